@@ -0,0 +1,574 @@
+#pragma once
+
+#include "Board.h"
+#include "Simd.h"
+#include <algorithm>
+#include <vector>
+
+//
+// Native animation curves. Each curve maps normalized time in [0, 1] to
+// progress from 0 to 1 with closed form math that can be evaluated at compile
+// time, and can be split into cubic pieces. An animation track strings those
+// pieces together in absolute time, which is exactly the form composition
+// animations take, so the app evaluates precisely what is on screen.
+//
+
+// Elementary functions that can be evaluated at compile time
+
+double constexpr CurvePi = 3.14159265358979323846;
+
+constexpr double CurveSqrt(double const x)
+{
+    double estimate = x > 1.0 ? x : 1.0;
+
+    for (unsigned i = 0; i != 64 && x > 0.0; ++i)
+    {
+        estimate = 0.5 * (estimate + x / estimate);
+    }
+
+    return x > 0.0 ? estimate : 0.0;
+}
+
+constexpr double CurveExp(double const x)
+{
+    // Halve the argument until the series converges quickly then square
+    // the result back up again.
+
+    double reduced = x;
+    unsigned halvings = 0;
+
+    while (reduced > 0.5 || reduced < -0.5)
+    {
+        reduced /= 2.0;
+        ++halvings;
+    }
+
+    double sum = 1.0;
+    double term = 1.0;
+
+    for (unsigned n = 1; n != 16; ++n)
+    {
+        term *= reduced / n;
+        sum += term;
+    }
+
+    for (; halvings; --halvings)
+    {
+        sum *= sum;
+    }
+
+    return sum;
+}
+
+constexpr double CurveSin(double const x)
+{
+    double reduced = x;
+
+    while (reduced > CurvePi) reduced -= 2.0 * CurvePi;
+    while (reduced < -CurvePi) reduced += 2.0 * CurvePi;
+
+    double sum = reduced;
+    double term = reduced;
+
+    for (unsigned n = 1; n != 12; ++n)
+    {
+        term *= -reduced * reduced / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+
+    return sum;
+}
+
+constexpr double CurveCos(double const x)
+{
+    return CurveSin(x + CurvePi / 2.0);
+}
+
+//
+// Constant acceleration from rest, constant velocity and then constant
+// deceleration to rest. The ratios are the fractions of the duration spent
+// accelerating and decelerating, as with the UIAnimation transition.
+//
+
+struct AccelerateDecelerate
+{
+    float Acceleration = 0.2f;
+    float Deceleration = 0.8f;
+
+    constexpr AccelerateDecelerate() = default;
+
+    constexpr AccelerateDecelerate(float const acceleration,
+                                   float const deceleration) :
+        Acceleration(acceleration),
+        Deceleration(deceleration)
+    {}
+
+    constexpr float Velocity() const
+    {
+        return 2.0f / (2.0f - Acceleration - Deceleration);
+    }
+
+    constexpr float operator()(float const t) const
+    {
+        float const velocity = Velocity();
+
+        if (t <= 0.0f) return 0.0f;
+        if (t >= 1.0f) return 1.0f;
+
+        if (t < Acceleration)
+        {
+            return velocity * t * t / (2.0f * Acceleration);
+        }
+
+        if (t <= 1.0f - Deceleration)
+        {
+            return velocity * (t - Acceleration / 2.0f);
+        }
+
+        float const remaining = 1.0f - t;
+        return 1.0f - velocity * remaining * remaining / (2.0f * Deceleration);
+    }
+
+    // Calls piece(begin, end, c0, c1, c2, c3) for each polynomial piece with
+    // the polynomial in time relative to the start of the piece.
+    template <typename Piece>
+    void Pieces(Piece && piece) const
+    {
+        float const velocity = Velocity();
+        float const cruise = 1.0f - Deceleration;
+
+        if (Acceleration > 0.0f)
+        {
+            piece(0.0f, Acceleration, 0.0f, 0.0f, velocity / (2.0f * Acceleration), 0.0f);
+        }
+
+        if (cruise > Acceleration)
+        {
+            piece(Acceleration, cruise, (*this)(Acceleration), velocity, 0.0f, 0.0f);
+        }
+
+        if (Deceleration > 0.0f)
+        {
+            piece(cruise, 1.0f, (*this)(cruise), velocity, -velocity / (2.0f * Deceleration), 0.0f);
+        }
+    }
+};
+
+// A cubic Hermite ease with the given starting and ending velocities
+struct CubicEase
+{
+    float StartVelocity = 0.0f;
+    float EndVelocity = 0.0f;
+
+    constexpr CubicEase() = default;
+
+    constexpr CubicEase(float const startVelocity,
+                        float const endVelocity) :
+        StartVelocity(startVelocity),
+        EndVelocity(endVelocity)
+    {}
+
+    constexpr float Quadratic() const
+    {
+        return 3.0f - 2.0f * StartVelocity - EndVelocity;
+    }
+
+    constexpr float Cubic() const
+    {
+        return StartVelocity + EndVelocity - 2.0f;
+    }
+
+    constexpr float operator()(float const t) const
+    {
+        if (t <= 0.0f) return 0.0f;
+        if (t >= 1.0f) return 1.0f;
+
+        return ((Cubic() * t + Quadratic()) * t + StartVelocity) * t;
+    }
+
+    template <typename Piece>
+    void Pieces(Piece && piece) const
+    {
+        piece(0.0f, 1.0f, 0.0f, StartVelocity, Quadratic(), Cubic());
+    }
+};
+
+//
+// A spring released from rest that settles on the target. Damping is the
+// damping ratio, so values below one overshoot, and the frequency is the
+// undamped angular frequency in radians over the whole duration. The spring
+// is split into cubic Hermite pieces with the last one landing exactly on
+// the target.
+//
+
+struct Spring
+{
+    float Damping = 0.5f;
+    float Frequency = 12.0f;
+    unsigned PieceCount = 12;
+
+    constexpr Spring() = default;
+
+    constexpr Spring(float const damping,
+                     float const frequency) :
+        Damping(damping),
+        Frequency(frequency)
+    {}
+
+    constexpr double Position(double const t) const
+    {
+        double const decay = CurveExp(-Damping * Frequency * t);
+
+        if (Damping >= 1.0f)
+        {
+            return 1.0 - decay * (1.0 + Frequency * t);
+        }
+
+        double const damped = Frequency * CurveSqrt(1.0 - Damping * Damping);
+
+        return 1.0 - decay * (CurveCos(damped * t) +
+                              Damping * Frequency / damped * CurveSin(damped * t));
+    }
+
+    constexpr double Velocity(double const t) const
+    {
+        double const decay = CurveExp(-Damping * Frequency * t);
+
+        if (Damping >= 1.0f)
+        {
+            return static_cast<double>(Frequency) * Frequency * t * decay;
+        }
+
+        double const damped = Frequency * CurveSqrt(1.0 - Damping * Damping);
+
+        return decay * Frequency * Frequency / damped * CurveSin(damped * t);
+    }
+
+    constexpr float operator()(float const t) const
+    {
+        if (t <= 0.0f) return 0.0f;
+        if (t >= 1.0f) return 1.0f;
+
+        return static_cast<float>(Position(t));
+    }
+
+    template <typename Piece>
+    void Pieces(Piece && piece) const
+    {
+        double const length = 1.0 / PieceCount;
+
+        for (unsigned i = 0; i != PieceCount; ++i)
+        {
+            bool const last = i + 1 == PieceCount;
+            double const begin = i * length;
+            double const end = last ? 1.0 : begin + length;
+
+            double const p0 = Position(begin);
+            double const p1 = last ? 1.0 : Position(end);
+            double const m0 = Velocity(begin) * length;
+            double const m1 = last ? 0.0 : Velocity(end) * length;
+
+            // Hermite basis in terms of s = t / length
+            double const c2 = 3.0 * (p1 - p0) - 2.0 * m0 - m1;
+            double const c3 = 2.0 * (p0 - p1) + m0 + m1;
+
+            piece(static_cast<float>(begin),
+                  static_cast<float>(end),
+                  static_cast<float>(p0),
+                  static_cast<float>(m0 / length),
+                  static_cast<float>(c2 / (length * length)),
+                  static_cast<float>(c3 / (length * length * length)));
+        }
+    }
+};
+
+// value = Constant + Linear * t + Quadratic * t^2 + Cubic * t^3 where t is
+// the time in seconds since Begin.
+struct CurveSegment
+{
+    double Begin;
+    float Constant;
+    float Linear;
+    float Quadratic;
+    float Cubic;
+
+    float Evaluate(double const time) const
+    {
+        float const t = static_cast<float>(time - Begin);
+        return ((Cubic * t + Quadratic) * t + Linear) * t + Constant;
+    }
+};
+
+unsigned const AnimationTrackCapacity = 20;
+
+//
+// The animation of one value. Each segment lasts until the next one begins
+// and the last until End, after which the value holds at Final. Before the
+// first segment the value is that at the start of the first segment.
+//
+
+struct AnimationTrack
+{
+    CurveSegment Segments[AnimationTrackCapacity];
+    unsigned Count = 0;
+    double End = 0.0;
+    float Final = 0.0f;
+
+    // The segment most recently found active, where the search starts
+    unsigned Active = 0;
+
+    unsigned Find(double const time)
+    {
+        if (Active >= Count || Segments[Active].Begin > time)
+        {
+            Active = 0;
+        }
+
+        while (Active + 1 < Count && Segments[Active + 1].Begin <= time)
+        {
+            ++Active;
+        }
+
+        return Active;
+    }
+
+    float Evaluate(double const time)
+    {
+        if (0 == Count || time >= End) return Final;
+        if (time <= Segments[0].Begin) return Segments[0].Constant;
+
+        return Segments[Find(time)].Evaluate(time);
+    }
+
+    void Set(float const value)
+    {
+        Count = 0;
+        Active = 0;
+        End = 0.0;
+        Final = value;
+    }
+
+    // Drops the segments that have finished by the given time, which is taken
+    // to be the present, so that a track does not grow with its history
+    void Trim(double const time)
+    {
+        if (0 == Count || time <= Segments[0].Begin) return;
+
+        Drop(time >= End ? Count : Find(time));
+    }
+
+    void Drop(unsigned const count)
+    {
+        for (unsigned i = count; i != Count; ++i)
+        {
+            Segments[i - count] = Segments[i];
+        }
+
+        Count -= count;
+        Active = 0;
+    }
+
+    //
+    // Animates from the value at the given time to the target. Whatever the
+    // track was going to do from then on is replaced: the segment under way
+    // at that time ends there and those after it are dropped. What it does
+    // before then is kept, even if the time is yet to come, with a gap after
+    // the last animation holding its final value. Room is made if need be by
+    // dropping the oldest segments.
+    //
+
+    template <typename Curve>
+    void Animate(double const begin,
+                 double const duration,
+                 float const target,
+                 Curve const & curve)
+    {
+        float const from = Evaluate(begin);
+
+        unsigned kept = 0;
+
+        while (kept != Count && Segments[kept].Begin < begin)
+        {
+            ++kept;
+        }
+
+        Count = kept;
+
+        if (0 != Count && begin > End && Count != AnimationTrackCapacity)
+        {
+            Segments[Count++] = { End, Final, 0.0f, 0.0f, 0.0f };
+        }
+
+        unsigned pieces = 0;
+
+        if (duration > 0.0)
+        {
+            curve.Pieces([&](float, float, float, float, float, float)
+            {
+                ++pieces;
+            });
+        }
+
+        if (Count + pieces > AnimationTrackCapacity)
+        {
+            Drop(std::min(Count, Count + pieces - AnimationTrackCapacity));
+        }
+
+        Active = 0;
+        End = begin + duration;
+        Final = target;
+
+        if (duration <= 0.0) return;
+
+        float const delta = target - from;
+        float const scale = static_cast<float>(1.0 / duration);
+
+        curve.Pieces([&](float const pieceBegin,
+                         float,
+                         float const c0,
+                         float const c1,
+                         float const c2,
+                         float const c3)
+        {
+            if (Count == AnimationTrackCapacity) return;
+
+            Segments[Count++] =
+            {
+                begin + pieceBegin * duration,
+                from + delta * c0,
+                delta * c1 * scale,
+                delta * c2 * scale * scale,
+                delta * c3 * scale * scale * scale
+            };
+        });
+    }
+};
+
+//
+// Evaluates a track per card. Finding each track's active segment is scalar
+// but cheap since it rarely changes between ticks; the polynomials for every
+// card are then evaluated together in one vector pass.
+//
+
+struct AnimationSet
+{
+    std::vector<AnimationTrack> Tracks;
+    std::vector<float> Values;
+    std::vector<float> Time;
+    std::vector<float> Constant;
+    std::vector<float> Linear;
+    std::vector<float> Quadratic;
+    std::vector<float> Cubic;
+
+    explicit AnimationSet(unsigned const count) :
+        Tracks(count),
+        Values(count),
+        Time(count),
+        Constant(count),
+        Linear(count),
+        Quadratic(count),
+        Cubic(count)
+    {}
+
+    unsigned Count() const
+    {
+        return static_cast<unsigned>(Tracks.size());
+    }
+
+    float const * Evaluate(double const time)
+    {
+        for (unsigned i = 0; i != Count(); ++i)
+        {
+            AnimationTrack & track = Tracks[i];
+
+            if (0 == track.Count || time >= track.End || time <= track.Segments[0].Begin)
+            {
+                Time[i] = 0.0f;
+                Constant[i] = track.Evaluate(time);
+                Linear[i] = Quadratic[i] = Cubic[i] = 0.0f;
+                continue;
+            }
+
+            CurveSegment const & segment = track.Segments[track.Find(time)];
+
+            Time[i] = static_cast<float>(time - segment.Begin);
+            Constant[i] = segment.Constant;
+            Linear[i] = segment.Linear;
+            Quadratic[i] = segment.Quadratic;
+            Cubic[i] = segment.Cubic;
+        }
+
+        unsigned i = 0;
+
+        #if SIMD_AVX2
+
+        for (; i + 8 <= Count(); i += 8)
+        {
+            __m256 const t = _mm256_loadu_ps(&Time[i]);
+            __m256 value = _mm256_loadu_ps(&Cubic[i]);
+            value = _mm256_add_ps(_mm256_mul_ps(value, t), _mm256_loadu_ps(&Quadratic[i]));
+            value = _mm256_add_ps(_mm256_mul_ps(value, t), _mm256_loadu_ps(&Linear[i]));
+            value = _mm256_add_ps(_mm256_mul_ps(value, t), _mm256_loadu_ps(&Constant[i]));
+            _mm256_storeu_ps(&Values[i], value);
+        }
+
+        #endif
+
+        #if SIMD_SSE2
+
+        for (; i + 4 <= Count(); i += 4)
+        {
+            __m128 const t = _mm_loadu_ps(&Time[i]);
+            __m128 value = _mm_loadu_ps(&Cubic[i]);
+            value = _mm_add_ps(_mm_mul_ps(value, t), _mm_loadu_ps(&Quadratic[i]));
+            value = _mm_add_ps(_mm_mul_ps(value, t), _mm_loadu_ps(&Linear[i]));
+            value = _mm_add_ps(_mm_mul_ps(value, t), _mm_loadu_ps(&Constant[i]));
+            _mm_storeu_ps(&Values[i], value);
+        }
+
+        #endif
+
+        for (; i != Count(); ++i)
+        {
+            Values[i] = ((Cubic[i] * Time[i] + Quadratic[i]) * Time[i] + Linear[i]) * Time[i] + Constant[i];
+        }
+
+        return Values.data();
+    }
+};
+
+//
+// Starts the flips for a click at the given time. The card clicked turns face
+// up from whatever angle it is at. Once it has, a completed pair turns away:
+// matched cards edge on so they disappear and mismatched cards face down.
+// Only the animations' Tracks are used, so a host may keep its own.
+//
+
+template <typename Animations, typename Curve>
+void AnimateClick(Animations & animations,
+                  ClickResult const result,
+                  unsigned const first,
+                  unsigned const next,
+                  double const time,
+                  Curve const & curve)
+{
+    if (ClickResult::Ignored == result) return;
+
+    AnimationTrack & shown = animations.Tracks[next];
+    shown.Trim(time);
+
+    float const angle = shown.Evaluate(time);
+    double const duration = (180.0f - angle) / 180.0f;
+
+    shown.Animate(time, duration, 180.0f, curve);
+
+    if (ClickResult::Shown == result) return;
+
+    float const hidden = ClickResult::Matched == result ? 90.0f : 0.0f;
+
+    // The first card may still be turning face up and the card clicked has
+    // yet to, so both turn away from what their tracks will have done by then
+    animations.Tracks[first].Trim(time);
+    animations.Tracks[first].Animate(time + duration, 1.0, hidden, curve);
+    shown.Animate(time + duration, 1.0, hidden, curve);
+}
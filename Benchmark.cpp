@@ -0,0 +1,3301 @@
+#include "Animation.h"
+#include "Board.h"
+#include "Layout.h"
+#include "Log.h"
+#include "Glyphs.h"
+#include "Host.h"
+#include "Resources.h"
+#include "ImageCache.h"
+#include "Input.h"
+#include "Jpeg.h"
+#include "Resample.h"
+#include "Pool.h"
+#include "Latency.h"
+#include "Matrix.h"
+#include "Picking.h"
+#include "Random.h"
+#include "Solver.h"
+#include "Surfaces.h"
+#include "Trace.h"
+#include "Viewport.h"
+#include "Window.h"
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <random>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+//
+// Headless benchmarks for the portable parts of the sample. Run without
+// arguments to run everything or name one or more benchmarks to run.
+//
+
+static unsigned const SimulationRows = 3;
+static unsigned const SimulationColumns = 6;
+static unsigned const SimulationGames = 1000000;
+
+// Every heap allocation in the process is counted so that benchmarks can
+// report how many a given operation makes.
+static atomic<unsigned long long> Allocations(0);
+
+void * operator new(size_t const size)
+{
+    ++Allocations;
+
+    if (void * const pointer = malloc(size ? size : 1))
+    {
+        return pointer;
+    }
+
+    throw bad_alloc();
+}
+
+// GCC pairs the replaced operator new with its own delete when inlining and
+// warns that free does not match.
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void * const pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void * const pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+struct Stopwatch
+{
+    steady_clock::time_point m_start = steady_clock::now();
+
+    double Seconds() const
+    {
+        return duration<double>(steady_clock::now() - m_start).count();
+    }
+};
+
+static void SimulateGames()
+{
+    unsigned const threads = max(1u, thread::hardware_concurrency());
+    vector<thread> workers;
+    vector<unsigned long long> clicks(threads);
+
+    Stopwatch const watch;
+
+    for (unsigned t = 0; t != threads; ++t)
+    {
+        workers.emplace_back([t, threads, &clicks]
+        {
+            Pcg32 generator(t);
+            GameState game(SimulationRows, SimulationColumns);
+            MemoryPlayer player;
+
+            unsigned long long count = 0;
+
+            for (unsigned i = t; i < SimulationGames; i += threads)
+            {
+                game.Reset(generator);
+                player.Play(game, generator);
+                count += game.Clicks;
+            }
+
+            clicks[t] = count;
+        });
+    }
+
+    for (thread & worker : workers)
+    {
+        worker.join();
+    }
+
+    double const seconds = watch.Seconds();
+
+    unsigned long long total = 0;
+
+    for (unsigned long long const count : clicks)
+    {
+        total += count;
+    }
+
+    printf("simulate: %u games (%ux%u) on %u threads in %.3fs, %.0f games/sec, %.2f clicks/game\n",
+           SimulationGames,
+           SimulationRows,
+           SimulationColumns,
+           threads,
+           seconds,
+           SimulationGames / seconds,
+           static_cast<double>(total) / SimulationGames);
+}
+
+struct HitTestBoard
+{
+    unsigned Rows;
+    unsigned Columns;
+};
+
+static HitTestBoard const HitTestBoards[] =
+{
+    { 3, 6 },
+    { 10, 10 },
+    { 30, 34 },
+    { 100, 100 },
+    { 250, 400 },
+};
+
+// The linear scan SampleWindow::CardAtPoint used before the grid index.
+static unsigned ScanCardAt(vector<float> const & offsetX,
+                           vector<float> const & offsetY,
+                           float const width,
+                           float const height,
+                           float const x,
+                           float const y)
+{
+    for (unsigned i = 0; i != offsetX.size(); ++i)
+    {
+        if (x > offsetX[i] &&
+            y > offsetY[i] &&
+            x < offsetX[i] + width &&
+            y < offsetY[i] + height)
+        {
+            return i;
+        }
+    }
+
+    return NoCard;
+}
+
+static void HitTest()
+{
+    float const margin = 15.0f;
+    float const width = 150.0f;
+    float const height = 210.0f;
+    float const dpi = 144.0f;
+
+    for (HitTestBoard const & board : HitTestBoards)
+    {
+        CardGrid grid;
+        grid.Build(board.Rows, board.Columns, margin, width, height, dpi, dpi);
+
+        vector<float> offsetX;
+        vector<float> offsetY;
+
+        for (unsigned row = 0; row != board.Rows; ++row)
+        for (unsigned column = 0; column != board.Columns; ++column)
+        {
+            offsetX.push_back(grid.OffsetX[column]);
+            offsetY.push_back(grid.OffsetY[row]);
+        }
+
+        float const right = grid.OffsetX.back() + grid.PitchX;
+        float const bottom = grid.OffsetY.back() + grid.PitchY;
+
+        unsigned const count = board.Rows * board.Columns;
+        unsigned const points = max(1000u, 100000000u / count);
+
+        mt19937 generator(count);
+        uniform_real_distribution<float> distributionX(0.0f, right);
+        uniform_real_distribution<float> distributionY(0.0f, bottom);
+
+        vector<float> x(points);
+        vector<float> y(points);
+
+        for (unsigned i = 0; i != points; ++i)
+        {
+            x[i] = floor(distributionX(generator));
+            y[i] = floor(distributionY(generator));
+        }
+
+        unsigned long long scanSum = 0;
+        Stopwatch const scanWatch;
+
+        for (unsigned i = 0; i != points; ++i)
+        {
+            scanSum += ScanCardAt(offsetX, offsetY, grid.Width, grid.Height, x[i], y[i]);
+        }
+
+        double const scanSeconds = scanWatch.Seconds();
+
+        unsigned long long gridSum = 0;
+        Stopwatch const gridWatch;
+
+        for (unsigned i = 0; i != points; ++i)
+        {
+            gridSum += grid.CardAt(x[i], y[i]);
+        }
+
+        double const gridSeconds = gridWatch.Seconds();
+
+        printf("hittest: %6u cards, scan %10.1f ns/click, grid %5.1f ns/click%s\n",
+               count,
+               scanSeconds * 1e9 / points,
+               gridSeconds * 1e9 / points,
+               scanSum == gridSum ? "" : " MISMATCH");
+    }
+}
+
+// A smooth gradient the size of background.jpg stands in for the image
+static Bitmap SyntheticImage(unsigned const width,
+                             unsigned const height)
+{
+    Bitmap image(width, height);
+
+    for (unsigned y = 0; y != height; ++y)
+    for (unsigned x = 0; x != width; ++x)
+    {
+        image.Row(y)[x] = (x * 255 / width) | (y * 255 / height) << 8 | ((x + y) & 0xFF) << 16;
+    }
+
+    return image;
+}
+
+// A filled disc with an anti-aliased edge stands in for a glyph
+static AlphaMask SyntheticGlyph(unsigned const size)
+{
+    AlphaMask mask(size, size);
+    float const radius = size / 2.0f;
+
+    for (unsigned y = 0; y != size; ++y)
+    for (unsigned x = 0; x != size; ++x)
+    {
+        float const dx = x + 0.5f - radius;
+        float const dy = y + 0.5f - radius;
+        float const edge = radius - sqrt(dx * dx + dy * dy);
+        mask.Coverage[y * size + x] = static_cast<uint8_t>(255.0f * min(1.0f, max(0.0f, edge)));
+    }
+
+    return mask;
+}
+
+static void Rasterize()
+{
+    Bitmap const image = SyntheticImage(1104, 737);
+    unsigned const repeat = 20;
+
+    for (float const dpi : { 96.0f, 144.0f, 192.0f })
+    {
+        CardGrid grid;
+        grid.Build(3, 6, 15.0f, 150.0f, 210.0f, dpi, dpi);
+
+        Bitmap card(static_cast<unsigned>(grid.Width),
+                    static_cast<unsigned>(grid.Height));
+
+        AlphaMask const glyph = SyntheticGlyph(card.Width / 2);
+        unsigned const count = grid.Rows * grid.Columns * repeat;
+
+        Stopwatch const clearWatch;
+
+        for (unsigned i = 0; i != count; ++i)
+        {
+            Clear(card, OpaqueWhite);
+        }
+
+        double const clearSeconds = clearWatch.Seconds();
+        Stopwatch const frontWatch;
+
+        for (unsigned i = 0; i != count; ++i)
+        {
+            RenderCardFront(card, glyph);
+        }
+
+        double const frontSeconds = frontWatch.Seconds();
+        Stopwatch const backWatch;
+
+        for (unsigned i = 0; i != repeat; ++i)
+        for (unsigned row = 0; row != grid.Rows; ++row)
+        for (unsigned column = 0; column != grid.Columns; ++column)
+        {
+            RenderCardBack(card,
+                           image,
+                           PhysicalToLogical(grid.OffsetX[column], dpi),
+                           PhysicalToLogical(grid.OffsetY[row], dpi),
+                           96.0f / dpi,
+                           96.0f / dpi);
+        }
+
+        double const backSeconds = backWatch.Seconds();
+        double const bytes = card.Pixels.size() * sizeof(uint32_t) * static_cast<double>(count);
+
+        printf("raster: %3.0f dpi %ux%u, clear %5.1f GB/s, front %7.1f us/card, back %7.1f us/card\n",
+               dpi,
+               card.Width,
+               card.Height,
+               bytes / clearSeconds / 1e9,
+               frontSeconds * 1e6 / count,
+               backSeconds * 1e6 / count);
+    }
+}
+
+// Glyphs of different sizes stand in for distinct letters
+static AlphaMask CardGlyph(unsigned const width,
+                           unsigned const height,
+                           wchar_t const value)
+{
+    AlphaMask mask(width, height);
+    AlphaMask const disc = SyntheticGlyph(width / 4 + value % 32);
+    unsigned const x = (width - disc.Width) / 2;
+    unsigned const y = (height - disc.Height) / 2;
+
+    for (unsigned row = 0; row != disc.Height; ++row)
+    {
+        memcpy(&mask.Coverage[(y + row) * mask.Width + x], disc.Row(row), disc.Width);
+    }
+
+    return mask;
+}
+
+static void ComposeFronts()
+{
+    GameState game(20, 40);
+    mt19937 generator(0);
+    game.Reset(generator);
+
+    Bitmap card(225, 315);
+    GlyphAtlas atlas;
+    unsigned rasterized = 0;
+
+    Stopwatch const watch;
+
+    for (float const dpi : { 144.0f, 96.0f, 144.0f })
+    {
+        atlas.Select(L"Synthetic", 105.0f, dpi, dpi);
+
+        for (unsigned i = 0; i != game.Cards.Count(); ++i)
+        {
+            GlyphEntry const glyph = atlas.Find(game.Cards.Value[i], [&](wchar_t const value)
+            {
+                ++rasterized;
+                return CardGlyph(card.Width, card.Height, value);
+            });
+
+            RenderCardFront(card, atlas.Pages[atlas.Current], glyph);
+        }
+    }
+
+    double const seconds = watch.Seconds();
+
+    printf("glyphs: %u fronts in %.3fs, %u rasterized, %u hits, %u misses\n",
+           game.Cards.Count() * 3,
+           seconds,
+           rasterized,
+           atlas.Hits,
+           atlas.Misses);
+
+    //
+    // Every capital of every deck at four times the usual DPI must still fit
+    // on sheets no taller than the cap, and each front drawn from the atlas
+    // must match one drawn from the glyph as it was rasterized.
+    //
+
+    Bitmap large(600, 840);
+    Bitmap expected(large.Width, large.Height);
+    GlyphAtlas highDpi;
+    highDpi.Select(L"Synthetic", 105.0f, 384.0f, 384.0f);
+    unsigned mismatches = 0;
+
+    for (wchar_t value = L'A'; value != L'A' + 224; ++value)
+    {
+        AlphaMask const mask = CardGlyph(large.Width, large.Height, value);
+
+        GlyphEntry const glyph = highDpi.Find(value, [&](wchar_t)
+        {
+            return mask;
+        });
+
+        RenderCardFront(large, highDpi.Pages[highDpi.Current], glyph);
+        RenderCardFront(expected, mask);
+
+        if (large.Pixels != expected.Pixels) ++mismatches;
+    }
+
+    GlyphPage const & page = highDpi.Pages[highDpi.Current];
+    unsigned tallest = 0;
+
+    for (AlphaMask const & sheet : page.Sheets)
+    {
+        tallest = max(tallest, sheet.Height);
+    }
+
+    printf("glyphs: 224 at 384 dpi on %u sheets, tallest %u rows%s\n",
+           static_cast<unsigned>(page.Sheets.size()),
+           tallest,
+           0 == mismatches && tallest <= GlyphSheetHeight ? "" : " MISMATCH");
+}
+
+struct MockFailure
+{
+    unsigned Card;
+};
+
+// Stands in for the composition device, counting the work it is asked to do
+// and failing on request once a given number of operations have succeeded.
+struct MockDevice
+{
+    unsigned Creates = 0;
+    unsigned Layouts = 0;
+    unsigned Draws = 0;
+    unsigned FailAfter = ~0u;
+
+    void Operation(unsigned const card)
+    {
+        if (0 == FailAfter--)
+        {
+            throw MockFailure{ card };
+        }
+    }
+
+    void CreateCard(unsigned const card)
+    {
+        Operation(card);
+        ++Creates;
+    }
+
+    void LayoutCard(unsigned const card)
+    {
+        Operation(card);
+        ++Layouts;
+    }
+
+    void DrawCard(unsigned const card)
+    {
+        Operation(card);
+        ++Draws;
+    }
+};
+
+static void Recover()
+{
+    GameState game(20, 40);
+    mt19937 generator(0);
+    game.Reset(generator);
+
+    for (unsigned i = 0; i != game.Cards.Count() / 4; ++i)
+    {
+        game.Cards.Status[i] = CardStatus::Matched;
+    }
+
+    // One card is face up, so its face is drawn along with the rest
+    unsigned const selected = game.Cards.Count() - 1;
+    game.Cards.Status[selected] = CardStatus::Selected;
+
+    ResourceGenerations generations(game.Cards.Count());
+
+    // Shows the card rather than updating them all if one is given
+    auto update = [&](char const * scenario, unsigned const failAfter, unsigned const shown = NoCard)
+    {
+        MockDevice device;
+        device.FailAfter = failAfter;
+        unsigned updated = 0;
+        bool failed = false;
+        Stopwatch const watch;
+
+        try
+        {
+            updated = NoCard == shown ?
+                      UpdateCards(device, generations, game.Cards) :
+                      ShowCard(device, generations, shown);
+        }
+        catch (MockFailure const & e)
+        {
+            failed = true;
+            updated = e.Card;
+        }
+
+        printf("recover: %-20s %-14s %3u, %3u creates, %3u layouts, %3u draws in %.1f us\n",
+               scenario,
+               failed ? "failed at card" : "updated cards",
+               updated,
+               device.Creates,
+               device.Layouts,
+               device.Draws,
+               watch.Seconds() * 1e6);
+    };
+
+    update("startup", ~0u);
+    update("nothing invalid", ~0u);
+
+    generations.InvalidateContent(selected);
+    update("one card changed", ~0u);
+
+    update("card shown", ~0u, selected - 1);
+    update("card shown again", ~0u, selected - 1);
+
+    generations.InvalidateLayout();
+    update("dpi change", ~0u);
+
+    generations.InvalidateLayout();
+    update("dpi change, failure", 500);
+    update("retry", ~0u);
+
+    generations.InvalidateDevice();
+    update("device lost", ~0u);
+}
+
+//
+// A minimal baseline encoder, only here to produce synthetic images of any
+// size for the decoder. It subsamples chroma 4:2:0 like the bundled image and
+// builds optimal Huffman tables from a first pass over the coefficients.
+//
+
+struct JpegTable
+{
+    uint32_t Frequency[257] = {};
+    uint8_t Counts[16] = {};
+    vector<uint8_t> Symbols;
+    uint16_t Codes[256] = {};
+    uint8_t Lengths[256] = {};
+
+    // Builds code lengths limited to sixteen bits as in Annex K.2 of the
+    // specification, reserving one code so that no code is all ones.
+    void Build()
+    {
+        uint32_t frequency[257];
+        copy(begin(Frequency), end(Frequency), frequency);
+        frequency[256] = 1;
+
+        int size[257] = {};
+        int others[257];
+        fill(begin(others), end(others), -1);
+
+        for (;;)
+        {
+            int first = -1;
+            int second = -1;
+
+            for (int i = 0; i != 257; ++i)
+            {
+                if (!frequency[i]) continue;
+
+                if (-1 == first || frequency[i] <= frequency[first])
+                {
+                    second = first;
+                    first = i;
+                }
+                else if (-1 == second || frequency[i] <= frequency[second])
+                {
+                    second = i;
+                }
+            }
+
+            if (-1 == second) break;
+
+            frequency[first] += frequency[second];
+            frequency[second] = 0;
+
+            for (int i = first;; i = others[i])
+            {
+                ++size[i];
+                if (-1 == others[i]) { others[i] = second; break; }
+            }
+
+            for (int i = second; -1 != i; i = others[i])
+            {
+                ++size[i];
+            }
+        }
+
+        int bits[33] = {};
+
+        for (int i = 0; i != 257; ++i)
+        {
+            if (size[i]) ++bits[size[i]];
+        }
+
+        for (int i = 32; i > 16; --i)
+        {
+            while (bits[i])
+            {
+                int j = i - 2;
+                while (!bits[j]) --j;
+
+                bits[i] -= 2;
+                ++bits[i - 1];
+                bits[j + 1] += 2;
+                --bits[j];
+            }
+        }
+
+        int longest = 16;
+        while (!bits[longest]) --longest;
+        --bits[longest];
+
+        Symbols.clear();
+
+        for (int length = 1; length <= 32; ++length)
+        {
+            for (int symbol = 0; symbol != 256; ++symbol)
+            {
+                if (size[symbol] == length) Symbols.push_back(static_cast<uint8_t>(symbol));
+            }
+        }
+
+        for (int length = 1; length <= 16; ++length)
+        {
+            Counts[length - 1] = static_cast<uint8_t>(bits[length]);
+        }
+
+        uint16_t code = 0;
+        unsigned index = 0;
+
+        for (int length = 1; length <= 16; ++length, code <<= 1)
+        {
+            for (unsigned i = 0; i != Counts[length - 1]; ++i, ++index, ++code)
+            {
+                Codes[Symbols[index]] = code;
+                Lengths[Symbols[index]] = static_cast<uint8_t>(length);
+            }
+        }
+    }
+};
+
+struct JpegBitWriter
+{
+    vector<uint8_t> & m_output;
+    uint32_t m_buffer = 0;
+    int m_count = 0;
+
+    explicit JpegBitWriter(vector<uint8_t> & output) :
+        m_output(output)
+    {}
+
+    void Write(uint32_t const bits,
+               int const length)
+    {
+        m_buffer = m_buffer << length | (bits & ((1u << length) - 1));
+        m_count += length;
+
+        while (m_count >= 8)
+        {
+            uint8_t const byte = static_cast<uint8_t>(m_buffer >> (m_count - 8));
+            m_output.push_back(byte);
+            if (0xFF == byte) m_output.push_back(0);
+            m_count -= 8;
+        }
+
+        m_buffer &= (1u << m_count) - 1;
+    }
+
+    // Pads the last byte with ones
+    void Flush()
+    {
+        if (m_count) Write(0x7F, 8 - m_count);
+    }
+};
+
+static unsigned Category(int const value)
+{
+    unsigned size = 0;
+
+    for (unsigned magnitude = abs(value); magnitude; magnitude >>= 1)
+    {
+        ++size;
+    }
+
+    return size;
+}
+
+static vector<uint8_t> EncodeJpeg(BitmapView const & image,
+                                  unsigned const restartInterval)
+{
+    unsigned const mcusX = (image.Width + 15) / 16;
+    unsigned const mcusY = (image.Height + 15) / 16;
+    unsigned const mcus = mcusX * mcusY;
+
+    uint8_t quant[2][64];
+    float cosines[8][8];
+
+    for (unsigned v = 0; v != 8; ++v)
+    for (unsigned u = 0; u != 8; ++u)
+    {
+        quant[0][v * 8 + u] = static_cast<uint8_t>(8 + (u + v) * 4);
+        quant[1][v * 8 + u] = static_cast<uint8_t>(12 + (u + v) * 6);
+        cosines[v][u] = cos((2 * v + 1) * u * 3.14159265f / 16) * (u ? 0.5f : 0.35355339f);
+    }
+
+    // Four luma blocks and one of each chroma per MCU, quantized in zigzag order
+    vector<int16_t> blocks(mcus * 6 * 64);
+
+    auto transform = [&](float const (&samples)[8][8], uint8_t const * table, int16_t * block)
+    {
+        float rows[8][8] = {};
+
+        for (unsigned y = 0; y != 8; ++y)
+        for (unsigned u = 0; u != 8; ++u)
+        for (unsigned x = 0; x != 8; ++x)
+        {
+            rows[y][u] += samples[y][x] * cosines[x][u];
+        }
+
+        for (unsigned k = 0; k != 64; ++k)
+        {
+            unsigned const natural = JpegNaturalOrder[k];
+            float sum = 0.0f;
+
+            for (unsigned y = 0; y != 8; ++y)
+            {
+                sum += rows[y][natural % 8] * cosines[y][natural / 8];
+            }
+
+            block[k] = static_cast<int16_t>(lrintf(sum / table[natural]));
+        }
+    };
+
+    for (unsigned mcu = 0; mcu != mcus; ++mcu)
+    {
+        float luma[4][8][8];
+        float chroma[2][8][8] = {};
+
+        for (unsigned y = 0; y != 16; ++y)
+        for (unsigned x = 0; x != 16; ++x)
+        {
+            unsigned const pixelX = min(image.Width - 1, mcu % mcusX * 16 + x);
+            unsigned const pixelY = min(image.Height - 1, mcu / mcusX * 16 + y);
+            uint32_t const pixel = image.Row(pixelY)[pixelX];
+            float const r = static_cast<float>(pixel >> 16 & 0xFF);
+            float const g = static_cast<float>(pixel >> 8 & 0xFF);
+            float const b = static_cast<float>(pixel & 0xFF);
+
+            luma[y / 8 * 2 + x / 8][y % 8][x % 8] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+            chroma[0][y / 2][x / 2] += (-0.168736f * r - 0.331264f * g + 0.5f * b) / 4;
+            chroma[1][y / 2][x / 2] += (0.5f * r - 0.418688f * g - 0.081312f * b) / 4;
+        }
+
+        int16_t * block = &blocks[mcu * 6 * 64];
+
+        for (unsigned i = 0; i != 4; ++i)
+        {
+            transform(luma[i], quant[0], block + i * 64);
+        }
+
+        transform(chroma[0], quant[1], block + 4 * 64);
+        transform(chroma[1], quant[1], block + 5 * 64);
+    }
+
+    // Walks the symbols in stream order, once to count them and once to write
+    // them. Tables are numbered DC and AC luma then DC and AC chroma.
+    auto walk = [&](auto && symbol, auto && restart)
+    {
+        int predictors[3] = {};
+
+        for (unsigned mcu = 0; mcu != mcus; ++mcu)
+        {
+            if (restartInterval && mcu && 0 == mcu % restartInterval)
+            {
+                restart(mcu / restartInterval - 1);
+                fill(begin(predictors), end(predictors), 0);
+            }
+
+            for (unsigned i = 0; i != 6; ++i)
+            {
+                int16_t const * block = &blocks[(mcu * 6 + i) * 64];
+                unsigned const component = i < 4 ? 0 : i - 3;
+                unsigned const table = component ? 2 : 0;
+                int const difference = block[0] - predictors[component];
+                predictors[component] = block[0];
+
+                symbol(table, Category(difference), difference);
+
+                unsigned run = 0;
+
+                for (unsigned k = 1; k != 64; ++k)
+                {
+                    if (!block[k])
+                    {
+                        ++run;
+                        continue;
+                    }
+
+                    for (; run >= 16; run -= 16)
+                    {
+                        symbol(table + 1, 0xF0u, 0);
+                    }
+
+                    symbol(table + 1, run << 4 | Category(block[k]), block[k]);
+                    run = 0;
+                }
+
+                if (run) symbol(table + 1, 0u, 0);
+            }
+        }
+    };
+
+    JpegTable tables[4];
+
+    walk([&](unsigned const table, unsigned const value, int)
+    {
+        ++tables[table].Frequency[value];
+    },
+    [](unsigned) {});
+
+    for (JpegTable & table : tables)
+    {
+        table.Build();
+    }
+
+    vector<uint8_t> output;
+
+    auto marker = [&](uint8_t const type, unsigned const length)
+    {
+        output.insert(output.end(), { 0xFF, type });
+        if (length) output.insert(output.end(), { static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length) });
+    };
+
+    auto word = [&](unsigned const value)
+    {
+        output.insert(output.end(), { static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value) });
+    };
+
+    marker(0xD8, 0);
+    marker(0xDB, 2 + 2 * 65);
+
+    for (uint8_t t = 0; t != 2; ++t)
+    {
+        output.push_back(t);
+
+        for (unsigned k = 0; k != 64; ++k)
+        {
+            output.push_back(quant[t][JpegNaturalOrder[k]]);
+        }
+    }
+
+    marker(0xC0, 17);
+    output.push_back(8);
+    word(image.Height);
+    word(image.Width);
+    output.insert(output.end(), { 3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 });
+
+    uint8_t const classes[4] = { 0x00, 0x10, 0x01, 0x11 };
+
+    for (unsigned t = 0; t != 4; ++t)
+    {
+        marker(0xC4, static_cast<unsigned>(2 + 17 + tables[t].Symbols.size()));
+        output.push_back(classes[t]);
+        output.insert(output.end(), begin(tables[t].Counts), end(tables[t].Counts));
+        output.insert(output.end(), tables[t].Symbols.begin(), tables[t].Symbols.end());
+    }
+
+    if (restartInterval)
+    {
+        marker(0xDD, 4);
+        word(restartInterval);
+    }
+
+    marker(0xDA, 12);
+    output.insert(output.end(), { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 });
+
+    JpegBitWriter writer(output);
+
+    walk([&](unsigned const table, unsigned const value, int const extra)
+    {
+        writer.Write(tables[table].Codes[value], tables[table].Lengths[value]);
+
+        if (unsigned const size = value & 15)
+        {
+            writer.Write(extra < 0 ? extra - 1 : extra, size);
+        }
+    },
+    [&](unsigned const index)
+    {
+        writer.Flush();
+        marker(static_cast<uint8_t>(0xD0 + index % 8), 0);
+    });
+
+    writer.Flush();
+    marker(0xD9, 0);
+    return output;
+}
+
+// Smooth shading with some noise so that the entropy coded data is not trivial
+static Bitmap SyntheticPhoto(unsigned const width,
+                             unsigned const height)
+{
+    Bitmap image(width, height);
+    uint32_t noise = 0x2545F491;
+
+    for (unsigned y = 0; y != height; ++y)
+    for (unsigned x = 0; x != width; ++x)
+    {
+        noise ^= noise << 13;
+        noise ^= noise >> 17;
+        noise ^= noise << 5;
+
+        unsigned const r = (x * 255 / width + (noise & 15)) & 0xFF;
+        unsigned const g = ((x * x + y * y * 3) >> 9 & 0xFF) / 2 + 64;
+        unsigned const b = (y * 255 / height + (noise >> 8 & 7)) & 0xFF;
+
+        image.Row(y)[x] = 0xFF000000 | r << 16 | g << 8 | b;
+    }
+
+    return image;
+}
+
+static double MeanError(BitmapView const & a,
+                        BitmapView const & b)
+{
+    double sum = 0.0;
+
+    for (unsigned i = 0; i != a.Width * a.Height; ++i)
+    {
+        for (unsigned shift = 0; shift != 24; shift += 8)
+        {
+            sum += abs(static_cast<int>(a.Pixels[i] >> shift & 0xFF) - static_cast<int>(b.Pixels[i] >> shift & 0xFF));
+        }
+    }
+
+    return sum / (a.Width * a.Height * 3.0);
+}
+
+static bool ReadFile(PathChar const * path,
+                     vector<uint8_t> & data)
+{
+    FILE * file = OpenPath(path, PATH_TEXT("rb"));
+
+    if (!file) return false;
+
+    uint8_t buffer[65536];
+
+    for (size_t read; 0 != (read = fread(buffer, 1, sizeof(buffer), file));)
+    {
+        data.insert(data.end(), buffer, buffer + read);
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void DecodeJpegs()
+{
+    struct JpegInput
+    {
+        char const * Name;
+        vector<uint8_t> Data;
+        Bitmap Source;
+    };
+
+    vector<JpegInput> inputs(1);
+    inputs.back().Name = "background.jpg";
+
+    if (!ReadFile(PATH_TEXT("background.jpg"), inputs.back().Data))
+    {
+        printf("jpeg: background.jpg not found, run from the project directory\n");
+        inputs.pop_back();
+    }
+
+    auto synthetic = [&](char const * name, unsigned const width, unsigned const height, bool const restarts)
+    {
+        inputs.emplace_back();
+        inputs.back().Name = name;
+        inputs.back().Source = SyntheticPhoto(width, height);
+        inputs.back().Data = EncodeJpeg(inputs.back().Source, restarts ? (width + 15) / 16 : 0);
+    };
+
+    synthetic("1104x737", 1104, 737, false);
+    synthetic("1104x737, restarts", 1104, 737, true);
+    synthetic("4096x4096, restarts", 4096, 4096, true);
+
+    unsigned const threads = HardwareThreads();
+
+    for (JpegInput const & input : inputs)
+    {
+        // The encoder is lossy so this only catches gross decoding errors
+        Bitmap const image = DecodeJpeg(input.Data.data(), input.Data.size());
+        bool const valid = input.Source.Pixels.empty() || MeanError(image, input.Source) < 12.0;
+
+        auto measure = [&](unsigned const count)
+        {
+            unsigned iterations = 0;
+            Stopwatch const watch;
+
+            do
+            {
+                DecodeJpeg(input.Data.data(), input.Data.size(), count);
+                ++iterations;
+            }
+            while (watch.Seconds() < 0.25);
+
+            return watch.Seconds() / iterations;
+        };
+
+        double const single = measure(1);
+        double const parallel = measure(threads);
+
+        printf("jpeg: %-22s %5u KB %7.2f ms 1 thread %7.2f ms %u threads %6.1f MP/s%s\n",
+               input.Name,
+               static_cast<unsigned>(input.Data.size() / 1024),
+               single * 1e3,
+               parallel * 1e3,
+               threads,
+               image.Width * image.Height / parallel / 1e6,
+               valid ? "" : " FAILED");
+    }
+}
+
+static void ResampleBacks()
+{
+    Bitmap const image = SyntheticPhoto(1104, 737);
+
+    Stopwatch const pyramidWatch;
+
+    MipPyramid pyramid;
+    pyramid.Reset(image);
+    pyramid.Level(pyramid.Select(16.0f, 16.0f));
+
+    printf("resample: pyramid of %u levels in %.2f ms\n",
+           static_cast<unsigned>(pyramid.Levels.size()),
+           pyramidWatch.Seconds() * 1e3);
+
+    for (float const dpi : { 40.0f, 96.0f, 144.0f, 192.0f })
+    {
+        float const scale = 96.0f / dpi;
+        Bitmap atlas(static_cast<unsigned>(image.Width / scale),
+                     static_cast<unsigned>(image.Height / scale));
+
+        double seconds[3] = {};
+        unsigned const level = pyramid.Select(scale, scale);
+        BitmapView const source = pyramid.Level(level);
+
+        for (ResampleFilter const filter : { ResampleFilter::Box, ResampleFilter::Bilinear, ResampleFilter::Lanczos })
+        {
+            Stopwatch const watch;
+
+            Resample(atlas,
+                     source,
+                     0.5f,
+                     0.0f,
+                     scale * source.Width / image.Width,
+                     scale * source.Height / image.Height,
+                     filter,
+                     1);
+
+            seconds[static_cast<unsigned>(filter)] = watch.Seconds();
+        }
+
+        printf("resample: %3.0f dpi %4ux%-4u level %u, per pixel box %5.1f ns, bilinear %5.1f ns, lanczos %5.1f ns\n",
+               dpi,
+               atlas.Width,
+               atlas.Height,
+               level,
+               seconds[0] * 1e9 / atlas.Pixels.size(),
+               seconds[1] * 1e9 / atlas.Pixels.size(),
+               seconds[2] * 1e9 / atlas.Pixels.size());
+    }
+
+    // Moving between two monitors and back again
+    ResampleCache cache;
+    cache.Reset(image);
+
+    Stopwatch const cacheWatch;
+
+    for (unsigned i = 0; i != 10; ++i)
+    {
+        float const dpi = i % 2 ? 144.0f : 96.0f;
+
+        cache.Find(dpi,
+                   dpi,
+                   static_cast<unsigned>(image.Width * dpi / 96.0f),
+                   static_cast<unsigned>(image.Height * dpi / 96.0f));
+    }
+
+    printf("resample: 10 dpi changes in %.2f ms, %u hits, %u misses\n",
+           cacheWatch.Seconds() * 1e3,
+           cache.Hits,
+           cache.Misses);
+}
+
+//
+// Golden values for the flip curve, which must keep the 0.2 / 0.8 profile of
+// the UIAnimation accelerate-decelerate transition it replaced.
+//
+
+constexpr bool Near(double const a,
+                    double const b)
+{
+    return a - b < 1e-5 && b - a < 1e-5;
+}
+
+constexpr AccelerateDecelerate FlipCurve(0.2f, 0.8f);
+
+static_assert(Near(FlipCurve(0.0f), 0.0), "");
+static_assert(Near(FlipCurve(0.1f), 0.05), "");
+static_assert(Near(FlipCurve(0.2f), 0.2), "");
+static_assert(Near(FlipCurve(0.3f), 0.3875), "");
+static_assert(Near(FlipCurve(0.5f), 0.6875), "");
+static_assert(Near(FlipCurve(0.8f), 0.95), "");
+static_assert(Near(FlipCurve(1.0f), 1.0), "");
+static_assert(Near(AccelerateDecelerate(0.25f, 0.25f)(0.5f), 0.5), "");
+static_assert(Near(CubicEase(0.0f, 0.0f)(0.5f), 0.5), "");
+static_assert(Near(CubicEase(1.0f, 1.0f)(0.25f), 0.25), "");
+static_assert(Near(CurveExp(-3.0), 0.049787068), "");
+static_assert(Near(CurveSin(CurvePi / 6.0), 0.5), "");
+static_assert(Near(Spring(1.0f, 10.0f).Position(0.5), 1.0 - 6.0 * 0.006737947), "");
+static_assert(Near(Spring().Velocity(0.0), 0.0), "");
+
+// The largest difference between a curve and the track built from its pieces
+template <typename Curve>
+static float PieceError(Curve const & curve)
+{
+    AnimationTrack track;
+    track.Animate(10.0, 2.0, 1.0f, curve);
+
+    float error = 0.0f;
+
+    for (unsigned i = 0; i <= 1000; ++i)
+    {
+        float const t = i / 1000.0f;
+        error = max(error, fabs(track.Evaluate(10.0 + t * 2.0) - curve(t)));
+    }
+
+    return error;
+}
+
+struct ClickAngle
+{
+    unsigned Card;
+    double Time;
+    float Angle;
+};
+
+// Plays two clicks through AnimateClick and checks the angles the cards
+// are at along the way
+static bool CheckClickAngles(double const shown,
+                             double const clicked,
+                             ClickResult const result,
+                             initializer_list<ClickAngle> const expected)
+{
+    AnimationSet set(2);
+
+    AnimateClick(set, ClickResult::Shown, NoCard, 0, shown, FlipCurve);
+    AnimateClick(set, result, 0, 1, clicked, FlipCurve);
+
+    bool matches = true;
+
+    for (ClickAngle const & angle : expected)
+    {
+        matches = matches && fabs(set.Tracks[angle.Card].Evaluate(angle.Time) - angle.Angle) < 0.01f;
+
+        // Composition animations are built from the track as it stands
+        float const * values = set.Evaluate(angle.Time);
+        matches = matches && fabs(values[angle.Card] - angle.Angle) < 0.01f;
+    }
+
+    return matches;
+}
+
+static bool CheckClickAngles()
+{
+    float const half = 180.0f * FlipCurve(0.5f);
+    float const late = 180.0f * FlipCurve(0.75f);
+
+    // The second card turns face up before the pair turns away
+    bool const mismatched = CheckClickAngles(1.0, 5.0, ClickResult::Mismatched,
+    {
+        { 1, 5.0, 0.0f }, { 1, 5.5, half }, { 1, 6.0, 180.0f }, { 1, 6.5, 180.0f - half }, { 1, 7.0, 0.0f },
+        { 0, 5.0, 180.0f }, { 0, 6.0, 180.0f }, { 0, 6.5, 180.0f - half }, { 0, 7.0, 0.0f },
+    });
+
+    bool const matched = CheckClickAngles(1.0, 5.0, ClickResult::Matched,
+    {
+        { 1, 5.5, half }, { 1, 6.0, 180.0f }, { 1, 6.5, 180.0f - half / 2.0f }, { 1, 7.0, 90.0f },
+        { 0, 6.0, 180.0f }, { 0, 7.0, 90.0f },
+    });
+
+    // The first card is still turning face up when the second is clicked, and
+    // finishes before the pair turns away
+    bool const interrupted = CheckClickAngles(1.0, 1.5, ClickResult::Mismatched,
+    {
+        { 0, 1.5, half }, { 0, 1.75, late }, { 0, 2.0, 180.0f }, { 0, 2.5, 180.0f }, { 0, 3.0, 180.0f - half },
+        { 1, 2.0, half }, { 1, 2.5, 180.0f }, { 1, 3.5, 0.0f },
+    });
+
+    return mismatched && matched && interrupted;
+}
+
+static void Animate()
+{
+    printf("animate: click flips %s\n", CheckClickAngles() ? "turn face up before turning away" : "MISMATCH");
+
+    printf("animate: piece error accelerate-decelerate %.2g, cubic %.2g, spring %.2g\n",
+           PieceError(FlipCurve),
+           PieceError(CubicEase(0.5f, 0.0f)),
+           PieceError(Spring()));
+
+    for (unsigned const count : { 18u, 1000u, 100000u })
+    {
+        AnimationSet set(count);
+        mt19937 generator(count);
+        uniform_real_distribution<double> start(0.0, 2.0);
+
+        // Flips in progress, some interrupted part way and sent back again
+        for (unsigned i = 0; i != count; ++i)
+        {
+            AnimationTrack & track = set.Tracks[i];
+            double const begin = start(generator);
+
+            track.Animate(begin, 1.0, 180.0f, FlipCurve);
+
+            if (i % 3 == 0)
+            {
+                track.Animate(begin + 1.0, 1.0, 0.0f, FlipCurve);
+            }
+            else if (i % 3 == 1)
+            {
+                track.Animate(begin + 0.5, 0.5, 90.0f, Spring());
+            }
+        }
+
+        unsigned const ticks = max(10u, 10000000u / count);
+        float error = 0.0f;
+        Stopwatch const watch;
+
+        for (unsigned tick = 0; tick != ticks; ++tick)
+        {
+            set.Evaluate(tick * 4.0 / ticks);
+        }
+
+        double const seconds = watch.Seconds();
+
+        for (unsigned tick = 0; tick != 100; ++tick)
+        {
+            double const time = tick * 0.04;
+            float const * values = set.Evaluate(time);
+
+            for (unsigned i = 0; i != count; ++i)
+            {
+                error = max(error, fabs(values[i] - set.Tracks[i].Evaluate(time)));
+            }
+        }
+
+        printf("animate: %6u cards %6.2f ns/card/tick%s\n",
+               count,
+               seconds * 1e9 / ticks / count,
+               error < 1e-3f ? "" : " MISMATCH");
+    }
+}
+
+// Stands in for IDCompositionAnimation: it grows storage for its segments and
+// is copied when a visual takes it, just as SetAngle copies the animation.
+struct MockAnimation
+{
+    vector<CurveSegment> Segments;
+    double End = 0.0;
+    float Final = 0.0f;
+
+    void Reset()
+    {
+        Segments.clear();
+    }
+};
+
+static void BuildAnimation(MockAnimation & animation,
+                           AnimationTrack const & track)
+{
+    double const begin = track.Segments[0].Begin;
+
+    for (unsigned i = 0; i != track.Count; ++i)
+    {
+        CurveSegment segment = track.Segments[i];
+        segment.Begin -= begin;
+        animation.Segments.push_back(segment);
+    }
+
+    animation.End = track.End - begin;
+    animation.Final = track.Final;
+}
+
+static void ClickLatency()
+{
+    unsigned const clicks = 200000;
+
+    for (bool const pooled : { false, true })
+    {
+        GameState game(SimulationRows, SimulationColumns);
+        unsigned const count = game.Cards.Count();
+        mt19937 generator(12);
+        uniform_int_distribution<unsigned> pick(0, count - 1);
+        AnimationSet animations(count);
+        ObjectPool<unique_ptr<MockAnimation>> pools[4];
+        vector<MockAnimation> applied(count);
+        LatencyRecorder latency(clicks);
+        double time = 0.0;
+
+        game.Reset(generator);
+
+        auto update = [&](unsigned const card, ObjectPool<unique_ptr<MockAnimation>> & pool)
+        {
+            unique_ptr<MockAnimation> fresh;
+            MockAnimation * animation = nullptr;
+
+            if (pooled)
+            {
+                animation = pool.Acquire([] { return make_unique<MockAnimation>(); }).get();
+                animation->Reset();
+            }
+            else
+            {
+                fresh = make_unique<MockAnimation>();
+                animation = fresh.get();
+            }
+
+            BuildAnimation(*animation, animations.Tracks[card]);
+            applied[card] = *animation;
+        };
+
+        unsigned long long const before = Allocations;
+        unsigned handled = 0;
+
+        while (handled != clicks)
+        {
+            if (game.IsComplete())
+            {
+                game.Reset(generator);
+            }
+
+            unsigned const first = game.FirstCard;
+            unsigned const next = pick(generator);
+            time += 0.3;
+
+            Stopwatch const watch;
+            ClickResult const result = game.Click(next);
+
+            if (ClickResult::Ignored == result) continue;
+
+            ObjectPool<unique_ptr<MockAnimation>> & pool = pools[static_cast<unsigned>(result)];
+            pool.Recycle();
+
+            AnimateClick(animations, result, first, next, time, FlipCurve);
+            update(next, pool);
+
+            if (ClickResult::Shown != result)
+            {
+                update(first, pool);
+            }
+
+            latency.Record(watch.Seconds());
+            ++handled;
+        }
+
+        printf("click: %s %5.2f allocations/click, p50 %4.0f ns, p99 %5.0f ns\n",
+               pooled ? "pooled" : "fresh ",
+               static_cast<double>(Allocations - before) / clicks,
+               latency.Percentile(0.5) * 1e9,
+               latency.Percentile(0.99) * 1e9);
+    }
+}
+
+// The product exactly as D2D1::Matrix4x4F::operator* spells it out.
+static Matrix4x4 ReferenceProduct(Matrix4x4 const & a,
+                                  Matrix4x4 const & b)
+{
+    Matrix4x4 result;
+
+    for (unsigned row = 0; row != 4; ++row)
+    {
+        for (unsigned column = 0; column != 4; ++column)
+        {
+            result.M[row][column] = a.M[row][0] * b.M[0][column] +
+                                    a.M[row][1] * b.M[1][column] +
+                                    a.M[row][2] * b.M[2][column] +
+                                    a.M[row][3] * b.M[3][column];
+        }
+    }
+
+    return result;
+}
+
+static void ComposeMatrices()
+{
+    // A half turn must have a sine of exactly zero or the front of every
+    // card would be very slightly skewed.
+    float sine = 1.0f;
+    float cosine = 0.0f;
+    Matrix4x4::SinCos(180.0f * (3.141592654f / 180.0f), sine, cosine);
+
+    float sinCosError = 0.0f;
+
+    for (int degrees = -720; degrees <= 720; ++degrees)
+    {
+        float const radians = degrees * (3.141592654f / 180.0f);
+        float s = 0.0f;
+        float c = 0.0f;
+        Matrix4x4::SinCos(radians, s, c);
+
+        sinCosError = max(sinCosError, max(fabs(s - sinf(radians)), fabs(c - cosf(radians))));
+    }
+
+    mt19937 generator(13);
+    uniform_real_distribution<float> element(-1000.0f, 1000.0f);
+    unsigned mismatches = 0;
+
+    for (unsigned i = 0; i != 100000; ++i)
+    {
+        Matrix4x4 a;
+        Matrix4x4 b;
+
+        for (unsigned j = 0; j != 16; ++j)
+        {
+            a.M[j / 4][j % 4] = element(generator);
+            b.M[j / 4][j % 4] = element(generator);
+        }
+
+        Matrix4x4 const product = a * b;
+        Matrix4x4 const expected = ReferenceProduct(a, b);
+
+        mismatches += 0 != memcmp(&product, &expected, sizeof(product));
+    }
+
+    // Compose the whole card transform for a range of angles, as the
+    // compositor does every frame while cards are flipping.
+    unsigned const count = 1000000;
+    Matrix4x4 const pre = CardPreTransform(150.0f, 210.0f, true);
+    Matrix4x4 const post = CardPostTransform(150.0f, 210.0f);
+    float simdSum = 0.0f;
+    float referenceSum = 0.0f;
+
+    Stopwatch const simdWatch;
+
+    for (unsigned i = 0; i != count; ++i)
+    {
+        simdSum += (pre * Matrix4x4::RotationY(i * (180.0f / count)) * post).M[3][0];
+    }
+
+    double const simdSeconds = simdWatch.Seconds();
+
+    Stopwatch const referenceWatch;
+
+    for (unsigned i = 0; i != count; ++i)
+    {
+        referenceSum += ReferenceProduct(ReferenceProduct(pre, Matrix4x4::RotationY(i * (180.0f / count))), post).M[3][0];
+    }
+
+    double const referenceSeconds = referenceWatch.Seconds();
+
+    printf("matrix: %.2f ns/card, reference %.2f ns/card, sincos error %.2g%s\n",
+           simdSeconds * 1e9 / count,
+           referenceSeconds * 1e9 / count,
+           sinCosError,
+           0.0f == sine && -1.0f == cosine && 0 == mismatches && simdSum == referenceSum && sinCosError < 1e-6f ? "" : " MISMATCH");
+}
+
+// How far inside a turned card a point lands, found by inverting the card's
+// projection analytically rather than projecting its corners. Negative
+// distances are outside the card.
+static double ReferenceInside(double const width,
+                              double const height,
+                              double const angle,
+                              double const x,
+                              double const y)
+{
+    double const radians = angle * CurvePi / 180.0;
+    double const depth = width * 2.0;
+    double const centreX = x - width / 2.0;
+    double const denominator = cos(radians) - centreX * sin(radians) / depth;
+
+    if (fabs(denominator) < 1e-9) return -1.0;
+
+    double const u = centreX / denominator;
+    double const w = 1.0 + u * sin(radians) / depth;
+    double const v = (y - height / 2.0) * w;
+
+    return min(width / 2.0 - fabs(u), height / 2.0 - fabs(v));
+}
+
+static void PickCards()
+{
+    float const margin = 15.0f;
+    float const width = 150.0f;
+    float const height = 210.0f;
+    unsigned const picks = 200000;
+
+    CardGrid grid;
+    grid.Build(SimulationRows, SimulationColumns, margin, width, height, 96.0f, 96.0f);
+
+    float const right = grid.OffsetX.back() + grid.Width + margin;
+    float const bottom = grid.OffsetY.back() + grid.Height + margin;
+
+    mt19937 generator(14);
+    uniform_real_distribution<float> pointX(0.0f, right);
+    uniform_real_distribution<float> pointY(0.0f, bottom);
+
+    vector<float> xs(picks);
+    vector<float> ys(picks);
+
+    for (unsigned i = 0; i != picks; ++i)
+    {
+        xs[i] = pointX(generator);
+        ys[i] = pointY(generator);
+    }
+
+    for (unsigned const flipping : { 0u, 2u, SimulationRows * SimulationColumns })
+    {
+        AnimationSet animations(SimulationRows * SimulationColumns);
+        CardPicker picker;
+
+        // Flips that started up to a second ago so every angle is covered
+        uniform_real_distribution<double> begin(-1.0, 0.0);
+
+        for (unsigned card = 0; card != flipping; ++card)
+        {
+            animations.Tracks[card * animations.Count() / flipping].Animate(begin(generator), 1.0, 180.0f, FlipCurve);
+        }
+
+        unsigned found = 0;
+        Stopwatch const watch;
+
+        for (unsigned i = 0; i != picks; ++i)
+        {
+            found += NoCard != picker.CardAt(grid, animations, 0.0, xs[i], ys[i]);
+        }
+
+        double const seconds = watch.Seconds();
+
+        // Compare each pick with the topmost card the reference finds under
+        // the point and with the flat rectangle the grid alone would pick.
+        // Points within a hundredth of a pixel of an edge are skipped since
+        // either answer is then right.
+
+        unsigned wrong = 0;
+        unsigned flatWrong = 0;
+
+        for (unsigned i = 0; i != picks; ++i)
+        {
+            unsigned expected = NoCard;
+            bool ambiguous = false;
+
+            for (unsigned card = 0; card != animations.Count(); ++card)
+            {
+                double const inside = ReferenceInside(grid.Width,
+                                                      grid.Height,
+                                                      animations.Tracks[card].Evaluate(0.0),
+                                                      xs[i] - grid.OffsetX[card % grid.Columns],
+                                                      ys[i] - grid.OffsetY[card / grid.Columns]);
+
+                ambiguous = ambiguous || fabs(inside) < 0.01;
+
+                if (inside > 0.0)
+                {
+                    expected = card;
+                }
+            }
+
+            if (ambiguous) continue;
+
+            wrong += expected != picker.CardAt(grid, animations, 0.0, xs[i], ys[i]);
+            flatWrong += expected != grid.CardAt(xs[i], ys[i]);
+        }
+
+        printf("pick: %2u flipping %6.2f ns/pick, %u wrong, %u wrong without projection%s\n",
+               flipping,
+               seconds * 1e9 / picks,
+               wrong,
+               flatWrong,
+               found && !wrong ? "" : " MISMATCH");
+    }
+}
+
+// Drives the portable part of each of SampleWindow's handlers from an input
+// log: picking and flipping for clicks, the grid for DPI changes and the
+// card updates for paints. A fuzzed session deals again once a game is won
+// so that a long stream keeps exercising the click path.
+struct HeadlessSession
+{
+    GameState Game;
+    CardGrid Grid;
+    CardPicker Picker;
+    AnimationSet Animations;
+    ResourceGenerations Generations;
+    MockDevice Device;
+    Pcg32 Generator;
+    bool Redeal = false;
+    unsigned Games = 0;
+
+    explicit HeadlessSession(InputLog const & log) :
+        Game(log.Rows, log.Columns),
+        Animations(log.Rows * log.Columns),
+        Generations(log.Rows * log.Columns),
+        Generator(log.Seed)
+    {
+        Game.Reset(Generator);
+        Dpi(96, 96);
+    }
+
+    void operator()(InputEvent const & event)
+    {
+        if (InputKind::Click == event.Kind)
+        {
+            Click(event.X, event.Y, event.Time);
+        }
+        else if (InputKind::Dpi == event.Kind)
+        {
+            Dpi(event.X, event.Y);
+        }
+        else
+        {
+            UpdateCards(Device, Generations, Game.Cards);
+        }
+    }
+
+    void Click(unsigned const x,
+               unsigned const y,
+               double const time)
+    {
+        unsigned const next = Picker.CardAt(Grid,
+                                            Animations,
+                                            time,
+                                            static_cast<float>(x),
+                                            static_cast<float>(y));
+
+        unsigned const first = Game.FirstCard;
+        ClickResult const result = Game.Click(next);
+
+        AnimateClick(Animations, result, first, next, time, FlipCurve);
+
+        // The card's face is drawn as it turns over, as the window does
+        if (ClickResult::Ignored != result)
+        {
+            ShowCard(Device, Generations, next);
+        }
+
+        if (Redeal && Game.IsComplete())
+        {
+            Game.Reset(Generator);
+            ++Games;
+
+            for (unsigned card = 0; card != Animations.Count(); ++card)
+            {
+                Animations.Tracks[card].Set(0.0f);
+                Generations.InvalidateContent(card);
+            }
+        }
+    }
+
+    void Dpi(unsigned const dpiX,
+             unsigned const dpiY)
+    {
+        Grid.Build(Game.Cards.Rows,
+                   Game.Cards.Columns,
+                   15.0f,
+                   150.0f,
+                   210.0f,
+                   static_cast<float>(dpiX),
+                   static_cast<float>(dpiY));
+
+        Generations.InvalidateLayout();
+    }
+
+    // Enough of the outcome to tell whether two replays agree
+    uint64_t Fingerprint() const
+    {
+        uint64_t hash = Game.Clicks * 31ull + Game.Remaining + Games * 7919ull;
+
+        for (unsigned card = 0; card != Game.Cards.Count(); ++card)
+        {
+            hash = hash * 1099511628211ull ^ static_cast<unsigned>(Game.Cards.Status[card]);
+        }
+
+        return hash * 1099511628211ull ^ Device.Draws;
+    }
+};
+
+static PathChar const ReplayPath[] = PATH_TEXT("session.cards");
+
+static void ReplayLog(char const * name,
+                      InputLog const & log,
+                      bool const redeal)
+{
+    HeadlessSession fast(log);
+    fast.Redeal = redeal;
+
+    Stopwatch const watch;
+    bool const complete = log.Replay(fast);
+    double const seconds = watch.Seconds();
+
+    // Once more timing every event, which also checks the replay repeats
+    HeadlessSession timed(log);
+    timed.Redeal = redeal;
+    LatencyRecorder latency(static_cast<unsigned>(log.Count));
+
+    log.Replay([&](InputEvent const & event)
+    {
+        Stopwatch const eventWatch;
+        timed(event);
+        latency.Record(eventWatch.Seconds());
+    });
+
+    printf("replay: %-8s %8llu events %5.2f bytes/event, %6.2f M events/s, p50 %4.0f ns, p99 %5.0f ns, %u games%s\n",
+           name,
+           static_cast<unsigned long long>(log.Count),
+           static_cast<double>(log.Bytes.size()) / max<uint64_t>(1, log.Count),
+           log.Count / seconds / 1e6,
+           latency.Percentile(0.5) * 1e9,
+           latency.Percentile(0.99) * 1e9,
+           fast.Games,
+           complete && fast.Fingerprint() == timed.Fingerprint() ? "" : " MISMATCH");
+}
+
+static void Replay()
+{
+    PathChar const path[] = PATH_TEXT("benchmark.cards");
+    unsigned const events = 1000000;
+
+    for (HitTestBoard const & board : { HitTestBoard{ 3, 6 }, HitTestBoard{ 30, 34 } })
+    {
+        InputLog log;
+        log.Rows = board.Rows;
+        log.Columns = board.Columns;
+        log.Seed = 15;
+
+        mt19937 generator(log.Seed);
+
+        FuzzClicks(log,
+                   generator,
+                   events,
+                   board.Columns * 165 + 15,
+                   board.Rows * 225 + 15);
+
+        // The log must survive a round trip through a file unchanged
+        InputLog loaded;
+        bool const saved = log.Save(path) && loaded.Load(path);
+        RemovePath(path);
+
+        if (!saved || loaded.Bytes != log.Bytes || loaded.Count != log.Count)
+        {
+            printf("replay: %ux%u log FAILED to round trip\n", board.Rows, board.Columns);
+            continue;
+        }
+
+        char name[16];
+        snprintf(name, sizeof(name), "%ux%u", board.Rows, board.Columns);
+        ReplayLog(name, loaded, true);
+    }
+
+    // A header whose board has no cards, an unpaired card, more cards than
+    // MaxCards or a size whose product wraps to zero must not load
+    unsigned accepted = 0;
+
+    for (HitTestBoard const & board : { HitTestBoard{ 0, 6 }, HitTestBoard{ 3, 5 }, HitTestBoard{ 2048, 1024 }, HitTestBoard{ 65536, 65536 } })
+    {
+        InputLog log;
+        log.Rows = board.Rows;
+        log.Columns = board.Columns;
+        log.Record(InputKind::Click, 0.0, 90, 120);
+
+        InputLog loaded;
+        accepted += log.Save(path) && loaded.Load(path);
+        RemovePath(path);
+    }
+
+    printf("replay: %u of 4 malformed headers loaded%s\n", accepted, accepted ? " MISMATCH" : "");
+
+    // A session saved by the sample is replayed too if one is at hand
+    InputLog session;
+
+    if (session.Load(ReplayPath))
+    {
+        ReplayLog("session", session, false);
+    }
+}
+
+// The standard generator always gives this first value for a seed of 42
+// on stream 54, as does every other implementation of pcg32.
+static_assert(Pcg32(42, 54)() == 0xA15C02B7, "Pcg32 does not match pcg32");
+
+// How Board::Shuffle dealt before pairs were made distinct.
+static void LegacyShuffle(Board & board,
+                          mt19937 & generator)
+{
+    uniform_int_distribution<short> distribution(L'A', L'Z');
+
+    for (unsigned i = 0; i != board.Count() / 2; ++i)
+    {
+        wchar_t const value = distribution(generator);
+
+        board.Value[i * 2 + 0] = value;
+        board.Value[i * 2 + 1] = towlower(value);
+    }
+
+    shuffle(begin(board.Value), end(board.Value), generator);
+    fill(begin(board.Status), end(board.Status), CardStatus::Hidden);
+}
+
+// Whether any capital appears on more than one pair
+static bool HasRepeatedPair(Board const & board)
+{
+    vector<wchar_t> capitals;
+
+    for (wchar_t const value : board.Value)
+    {
+        if (value < L'a' || value > L'z')
+        {
+            if (value < 0xE0 || value > 0xFE)
+            {
+                if (value < 0x3B1 || value > 0x3C9)
+                {
+                    if (value < 0x430 || value > 0x44F)
+                    {
+                        capitals.push_back(value);
+                    }
+                }
+            }
+        }
+    }
+
+    sort(begin(capitals), end(capitals));
+    return adjacent_find(begin(capitals), end(capitals)) != end(capitals);
+}
+
+static uint64_t BoardHash(Board const & board)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    for (wchar_t const value : board.Value)
+    {
+        hash = (hash ^ static_cast<uint32_t>(value)) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+template <typename Deal>
+static void DealBoards(char const * name,
+                       unsigned const rows,
+                       unsigned const columns,
+                       Deal && deal)
+{
+    unsigned const boards = 2000000 / (rows * columns / 18);
+    Board board(rows, columns);
+    unsigned repeated = 0;
+    uint64_t hash = 0;
+
+    Stopwatch const watch;
+
+    for (unsigned i = 0; i != boards; ++i)
+    {
+        deal(board);
+        hash ^= BoardHash(board);
+    }
+
+    double const seconds = watch.Seconds();
+
+    // Checked separately so that the check is not part of the timing
+    for (unsigned i = 0; i != 1000; ++i)
+    {
+        deal(board);
+        repeated += HasRepeatedPair(board);
+    }
+
+    printf("boards: %-14s %2ux%-2u %6.2f M boards/s, %4u of 1000 with a repeated pair (%016llx)\n",
+           name,
+           rows,
+           columns,
+           boards / seconds / 1e6,
+           repeated,
+           static_cast<unsigned long long>(hash));
+}
+
+static void DealBoards()
+{
+    for (HitTestBoard const & size : { HitTestBoard{ 3, 6 }, HitTestBoard{ 10, 10 }, HitTestBoard{ 14, 16 } })
+    {
+        mt19937 legacy(16);
+        mt19937 standard(16);
+        Pcg32 pcg(16);
+
+        DealBoards("legacy mt19937", size.Rows, size.Columns, [&](Board & board) { LegacyShuffle(board, legacy); });
+        DealBoards("mt19937", size.Rows, size.Columns, [&](Board & board) { board.Shuffle(standard); });
+        DealBoards("pcg32", size.Rows, size.Columns, [&](Board & board) { board.Shuffle(pcg); });
+    }
+
+    // A seed must deal the same board every time and everywhere. The hash
+    // was recorded from the first deal for this seed.
+    Pcg32 first(2024);
+    Pcg32 second(2024);
+    Board a(3, 6);
+    Board b(3, 6);
+    a.Shuffle(first);
+    b.Shuffle(second);
+
+    printf("boards: seed 2024 deals %016llx%s\n",
+           static_cast<unsigned long long>(BoardHash(a)),
+           a.Value == b.Value && 0xE7471B35ED56C417ull == BoardHash(a) ? "" : " MISMATCH");
+}
+
+// Board sizes from the default up to the largest whose pairs are all distinct
+static HitTestBoard const SolverBoards[] =
+{
+    { 3, 6 },
+    { 6, 8 },
+    { 10, 10 },
+    { 14, 16 },
+};
+
+template <typename Player>
+static void ReportStrategy(char const * name,
+                           unsigned const rows,
+                           unsigned const columns,
+                           unsigned const runs,
+                           Player const & player)
+{
+    Stopwatch const watch;
+    StrategyResult const result = EvaluateStrategy(rows, columns, runs, 17, player);
+    double const seconds = watch.Seconds();
+
+    printf("solve: %2ux%-2u %-14s mean %8.1f sd %6.1f median %6u p90 %6u, difficulty %5.2f, %8.0f games/s\n",
+           rows,
+           columns,
+           name,
+           result.Mean,
+           result.Deviation,
+           result.Median,
+           result.P90,
+           Difficulty(result.Mean, rows * columns / 2),
+           runs / seconds);
+}
+
+static void Solve()
+{
+    for (HitTestBoard const & board : SolverBoards)
+    {
+        unsigned const cards = board.Rows * board.Columns;
+        unsigned const runs = max(200u, 2000000u / cards);
+
+        // The Monte Carlo mean of the perfect player should agree with the
+        // exact expectation to within a few standard errors
+        double const exact = PerfectMemoryClicks(cards / 2);
+        StrategyResult const perfect = EvaluateStrategy(board.Rows, board.Columns, runs, 17, MemoryPlayer());
+        double const error = fabs(perfect.Mean - exact) / (perfect.Deviation / sqrt(static_cast<double>(runs)));
+
+        printf("solve: %2ux%-2u exact perfect memory %.2f clicks, simulated %.2f%s\n",
+               board.Rows,
+               board.Columns,
+               exact,
+               perfect.Mean,
+               error < 4.0 ? "" : " MISMATCH");
+
+        ReportStrategy("perfect", board.Rows, board.Columns, runs, MemoryPlayer());
+        ReportStrategy("remember 16", board.Rows, board.Columns, runs, ForgetfulPlayer(16));
+        ReportStrategy("remember 6", board.Rows, board.Columns, runs, ForgetfulPlayer(6));
+
+        if (cards <= 100)
+        {
+            ReportStrategy("no memory", board.Rows, board.Columns, runs / 10, ForgetfulPlayer(0));
+        }
+    }
+
+    // Results depend only on the seed, and the work should spread evenly
+    unsigned const runs = 400000;
+    unsigned const threads = HardwareThreads();
+    StrategyResult single;
+    StrategyResult all;
+
+    Stopwatch const singleWatch;
+    single = EvaluateStrategy(3, 6, runs, 17, ForgetfulPlayer(6), 1);
+    double const singleSeconds = singleWatch.Seconds();
+
+    Stopwatch const allWatch;
+    all = EvaluateStrategy(3, 6, runs, 17, ForgetfulPlayer(6), threads);
+    double const allSeconds = allWatch.Seconds();
+
+    printf("solve: 1 thread %.0f games/s, %u threads %.0f games/s, %.2fx%s\n",
+           runs / singleSeconds,
+           threads,
+           runs / allSeconds,
+           singleSeconds / allSeconds,
+           single.Clicks == all.Clicks ? "" : " MISMATCH");
+}
+
+static unsigned const HostSessionCount = 20000;
+static unsigned const HostBatches = 50;
+
+// A person clicks a few times a second at most, as FuzzClicks assumes
+static double const HostClicksPerSecond = 2.5;
+
+static bool SameGame(HeadlessSession const & reference,
+                     HostedSession const & hosted)
+{
+    HostedGame const & game = hosted.Game;
+
+    if (reference.Game.Clicks != game.Clicks ||
+        reference.Game.Remaining != game.Remaining ||
+        reference.Game.FirstCard != game.FirstCard ||
+        reference.Games != hosted.Games)
+    {
+        return false;
+    }
+
+    for (unsigned card = 0; card != game.Cards.Count(); ++card)
+    {
+        if (reference.Game.Cards.Status[card] != game.Cards.Status[card] ||
+            reference.Game.Cards.Value[card] != game.Cards.Value[card])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void HostSessions()
+{
+    // Many copies of one fuzzed session, their events interleaved over
+    // several batches, must each end as a lone headless replay does
+    {
+        InputLog log;
+        log.Rows = SimulationRows;
+        log.Columns = SimulationColumns;
+        log.Seed = 18;
+
+        mt19937 generator(log.Seed);
+        FuzzClicks(log, generator, 20000, SimulationColumns * 165 + 15, SimulationRows * 225 + 15);
+
+        HeadlessSession reference(log);
+        reference.Redeal = true;
+        log.Replay(reference);
+
+        SessionHost host;
+        host.Redeal = true;
+
+        for (unsigned i = 0; i != 64; ++i)
+        {
+            host.Open(log.Rows, log.Columns, log.Seed);
+        }
+
+        unsigned events = 0;
+
+        log.Replay([&](InputEvent const & event)
+        {
+            for (unsigned session = 0; session != host.Sessions.size(); ++session)
+            {
+                host.Submit(session, event);
+            }
+
+            if (0 == ++events % 1000)
+            {
+                host.Process();
+            }
+        });
+
+        host.Process();
+
+        unsigned wrong = 0;
+
+        for (HostedSession const & session : host.Sessions)
+        {
+            wrong += !SameGame(reference, session);
+        }
+
+        printf("host: %u sessions replayed %u events, %u games each, %u differ from a headless replay\n",
+               static_cast<unsigned>(host.Sessions.size()),
+               events,
+               reference.Games,
+               wrong);
+    }
+
+    // A session closed with clicks still queued and reopened at the same
+    // index before the batch is processed must only see its own clicks
+    {
+        SessionHost host;
+
+        unsigned const kept = host.Open(SimulationRows, SimulationColumns, 18);
+        unsigned const closed = host.Open(SimulationRows, SimulationColumns, 18);
+
+        // The centres of the first three cards, a second apart so that no
+        // flip is still in flight when the next click lands
+        for (unsigned i = 0; i != 3; ++i)
+        {
+            InputEvent const click{ InputKind::Click, i * 1.0, 90 + i * 165, 120 };
+            host.Submit(kept, click);
+            host.Submit(closed, click);
+        }
+
+        host.Close(closed);
+        unsigned const reopened = host.Open(SimulationRows, SimulationColumns, 18);
+        host.Submit(reopened, InputEvent{ InputKind::Click, 0.0, 90, 120 });
+        host.Process();
+
+        unsigned const keptClicks = host.Sessions[kept].Game.Clicks;
+        unsigned const reopenedClicks = host.Sessions[reopened].Game.Clicks;
+
+        printf("host: a session reopened at index %u saw %u of its 1 click, the other session %u of 3%s\n",
+               reopened,
+               reopenedClicks,
+               keptClicks,
+               closed == reopened && 1 == reopenedClicks && 3 == keptClicks ? "" : " MISMATCH");
+    }
+
+    for (HitTestBoard const & board : { HitTestBoard{ 3, 6 }, HitTestBoard{ 10, 10 } })
+    {
+        SessionHost host;
+        host.Redeal = true;
+
+        unsigned long long const openAllocations = Allocations;
+
+        for (unsigned i = 0; i != HostSessionCount; ++i)
+        {
+            host.Open(board.Rows, board.Columns, i);
+        }
+
+        double const allocations = static_cast<double>(Allocations - openAllocations) / HostSessionCount;
+
+        // The state a window keeps for the same board, for comparison
+        unsigned long long const windowAllocations = Allocations;
+        {
+            GameState game(board.Rows, board.Columns);
+            AnimationSet animations(board.Rows * board.Columns);
+            CardGrid grid;
+            grid.Build(board.Rows, board.Columns, 15.0f, 150.0f, 210.0f, 96.0f, 96.0f);
+        }
+        unsigned long long const windowCount = Allocations - windowAllocations;
+
+        // Every session clicks once per batch somewhere in the window
+        Pcg32 generator(18);
+        unsigned const width = board.Columns * 165 + 15;
+        unsigned const height = board.Rows * 225 + 15;
+        double processing = 0.0;
+
+        for (unsigned batch = 0; batch != HostBatches; ++batch)
+        {
+            for (unsigned session = 0; session != HostSessionCount; ++session)
+            {
+                host.Submit(session, InputEvent
+                {
+                    InputKind::Click,
+                    batch * 0.4,
+                    RandomBelow(generator, width),
+                    RandomBelow(generator, height)
+                });
+            }
+
+            Stopwatch const watch;
+            host.Process();
+            processing += watch.Seconds();
+        }
+
+        unsigned long long games = 0;
+
+        for (HostedSession const & session : host.Sessions)
+        {
+            games += session.Games;
+        }
+
+        double const perCore = HostSessionCount * HostBatches / processing / HardwareThreads();
+
+        printf("host: %2ux%-2u %u sessions, %6.0f bytes and %.2f allocations/session (window state %llu allocations), %5.2f M clicks/s/core, %6.0f sessions/core, %llu games\n",
+               board.Rows,
+               board.Columns,
+               HostSessionCount,
+               static_cast<double>(host.SessionBytes()) / HostSessionCount,
+               allocations,
+               windowCount,
+               perCore / 1e6,
+               perCore / HostClicksPerSecond,
+               games);
+    }
+}
+
+static unsigned const TraceZoneCount = 1000000;
+
+static void TraceZones()
+{
+    // Zones are recorded directly so that they are measured whether or not
+    // this build defines TRACING
+    {
+        Stopwatch const watch;
+
+        for (unsigned i = 0; i != TraceZoneCount; ++i)
+        {
+            TraceZone const zone("Benchmark");
+        }
+
+        printf("trace: %.1f ns/zone\n", watch.Seconds() / TraceZoneCount * 1e9);
+    }
+
+    // Zones on other threads are kept apart and outlive their threads
+    vector<thread> threads;
+
+    for (unsigned i = 0; i != 3; ++i)
+    {
+        threads.emplace_back([]
+        {
+            for (unsigned j = 0; j != 1000; ++j)
+            {
+                TraceZone const outer("Outer \"quoted\"");
+                TraceZone const inner("Inner");
+            }
+        });
+    }
+
+    for (thread & t : threads)
+    {
+        t.join();
+    }
+
+    PathChar const path[] = PATH_TEXT("benchmark-trace.json");
+    Stopwatch const watch;
+    bool const written = WriteChromeTrace(path);
+    double const seconds = watch.Seconds();
+
+    // Every zone kept, and only those, is written as a complete event
+    uint64_t expected = 0;
+
+    for (unique_ptr<TraceBuffer> const & buffer : Traces().Buffers)
+    {
+        expected += min<uint64_t>(buffer->Written, TraceBufferCapacity);
+    }
+
+    vector<uint8_t> json;
+    unsigned events = 0;
+
+    if (written && ReadFile(path, json))
+    {
+        char const marker[] = "\"ph\":\"X\"";
+        string const text(json.begin(), json.end());
+
+        for (size_t at = text.find(marker); string::npos != at; at = text.find(marker, at + 1))
+        {
+            ++events;
+        }
+    }
+
+    RemovePath(path);
+
+    printf("trace: %u threads, %u events written in %.1f ms%s\n",
+           static_cast<unsigned>(Traces().Buffers.size()),
+           events,
+           seconds * 1e3,
+           written && events == expected ? "" : " MISMATCH");
+
+    // The histogram agrees with exact percentiles to within its buckets
+    mt19937 generator(19);
+    lognormal_distribution<double> latency(log(200e-6), 0.8);
+    LatencyRecorder exact(100000);
+    LatencyHistogram histogram;
+
+    for (unsigned i = 0; i != 100000; ++i)
+    {
+        double const sample = latency(generator);
+        exact.Record(sample);
+        histogram.Record(sample);
+    }
+
+    double worst = 0.0;
+
+    for (double const fraction : { 0.5, 0.9, 0.99, 0.999 })
+    {
+        worst = max(worst, histogram.Percentile(fraction) / exact.Percentile(fraction) - 1.0);
+    }
+
+    printf("trace: histogram p50 %.0f us p99 %.0f us, %zu bytes, at most %.1f%% above exact%s\n",
+           histogram.Percentile(0.5) * 1e6,
+           histogram.Percentile(0.99) * 1e6,
+           sizeof(histogram),
+           worst * 100.0,
+           worst >= 0.0 && worst <= 0.25 ? "" : " MISMATCH");
+}
+
+static unsigned const LogBursts = 500;
+static unsigned const LogBurst = LogCapacity / 2;
+
+// Lines written by the logger are counted and the last one kept
+static atomic<unsigned> LogLines(0);
+static wchar_t LastLogLine[LogLineCapacity];
+
+static void CountLogLine(wchar_t const * line)
+{
+    wcsncpy(LastLogLine, line, LogLineCapacity - 1);
+    ++LogLines;
+}
+
+static double TimeLogCalls(unsigned const threads)
+{
+    vector<thread> producers;
+    atomic<unsigned> ready(0);
+    double seconds = 0.0;
+    mutex lock;
+
+    for (unsigned t = 0; t != threads; ++t)
+    {
+        producers.emplace_back([&, t]
+        {
+            ++ready;
+
+            while (ready != threads)
+            {
+                this_thread::yield();
+            }
+
+            double local = 0.0;
+
+            for (unsigned burst = 0; burst != LogBursts; ++burst)
+            {
+                // Bursts fit the ring so that nothing is dropped and only
+                // the calls themselves are timed
+                Stopwatch const watch;
+
+                for (unsigned i = 0; i != LogBurst / threads; ++i)
+                {
+                    Log(L"Updated %u cards, glyph atlas %u hits, %u misses\n", i, burst, t);
+                }
+
+                local += watch.Seconds();
+                Logs().Flush();
+            }
+
+            lock_guard<mutex> const guard(lock);
+            seconds += local;
+        });
+    }
+
+    for (thread & producer : producers)
+    {
+        producer.join();
+    }
+
+    return seconds / (LogBursts * (LogBurst / threads) * threads);
+}
+
+static void LogMessages()
+{
+    Logger & logger = Logs();
+    logger.Redirect(CountLogLine);
+
+    // Strings are copied and everything is formatted later as printf would
+    {
+        wchar_t name[16] = L"background";
+        Log(L"%u %ls %.2f %llx\n", 20u, name, 1.5, 0xABCull);
+        memcpy(name, L"overwritten", sizeof(L"overwritten"));
+        logger.Flush();
+
+        wchar_t const * const text = wcschr(LastLogLine, L']');
+        bool const formatted = text && 0 == wcscmp(text, L"] 20 background 1.50 abc\n");
+
+        printf("log: deferred formatting %s\n", formatted ? "matches" : "MISMATCH");
+    }
+
+    // The cost of formatting on the calling thread, as DebugTrace did
+    Stopwatch const syncWatch;
+    wchar_t buffer[512];
+    unsigned length = 0;
+
+    for (unsigned i = 0; i != LogBursts * LogBurst; ++i)
+    {
+        length += swprintf(buffer, 512, L"Updated %u cards, glyph atlas %u hits, %u misses\n", i, i, i);
+    }
+
+    double const sync = syncWatch.Seconds() / (LogBursts * LogBurst);
+    unsigned const before = LogLines;
+    uint64_t const dropped = logger.Dropped();
+
+    double const single = TimeLogCalls(1);
+    double const shared = TimeLogCalls(4);
+
+    printf("log: format on caller %.1f ns/call for %u chars, deferred %.1f ns/call, 4 threads %.1f ns/call, %u lines, %llu dropped\n",
+           sync * 1e9,
+           length / (LogBursts * LogBurst),
+           single * 1e9,
+           shared * 1e9,
+           LogLines - before,
+           static_cast<unsigned long long>(logger.Dropped() - dropped));
+
+    // Far more than the ring holds at once, which drops rather than waits
+    uint64_t const full = logger.Dropped();
+
+    for (unsigned i = 0; i != LogCapacity * 4; ++i)
+    {
+        Log(L"%u\n", i);
+    }
+
+    logger.Flush();
+
+    printf("log: %u messages at once, %llu dropped\n",
+           LogCapacity * 4,
+           static_cast<unsigned long long>(logger.Dropped() - full));
+
+    logger.Redirect(DefaultLogSink);
+}
+
+//
+// The window benchmark drives Window<T> through the headless stand in for
+// the Win32 windowing API, which only exists where Windows does not. On
+// Windows the same code runs in the sample itself.
+//
+
+#ifndef _WIN32
+
+static unsigned const WindowMessages = 4000000;
+static UINT const WindowImageLoaded = WM_APP;
+static UINT const WindowGlyphRasterized = WM_APP + 1; // The low bits of WM_CREATE
+static UINT const WM_MOUSEMOVE_ = 0x0200;
+
+//
+// A window with trivial handlers for the sample's messages, to measure what
+// dispatch alone costs through the map and through the chain of ifs the
+// sample used before.
+//
+
+struct CountingWindow : Window<CountingWindow>
+{
+    unsigned Counts[7] = {};
+
+    void Click(WPARAM, LPARAM const lparam) { Counts[0] += LOWORD(lparam) & 1; }
+    void Paint(WPARAM, LPARAM) { ++Counts[1]; }
+    void Dpi(WPARAM const wparam, LPARAM) { Counts[2] += HIWORD(wparam) & 1; }
+    void Create(WPARAM, LPARAM) { ++Counts[3]; }
+    void Loaded(WPARAM, LPARAM) { ++Counts[4]; }
+    void Moving(WPARAM, LPARAM) { ++Counts[5]; }
+    void Rasterized(WPARAM, LPARAM) { ++Counts[6]; }
+
+    LRESULT ChainHandler(UINT const message,
+                         WPARAM const wparam,
+                         LPARAM const lparam)
+    {
+        if (WM_LBUTTONUP == message)
+        {
+            Click(wparam, lparam);
+        }
+        else if (WM_PAINT == message)
+        {
+            Paint(wparam, lparam);
+        }
+        else if (WM_DPICHANGED == message)
+        {
+            Dpi(wparam, lparam);
+        }
+        else if (WM_CREATE == message)
+        {
+            Create(wparam, lparam);
+        }
+        else if (WindowImageLoaded == message)
+        {
+            Loaded(wparam, lparam);
+        }
+        else if (WM_WINDOWPOSCHANGING == message)
+        {
+            Moving(wparam, lparam);
+        }
+        else if (WindowGlyphRasterized == message)
+        {
+            Rasterized(wparam, lparam);
+        }
+        else
+        {
+            return DefWindowProc(m_window, message, wparam, lparam);
+        }
+
+        return 0;
+    }
+
+    typedef MessageMap<CountingWindow,
+                       On<WM_LBUTTONUP, &CountingWindow::Click>,
+                       On<WM_PAINT, &CountingWindow::Paint>,
+                       On<WM_DPICHANGED, &CountingWindow::Dpi>,
+                       On<WM_CREATE, &CountingWindow::Create>,
+                       On<WindowImageLoaded, &CountingWindow::Loaded>,
+                       On<WM_WINDOWPOSCHANGING, &CountingWindow::Moving>,
+                       On<WindowGlyphRasterized, &CountingWindow::Rasterized>> Messages;
+};
+
+//
+// The sample's game without a device, driven through window messages as the
+// sample is: clicks pick and flip cards, DPI changes lay the board out again
+// and a background thread posts the message that its image has loaded.
+//
+
+struct GameWindow : Window<GameWindow>
+{
+    GameState Game;
+    CardGrid Grid;
+    CardPicker Picker;
+    AnimationSet Animations;
+    double Time = 0.0;
+    unsigned Paints = 0;
+    bool Loaded = false;
+
+    GameWindow() :
+        Game(SimulationRows, SimulationColumns),
+        Animations(SimulationRows * SimulationColumns)
+    {
+        Pcg32 generator(21);
+        Game.Reset(generator);
+        CreateHeadless();
+    }
+
+    ~GameWindow()
+    {
+        DestroyWindow(m_window);
+    }
+
+    void LayOut(unsigned const dpiX,
+                unsigned const dpiY)
+    {
+        Grid.Build(Game.Cards.Rows,
+                   Game.Cards.Columns,
+                   15.0f,
+                   150.0f,
+                   210.0f,
+                   static_cast<float>(dpiX),
+                   static_cast<float>(dpiY));
+    }
+
+    void CreateHandler(WPARAM, LPARAM)
+    {
+        LayOut(96, 96);
+    }
+
+    void LeftButtonUpHandler(WPARAM, LPARAM const lparam)
+    {
+        Time += 0.3;
+
+        unsigned const next = Picker.CardAt(Grid,
+                                            Animations,
+                                            Time,
+                                            static_cast<float>(LOWORD(lparam)),
+                                            static_cast<float>(HIWORD(lparam)));
+
+        unsigned const first = Game.FirstCard;
+        ClickResult const result = Game.Click(next);
+
+        AnimateClick(Animations, result, first, next, Time, FlipCurve);
+    }
+
+    void PaintHandler(WPARAM, LPARAM)
+    {
+        ++Paints;
+    }
+
+    void DpiChangedHandler(WPARAM const wparam, LPARAM)
+    {
+        LayOut(LOWORD(wparam), HIWORD(wparam));
+    }
+
+    void ImageLoadedHandler(WPARAM, LPARAM)
+    {
+        Loaded = true;
+    }
+
+    typedef MessageMap<GameWindow,
+                       On<WM_LBUTTONUP, &GameWindow::LeftButtonUpHandler>,
+                       On<WM_PAINT, &GameWindow::PaintHandler>,
+                       On<WM_DPICHANGED, &GameWindow::DpiChangedHandler>,
+                       On<WM_CREATE, &GameWindow::CreateHandler>,
+                       On<WindowImageLoaded, &GameWindow::ImageLoadedHandler>> Messages;
+};
+
+static void DispatchMessages()
+{
+    // The sample's messages in a random order, with one in nine unmapped
+    UINT const mapped[] = { WM_LBUTTONUP, WM_PAINT, WM_DPICHANGED, WM_CREATE, WindowImageLoaded, WM_WINDOWPOSCHANGING, WindowGlyphRasterized };
+    Pcg32 generator(21);
+    vector<UINT> messages(WindowMessages);
+
+    for (UINT & message : messages)
+    {
+        unsigned const roll = RandomBelow(generator, 9);
+        message = roll < 7 ? mapped[roll] : roll == 7 ? WM_LBUTTONUP : WM_MOUSEMOVE_;
+    }
+
+    CountingWindow window;
+    window.CreateHeadless();
+    fill(begin(window.Counts), end(window.Counts), 0);
+
+    Stopwatch const chainWatch;
+
+    for (unsigned i = 0; i != WindowMessages; ++i)
+    {
+        window.ChainHandler(messages[i], i, i);
+    }
+
+    double const chain = chainWatch.Seconds();
+    unsigned chainCounts[7];
+    copy(begin(window.Counts), end(window.Counts), chainCounts);
+    fill(begin(window.Counts), end(window.Counts), 0);
+
+    Stopwatch const mapWatch;
+
+    for (unsigned i = 0; i != WindowMessages; ++i)
+    {
+        window.MessageHandler(messages[i], i, i);
+    }
+
+    double const map = mapWatch.Seconds();
+    bool const same = equal(begin(window.Counts), end(window.Counts), chainCounts);
+
+    // Sent messages pass through the window procedure as well
+    Stopwatch const sendWatch;
+
+    for (unsigned i = 0; i != WindowMessages; ++i)
+    {
+        SendMessage(window.m_window, messages[i], i, i);
+    }
+
+    double const send = sendWatch.Seconds();
+
+    // Destroying a window quits the pump, as closing the sample does
+    DestroyWindow(window.m_window);
+
+    bool const quit = !PumpMessages();
+    ThreadQueue().Quit = false;
+
+    printf("window: chain of ifs %.2f ns/message, message map %.2f ns/message, sent %.2f ns/message%s\n",
+           chain / WindowMessages * 1e9,
+           map / WindowMessages * 1e9,
+           send / WindowMessages * 1e9,
+           same ? "" : " MISMATCH");
+
+    printf("window: destroying a window %s\n", quit ? "quits" : "MISMATCH");
+
+    // Clicks anywhere on a game window, timed from being sent to handled
+    {
+        GameWindow game;
+        LatencyRecorder latency(WindowMessages / 8);
+        unsigned const width = SimulationColumns * 165 + 15;
+        unsigned const height = SimulationRows * 225 + 15;
+
+        for (unsigned i = 0; i != WindowMessages / 8; ++i)
+        {
+            LPARAM const position = MAKELPARAM(RandomBelow(generator, width), RandomBelow(generator, height));
+
+            Stopwatch const watch;
+            SendMessage(game.m_window, WM_LBUTTONUP, 0, position);
+            latency.Record(watch.Seconds());
+
+            if (game.Game.IsComplete())
+            {
+                game.Game.Reset(generator);
+            }
+        }
+
+        printf("window: click handler p50 %.0f ns p99 %.0f ns\n",
+               latency.Percentile(0.5) * 1e9,
+               latency.Percentile(0.99) * 1e9);
+
+        // A message posted from another thread waits for the pump
+        thread loader([&]
+        {
+            PostMessage(game.m_window, WindowImageLoaded, 0, 0);
+            PostMessage(game.m_window, WM_DPICHANGED, 144 | 144 << 16, 0);
+        });
+
+        loader.join();
+
+        bool const waited = !game.Loaded;
+        bool const pumped = PumpMessages() && game.Loaded && game.Grid.Width == LogicalToPhysical(150.0f, 144.0f);
+
+        printf("window: posted messages %s\n", waited && pumped ? "handled by the pump" : "MISMATCH");
+    }
+
+    ThreadQueue().Quit = false;
+}
+
+#endif
+
+static unsigned const SurfaceRows = 20;
+static unsigned const SurfaceColumns = 40;
+static unsigned const SurfaceRounds = 4;
+static size_t const SurfaceBudget = 64 * 1024 * 1024;
+
+// Stands in for a composition surface, whose memory is what creating one costs
+typedef unique_ptr<unsigned char[]> MockSurface;
+
+struct SurfaceCard
+{
+    MockSurface Surface;
+    SurfaceKey Key = {};
+};
+
+struct SurfaceScenario
+{
+    bool Pooled = false;
+    vector<SurfaceCard> Cards;
+    SurfacePool<MockSurface> Pool;
+    size_t Bytes = 0;
+    size_t HighWater = 0;
+    unsigned Creates = 0;
+
+    explicit SurfaceScenario(bool const pooled) :
+        Pooled(pooled),
+        Cards(SurfaceRows * SurfaceColumns)
+    {
+        Pool.Budget = SurfaceBudget;
+    }
+
+    MockSurface Create(SurfaceKey const & key)
+    {
+        ++Creates;
+        Bytes += key.Bytes();
+        HighWater = max(HighWater, Bytes);
+
+        MockSurface surface(new unsigned char[key.Bytes()]);
+        surface[0] = 0;
+        return surface;
+    }
+
+    // As the sample lays out a card, with the pool or creating a surface
+    // every time as it did before
+    void LayOut(float const dpi)
+    {
+        SurfaceKey const key =
+        {
+            static_cast<unsigned>(LogicalToPhysical(150.0f, dpi)),
+            static_cast<unsigned>(LogicalToPhysical(210.0f, dpi)),
+            87,
+            4
+        };
+
+        for (SurfaceCard & card : Cards)
+        {
+            if (!Pooled)
+            {
+                MockSurface surface = Create(key);
+                Bytes -= card.Surface ? card.Key.Bytes() : 0;
+                card.Surface = move(surface);
+                card.Key = key;
+                continue;
+            }
+
+            if (card.Surface && card.Key == key) continue;
+
+            if (card.Surface)
+            {
+                Pool.Release(card.Key, move(card.Surface));
+            }
+
+            card.Surface = Pool.Acquire(key, [&](SurfaceKey const & created)
+            {
+                return Create(created);
+            });
+
+            card.Key = key;
+        }
+
+        if (Pooled)
+        {
+            Bytes = Pool.BytesInUse + Pool.BytesFree;
+        }
+    }
+
+    void Lose()
+    {
+        for (SurfaceCard & card : Cards)
+        {
+            card.Surface.reset();
+        }
+
+        if (Pooled)
+        {
+            Pool.Lose();
+        }
+
+        Bytes = 0;
+    }
+};
+
+static void RecycleSurfaces()
+{
+    // Fresh surfaces are measured first as the pool is held to them
+    size_t freshHighWater = 0;
+
+    for (bool const pooled : { false, true })
+    {
+        SurfaceScenario scenario(pooled);
+        double relayout = 0.0;
+        double rebuild = 0.0;
+        unsigned tripCreates[2] = {};
+
+        scenario.LayOut(96.0f);
+
+        for (unsigned round = 0; round != SurfaceRounds; ++round)
+        {
+            // Moving to another monitor and back, twice. The first trip after
+            // device loss has to create the other size again, and later trips
+            // create what the budget could not hold.
+            for (unsigned & creates : tripCreates)
+            {
+                unsigned const created = scenario.Creates;
+
+                Stopwatch const layoutWatch;
+                scenario.LayOut(144.0f);
+                scenario.LayOut(96.0f);
+                relayout += layoutWatch.Seconds();
+
+                creates += scenario.Creates - created;
+            }
+
+            Stopwatch const rebuildWatch;
+            scenario.Lose();
+            scenario.LayOut(96.0f);
+            rebuild += rebuildWatch.Seconds();
+        }
+
+        // The pool may hold at most its budget beyond what creating fresh
+        // surfaces every time peaks at
+        size_t const expected = scenario.Cards.size() * scenario.Cards[0].Key.Bytes();
+        bool const consistent = !pooled || (scenario.Pool.BytesInUse == expected &&
+                                            scenario.Pool.BytesFree - scenario.Pool.CurrentBytes() <= SurfaceBudget &&
+                                            scenario.Pool.HighWater <= freshHighWater + SurfaceBudget);
+
+        if (!pooled)
+        {
+            freshHighWater = scenario.HighWater;
+        }
+
+        printf("surfaces: %-6s %5u creates, dpi round trip %6.2f ms with %4u then %4u creates, device loss %6.2f ms, high water %4.0f MB%s\n",
+               pooled ? "pooled" : "fresh",
+               scenario.Creates,
+               relayout / SurfaceRounds / 2 * 1e3,
+               tripCreates[0] / SurfaceRounds,
+               tripCreates[1] / SurfaceRounds,
+               rebuild / SurfaceRounds * 1e3,
+               (pooled ? scenario.Pool.HighWater : scenario.HighWater) / 1048576.0,
+               consistent ? "" : " MISMATCH");
+    }
+}
+
+static unsigned const ViewportBoards[][2] = { { 4, 8 }, { 20, 40 }, { 100, 100 }, { 200, 200 } };
+static unsigned const ViewportShownRows = 4;
+static unsigned const ViewportShownColumns = 8;
+
+// Whether the cards holding slots are exactly those in range, with no slot
+// held twice
+static bool SlotsMatchRange(VisualSlots const & slots,
+                            CardRange const & range,
+                            unsigned const columns)
+{
+    if (slots.Bound.size() != range.Count()) return false;
+
+    for (unsigned const card : slots.Bound)
+    {
+        unsigned const slot = slots.SlotOf[card];
+
+        if (!range.Contains(card, columns) || NoCard == slot || slots.CardOf[slot] != card) return false;
+    }
+
+    return true;
+}
+
+static void ScrollViewports()
+{
+    for (auto const & size : ViewportBoards)
+    {
+        unsigned const rows = size[0];
+        unsigned const columns = size[1];
+
+        GameState game(rows, columns);
+        mt19937 generator(0);
+        game.Reset(generator);
+
+        // At 144 DPI the pitch is a fraction of a pixel, as scrolling by a
+        // row is
+        CardGrid grid;
+        grid.Build(rows, columns, 15.0f, 150.0f, 210.0f, 144.0f, 144.0f);
+
+        Viewport viewport;
+        viewport.Resize(grid,
+                        LogicalToPhysical(min(columns, ViewportShownColumns) * 165.0f + 15.0f, 144.0f),
+                        LogicalToPhysical(min(rows, ViewportShownRows) * 225.0f + 15.0f, 144.0f));
+
+        VisualSlots slots(rows * columns);
+        ResourceGenerations generations(rows * columns);
+        MockDevice device;
+        unsigned largestRange = 0;
+        bool consistent = true;
+
+        auto const update = [&]
+        {
+            CardRange const range = viewport.Range(grid);
+            largestRange = max(largestRange, range.Count());
+
+            slots.Update(range, columns, [](unsigned) { return true; }, [](unsigned, unsigned) {});
+
+            for (unsigned const card : slots.Entering)
+            {
+                generations.Forget(card);
+            }
+
+            unsigned const updated = UpdateCards(device, generations, game.Cards, slots.Bound);
+
+            // A click on the card at the top left of the window, which the
+            // scrolling lines up with, lands on a card with visuals
+            unsigned const clicked = grid.CardAt(grid.OriginX + grid.Width / 2.0f + viewport.ScrollX,
+                                                 grid.OriginY + grid.Height / 2.0f + viewport.ScrollY);
+
+            consistent = consistent &&
+                         SlotsMatchRange(slots, range, columns) &&
+                         NoCard != clicked && NoCard != slots.SlotOf[clicked] &&
+                         viewport.ScrollX == floor(viewport.ScrollX);
+
+            return updated;
+        };
+
+        update();
+
+        unsigned const initial = device.Creates;
+        unsigned steps = 0;
+        unsigned mostUpdated = 0;
+
+        auto const scroll = [&](float const x,
+                                float const y)
+        {
+            if (!viewport.ScrollBy(grid, x, y)) return false;
+
+            mostUpdated = max(mostUpdated, update());
+            ++steps;
+            return true;
+        };
+
+        // Down the board a row at a time, across it, and back again
+        Stopwatch const watch;
+
+        while (scroll(0.0f, grid.PitchY)) {}
+        while (scroll(grid.PitchX, 0.0f)) {}
+        while (scroll(0.0f, -grid.PitchY)) {}
+        while (scroll(-grid.PitchX, 0.0f)) {}
+
+        double const seconds = watch.Seconds();
+
+        consistent = consistent &&
+                     slots.Slots() <= largestRange &&
+                     0 == viewport.ScrollX && 0 == viewport.ScrollY;
+
+        printf("viewport: %3ux%-3u %5u cards, %3u slots, %3u created up front, %3u at most a scroll, %6.2f us a scroll over %4u%s\n",
+               rows,
+               columns,
+               rows * columns,
+               slots.Slots(),
+               initial,
+               mostUpdated,
+               steps ? seconds / steps * 1e6 : 0.0,
+               steps,
+               consistent ? "" : " MISMATCH");
+    }
+}
+
+static unsigned const ReclaimRows = 20;
+static unsigned const ReclaimColumns = 40;
+
+//
+// Plays a game through without a miss on a board that is all in view, as
+// the window's resources would follow it, either with matched cards giving
+// up their slots and fronts as they finish hiding or keeping them until the
+// device is next lost.
+//
+
+struct ReclaimScenario
+{
+    bool Reclaim = false;
+    GameState Game;
+    AnimationSet Animations;
+    ResourceGenerations Generations;
+    VisualSlots Slots;
+    vector<SurfaceCard> Fronts; // By slot
+    vector<bool> Visuals;       // By slot, whether it has visuals made
+    SurfacePool<MockSurface> Pool;
+    HideCompletions Hiding;
+    CardFootprint Footprint;
+    CardRange Range;
+    SurfaceKey const Key = { 150, 210, 87, 4 };
+
+    explicit ReclaimScenario(bool const reclaim) :
+        Reclaim(reclaim),
+        Game(ReclaimRows, ReclaimColumns),
+        Animations(ReclaimRows * ReclaimColumns),
+        Generations(ReclaimRows * ReclaimColumns),
+        Slots(ReclaimRows * ReclaimColumns),
+        Footprint(ReclaimRows * ReclaimColumns)
+    {
+        mt19937 generator(0);
+        Game.Reset(generator);
+
+        Range.EndRow = ReclaimRows;
+        Range.EndColumn = ReclaimColumns;
+    }
+
+    void CreateCard(unsigned const card)
+    {
+        Visuals[Slots.SlotOf[card]] = true;
+    }
+
+    void LayoutCard(unsigned)
+    {}
+
+    unsigned VisualCount() const
+    {
+        return static_cast<unsigned>(count(Visuals.begin(), Visuals.end(), true));
+    }
+
+    void DrawCard(unsigned const card)
+    {
+        SurfaceCard & front = Fronts[Slots.SlotOf[card]];
+
+        if (front.Surface) return;
+
+        front.Surface = Pool.Acquire(Key, [](SurfaceKey const & key)
+        {
+            return MockSurface(new unsigned char[key.Bytes()]);
+        });
+
+        front.Key = Key;
+        Footprint.Hold(card, Game.Cards.Status[card], Key.Bytes());
+    }
+
+    void ReleaseFront(unsigned const card)
+    {
+        SurfaceCard & front = Fronts[Slots.SlotOf[card]];
+
+        if (!front.Surface) return;
+
+        Pool.Release(front.Key, move(front.Surface));
+        Footprint.Release(card);
+    }
+
+    void Update()
+    {
+        auto const keep = [this](unsigned const card)
+        {
+            return !Reclaim || Game.Cards.Status[card] != CardStatus::Matched || Hiding.Contains(card);
+        };
+
+        Slots.Update(Range, ReclaimColumns, keep, [this](unsigned const card, unsigned const slot)
+        {
+            if (!Fronts[slot].Surface) return;
+
+            Pool.Release(Fronts[slot].Key, move(Fronts[slot].Surface));
+            Footprint.Release(card);
+        });
+
+        Fronts.resize(max<size_t>(Fronts.size(), Slots.Slots()));
+        Visuals.resize(Fronts.size());
+
+        // As the window drops the visuals of the slots no card took
+        for (unsigned const slot : Slots.Free)
+        {
+            Visuals[slot] = false;
+        }
+
+        for (unsigned const card : Slots.Entering)
+        {
+            Generations.Forget(card);
+        }
+
+        UpdateCards(*this, Generations, Game.Cards, Slots.Bound);
+    }
+
+    void Click(unsigned const card,
+               double const time)
+    {
+        unsigned const first = Game.FirstCard;
+        ClickResult const result = Game.Click(card);
+
+        AnimateClick(Animations, result, first, card, time, FlipCurve);
+        Footprint.Restate(card, Game.Cards.Status[card]);
+
+        if (NoCard != first)
+        {
+            Footprint.Restate(first, Game.Cards.Status[first]);
+        }
+
+        ShowCard(*this, Generations, card);
+
+        if (Reclaim && ClickResult::Matched == result)
+        {
+            Hiding.Add(first, Animations.Tracks[first].End);
+            Hiding.Add(card, Animations.Tracks[card].End);
+        }
+    }
+
+    // As the window's timer fires
+    void Complete(double const time)
+    {
+        if (!Hiding.Complete(time, [this](unsigned const card) { ReleaseFront(card); })) return;
+
+        Update();
+    }
+};
+
+static void ReclaimMatched()
+{
+    for (bool const reclaim : { false, true })
+    {
+        ReclaimScenario scenario(reclaim);
+        scenario.Update();
+
+        Board const & cards = scenario.Game.Cards;
+        double time = 0.0;
+        size_t halfway = 0;
+        size_t peak = 0;
+        bool consistent = true;
+
+        Stopwatch const watch;
+
+        for (unsigned card = 0; card != cards.Count(); ++card)
+        {
+            if (cards.Status[card] == CardStatus::Matched) continue;
+
+            unsigned pair = card + 1;
+
+            while (cards.Status[pair] == CardStatus::Matched || !IsMatch(cards.Value[card], cards.Value[pair]))
+            {
+                ++pair;
+            }
+
+            // A pair is turned over every half second, so the last is still
+            // turning away when the next is shown
+            scenario.Click(card, time);
+            scenario.Click(pair, time + 0.25);
+            time += 0.5;
+            scenario.Complete(time);
+
+            consistent = consistent && scenario.Pool.BytesInUse == scenario.Footprint.Total();
+            peak = max(peak, scenario.Footprint.Total());
+
+            if (scenario.Game.Remaining == cards.Count() / 4)
+            {
+                halfway = scenario.Footprint.Bytes[static_cast<unsigned>(CardStatus::Matched)];
+            }
+        }
+
+        // Long enough for the last pair to have hidden
+        scenario.Complete(time + 10.0);
+
+        double const seconds = watch.Seconds();
+        size_t const matched = scenario.Footprint.Bytes[static_cast<unsigned>(CardStatus::Matched)];
+
+        consistent = consistent &&
+                     scenario.Game.IsComplete() &&
+                     scenario.Pool.BytesInUse == scenario.Footprint.Total() &&
+                     (!reclaim || (0 == matched &&
+                                   scenario.Slots.Bound.empty() &&
+                                   0 == scenario.VisualCount() &&
+                                   scenario.Hiding.Cards.empty()));
+
+        printf("reclaim: %-4s matched cards hold %5.1f MB halfway, %5.1f MB at the end, all cards %5.1f MB at most, %3u slots bound, %3u with visuals, %.2f ms%s\n",
+               reclaim ? "free" : "keep",
+               halfway / 1048576.0,
+               matched / 1048576.0,
+               peak / 1048576.0,
+               static_cast<unsigned>(scenario.Slots.Bound.size()),
+               scenario.VisualCount(),
+               seconds * 1e3,
+               consistent ? "" : " MISMATCH");
+    }
+}
+
+static uint64_t Checksum(BitmapView const & image)
+{
+    uint64_t sum = 0;
+
+    for (unsigned i = 0; i != image.Width * image.Height; ++i)
+    {
+        sum += image.Pixels[i];
+    }
+
+    return sum;
+}
+
+static void Startup()
+{
+    PathChar const * const cache = PATH_TEXT("startup.bgrx");
+    ImageStamp const stamp = { 1, 1 };
+
+    RemovePath(cache);
+
+    vector<uint8_t> const source = EncodeJpeg(SyntheticPhoto(1104, 737), 0);
+
+    // A cold start decodes the image and writes the cache
+    Stopwatch const coldWatch;
+
+    Image cold;
+    cold.Decoded = DecodeJpeg(source.data(), source.size());
+    cold.View = cold.Decoded;
+    bool const written = WriteImageCache(cache, cold.View, stamp);
+    uint64_t const coldSum = Checksum(cold.View);
+
+    double const coldSeconds = coldWatch.Seconds();
+
+    // A warm start maps the cache and reads every pixel once
+    Stopwatch const warmWatch;
+
+    Image warm;
+    bool const mapped = MapImageCache(cache, stamp, warm);
+    uint64_t const warmSum = mapped ? Checksum(warm.View) : 0;
+
+    double const warmSeconds = warmWatch.Seconds();
+
+    Image stale;
+    bool const rejected = !MapImageCache(cache, ImageStamp{ 1, 2 }, stale);
+
+    printf("startup: cold %.2f ms, warm %.2f ms%s\n",
+           coldSeconds * 1e3,
+           warmSeconds * 1e3,
+           written && mapped && rejected && coldSum == warmSum ? "" : " FAILED");
+
+    RemovePath(cache);
+}
+
+struct Benchmark
+{
+    char const * Name;
+    void (*Run)();
+};
+
+static Benchmark const Benchmarks[] =
+{
+    { "simulate", SimulateGames },
+    { "hittest", HitTest },
+    { "raster", Rasterize },
+    { "glyphs", ComposeFronts },
+    { "recover", Recover },
+    { "startup", Startup },
+    { "jpeg", DecodeJpegs },
+    { "resample", ResampleBacks },
+    { "animate", Animate },
+    { "click", ClickLatency },
+    { "matrix", ComposeMatrices },
+    { "pick", PickCards },
+    { "replay", Replay },
+    { "boards", DealBoards },
+    { "solve", Solve },
+    { "host", HostSessions },
+    { "trace", TraceZones },
+    { "log", LogMessages },
+    #ifndef _WIN32
+    { "window", DispatchMessages },
+    #endif
+    { "surfaces", RecycleSurfaces },
+    { "viewport", ScrollViewports },
+    { "reclaim", ReclaimMatched },
+};
+
+int main(int const argc,
+         char const * const * const argv)
+{
+    for (Benchmark const & benchmark : Benchmarks)
+    {
+        bool selected = argc < 2;
+
+        for (int i = 1; i != argc; ++i)
+        {
+            selected = selected || 0 == strcmp(argv[i], benchmark.Name);
+        }
+
+        if (selected)
+        {
+            benchmark.Run();
+        }
+    }
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "Random.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+//
+// The game rules have no dependency on Windows, COM or DirectComposition so
+// that they may be exercised headless. SampleWindow calls into GameState and
+// keeps only the presentation side of each card.
+//
+
+unsigned const NoCard = ~0u;
+
+// The most cards a board may have
+unsigned const MaxCards = 1u << 20;
+
+// Whether a board of this size can be dealt: it must have cards, pair them
+// all and be no larger than MaxCards. The product is taken at 64 bits so
+// that sizes whose product wraps are refused rather than accepted.
+inline bool IsValidBoard(unsigned const rows,
+                         unsigned const columns)
+{
+    unsigned long long const count = static_cast<unsigned long long>(rows) * columns;
+
+    return 0 != count && 0 == count % 2 && count <= MaxCards;
+}
+
+enum class CardStatus
+{
+    Hidden,
+    Selected,
+    Matched
+};
+
+enum class ClickResult
+{
+    Ignored,
+    Shown,
+    Matched,
+    Mismatched
+};
+
+inline bool IsMatch(wchar_t const first,
+                    wchar_t const second)
+{
+    int const expected = 'a' - 'A';
+
+    int const actual = abs(first - second);
+
+    return expected == actual;
+}
+
+//
+// The capitals that cards may show. Each block's lower case letters follow
+// its capitals at the offset IsMatch expects, and no block spans as much as
+// that offset, so no two letters from different pairs ever match.
+//
+
+struct LetterBlock
+{
+    wchar_t First;
+    wchar_t Last;
+    wchar_t Excluded;
+};
+
+LetterBlock const LetterBlocks[] =
+{
+    { L'A', L'Z', 0 },
+    { 0x00C0, 0x00DE, 0x00D7 }, // Latin-1 without the multiplication sign
+    { 0x0391, 0x03A9, 0x03A2 }, // Greek without the unassigned code point
+    { 0x0410, 0x042F, 0 },      // Cyrillic
+};
+
+unsigned const CapitalCount = 112;
+
+struct Capitals
+{
+    wchar_t Letters[CapitalCount] = {};
+
+    constexpr Capitals()
+    {
+        unsigned count = 0;
+
+        for (LetterBlock const & block : LetterBlocks)
+        {
+            for (wchar_t letter = block.First; letter <= block.Last; ++letter)
+            {
+                if (letter != block.Excluded && count != CapitalCount)
+                {
+                    Letters[count++] = letter;
+                }
+            }
+        }
+    }
+};
+
+//
+// Deals a pair for each of as many distinct capitals as there are pairs,
+// chosen by a partial shuffle of the capitals. Only a board with more pairs
+// than capitals has to use a capital again, and then only once all of them
+// have been used. The deal depends only on the generator's sequence so a
+// seed reproduces a board anywhere.
+//
+
+template <typename Generator>
+void DealCards(wchar_t * const value,
+               CardStatus * const status,
+               unsigned const count,
+               Generator & generator)
+{
+    Capitals capitals;
+    unsigned const pairs = count / 2;
+
+    for (unsigned i = 0; i != pairs; ++i)
+    {
+        unsigned const used = i % CapitalCount;
+        unsigned const chosen = used + RandomBelow(generator, CapitalCount - used);
+
+        std::swap(capitals.Letters[used], capitals.Letters[chosen]);
+
+        wchar_t const capital = capitals.Letters[used];
+
+        value[i * 2 + 0] = capital;
+        value[i * 2 + 1] = static_cast<wchar_t>(capital + ('a' - 'A'));
+    }
+
+    RandomShuffle(value, value + count, generator);
+    std::fill(status, status + count, CardStatus::Hidden);
+}
+
+struct Board
+{
+    unsigned Rows = 0;
+    unsigned Columns = 0;
+    std::vector<CardStatus> Status;
+    std::vector<wchar_t> Value;
+
+    Board(unsigned const rows,
+          unsigned const columns) :
+        Rows(rows),
+        Columns(columns),
+        Status(rows * columns, CardStatus::Hidden),
+        Value(rows * columns, L' ')
+    {}
+
+    unsigned Count() const
+    {
+        return Rows * Columns;
+    }
+
+    template <typename Generator>
+    void Shuffle(Generator & generator)
+    {
+        DealCards(Value.data(), Status.data(), Count(), generator);
+    }
+};
+
+//
+// The rules of a game over any storage for its cards that offers Count,
+// Status, Value and Shuffle as Board does, so that a host can keep the
+// cards of many games in memory it manages itself.
+//
+
+template <typename CardStorage>
+struct BasicGameState
+{
+    CardStorage Cards;
+    unsigned FirstCard = NoCard;
+    unsigned Remaining = 0;
+    unsigned Clicks = 0;
+
+    BasicGameState(unsigned const rows,
+                   unsigned const columns) :
+        Cards(rows, columns)
+    {}
+
+    explicit BasicGameState(CardStorage const & cards) :
+        Cards(cards)
+    {}
+
+    template <typename Generator>
+    void Reset(Generator & generator)
+    {
+        Cards.Shuffle(generator);
+        FirstCard = NoCard;
+        Remaining = Cards.Count() / 2;
+        Clicks = 0;
+    }
+
+    bool IsComplete() const
+    {
+        return 0 == Remaining;
+    }
+
+    ClickResult Click(unsigned const card)
+    {
+        if (card >= Cards.Count()) return ClickResult::Ignored;
+
+        if (card == FirstCard) return ClickResult::Ignored;
+
+        if (Cards.Status[card] == CardStatus::Matched) return ClickResult::Ignored;
+
+        ++Clicks;
+
+        if (NoCard == FirstCard)
+        {
+            FirstCard = card;
+            Cards.Status[card] = CardStatus::Selected;
+            return ClickResult::Shown;
+        }
+
+        unsigned const first = FirstCard;
+        FirstCard = NoCard;
+        Cards.Status[first] = CardStatus::Hidden;
+
+        if (!IsMatch(Cards.Value[first], Cards.Value[card]))
+        {
+            return ClickResult::Mismatched;
+        }
+
+        Cards.Status[first] = Cards.Status[card] = CardStatus::Matched;
+        --Remaining;
+        return ClickResult::Matched;
+    }
+};
+
+typedef BasicGameState<Board> GameState;
@@ -13,23 +13,14 @@
 #endif
 #endif
 
+// TRACE writes through the asynchronous logger in debug builds, and in a
+// release build only if it asks for tracing by defining TRACING=1. Shipping
+// builds compile it out as before, so they start no logging thread and pay
+// nothing for a failure path that logs.
 #ifndef TRACE
-#ifdef _DEBUG
-#include <stdio.h>
-template <typename... Args>
-void DebugTrace(wchar_t const * format, Args... args)
-{
-    wchar_t buffer [512];
-
-    int const count = swprintf_s(buffer,
-                                 format,
-                                 args...);
-
-    ASSERT(-1 != count);
-
-    OutputDebugString(buffer);
-}
-#define TRACE DebugTrace
+#if defined(_DEBUG) || (defined(TRACING) && TRACING)
+#include "Log.h"
+#define TRACE Log
 #else
 #define TRACE __noop
 #endif
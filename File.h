@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+typedef wchar_t PathChar;
+#define PATH_TEXT(text) L##text
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+typedef char PathChar;
+#define PATH_TEXT(text) text
+#endif
+
+//
+// Paths are wide on Windows and narrow elsewhere, as the native file APIs
+// expect, and PATH_TEXT spells a literal path either way. A mapped file is read straight from the page cache without being
+// copied, and is unmapped when it goes out of scope.
+//
+
+struct MappedFile
+{
+    void const * Data = nullptr;
+    size_t Size = 0;
+
+    #ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+    #else
+    int m_file = -1;
+    #endif
+
+    MappedFile() = default;
+    MappedFile(MappedFile const &) = delete;
+    MappedFile & operator=(MappedFile const &) = delete;
+
+    MappedFile(MappedFile && other)
+    {
+        Swap(other);
+    }
+
+    MappedFile & operator=(MappedFile && other)
+    {
+        Close();
+        Swap(other);
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    void Swap(MappedFile & other)
+    {
+        std::swap(Data, other.Data);
+        std::swap(Size, other.Size);
+        std::swap(m_file, other.m_file);
+
+        #ifdef _WIN32
+        std::swap(m_mapping, other.m_mapping);
+        #endif
+    }
+
+    bool Open(PathChar const * path)
+    {
+        Close();
+
+        #ifdef _WIN32
+
+        m_file = CreateFile(path,
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            nullptr,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+
+        if (INVALID_HANDLE_VALUE == m_file) return false;
+
+        LARGE_INTEGER size = {};
+
+        if (!GetFileSizeEx(m_file, &size) || 0 == size.QuadPart) return false;
+
+        m_mapping = CreateFileMapping(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (!m_mapping) return false;
+
+        Data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        Size = static_cast<size_t>(size.QuadPart);
+
+        #else
+
+        m_file = open(path, O_RDONLY);
+
+        if (-1 == m_file) return false;
+
+        struct stat data = {};
+
+        if (0 != fstat(m_file, &data) || 0 == data.st_size) return false;
+
+        void * const view = mmap(nullptr, data.st_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+
+        if (MAP_FAILED == view) return false;
+
+        Data = view;
+        Size = static_cast<size_t>(data.st_size);
+
+        #endif
+
+        return nullptr != Data;
+    }
+
+    void Close()
+    {
+        #ifdef _WIN32
+
+        if (Data) UnmapViewOfFile(Data);
+        if (m_mapping) CloseHandle(m_mapping);
+        if (INVALID_HANDLE_VALUE != m_file) CloseHandle(m_file);
+
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+
+        #else
+
+        if (Data) munmap(const_cast<void *>(Data), Size);
+        if (-1 != m_file) close(m_file);
+
+        m_file = -1;
+
+        #endif
+
+        Data = nullptr;
+        Size = 0;
+    }
+};
+
+inline FILE * OpenPath(PathChar const * path,
+                       PathChar const * mode)
+{
+    FILE * file = nullptr;
+
+    #ifdef _WIN32
+    if (0 != _wfopen_s(&file, path, mode)) return nullptr;
+    #else
+    file = fopen(path, mode);
+    #endif
+
+    return file;
+}
+
+inline bool RemovePath(PathChar const * path)
+{
+    #ifdef _WIN32
+    return 0 == _wremove(path);
+    #else
+    return 0 == remove(path);
+    #endif
+}
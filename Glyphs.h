@@ -0,0 +1,213 @@
+#pragma once
+
+#include "Raster.h"
+#include <string>
+#include <utility>
+
+//
+// Caches rasterized card glyphs so that each distinct glyph is rasterized
+// once per font and DPI no matter how many cards show it. A page holds the
+// glyphs for one font and DPI packed into rows of coverage masks called
+// sheets. A sheet only ever grows downward, so existing entries never move,
+// and once it is GlyphSheetHeight tall the next glyph starts a new sheet.
+// Each sheet is uploaded as a bitmap of its own, so the cap keeps every one
+// well within the largest texture a device takes however high the DPI.
+//
+
+unsigned const GlyphSheetWidth = 1024;
+unsigned const GlyphSheetHeight = 4096;
+
+struct GlyphEntry
+{
+    // The sheet holding the glyph and its position within it
+    unsigned Sheet = 0;
+    unsigned X = 0;
+    unsigned Y = 0;
+    unsigned Width = 0;
+    unsigned Height = 0;
+
+    // Position of the trimmed glyph relative to the card
+    int OffsetX = 0;
+    int OffsetY = 0;
+};
+
+struct GlyphPage
+{
+    std::wstring Font;
+    float Size = 0.0f;
+    float DpiX = 0.0f;
+    float DpiY = 0.0f;
+    std::vector<AlphaMask> Sheets;
+    std::vector<std::pair<wchar_t, GlyphEntry>> Entries;
+    unsigned ShelfX = 0;
+    unsigned ShelfY = 0;
+    unsigned ShelfHeight = 0;
+
+    // Incremented whenever glyphs are added so that copies of the sheets on
+    // the device can tell when they are stale. Only the last sheet changes.
+    unsigned Version = 0;
+
+    GlyphEntry const * Find(wchar_t const value) const
+    {
+        for (std::pair<wchar_t, GlyphEntry> const & entry : Entries)
+        {
+            if (entry.first == value)
+            {
+                return &entry.second;
+            }
+        }
+
+        return nullptr;
+    }
+
+    GlyphEntry Add(wchar_t const value,
+                   AlphaMask const & glyph)
+    {
+        unsigned left = glyph.Width;
+        unsigned top = glyph.Height;
+        unsigned right = 0;
+        unsigned bottom = 0;
+
+        for (unsigned y = 0; y != glyph.Height; ++y)
+        for (unsigned x = 0; x != glyph.Width; ++x)
+        {
+            if (glyph.Row(y)[x])
+            {
+                left = std::min(left, x);
+                top = std::min(top, y);
+                right = std::max(right, x + 1);
+                bottom = std::max(bottom, y + 1);
+            }
+        }
+
+        GlyphEntry entry;
+
+        if (left < right)
+        {
+            entry.Width = right - left;
+            entry.Height = bottom - top;
+            entry.OffsetX = left;
+            entry.OffsetY = top;
+
+            Pack(entry);
+
+            AlphaMask & sheet = Sheets[entry.Sheet];
+
+            for (unsigned y = 0; y != entry.Height; ++y)
+            {
+                memcpy(sheet.Coverage.data() + (entry.Y + y) * sheet.Width + entry.X,
+                       glyph.Row(top + y) + left,
+                       entry.Width);
+            }
+        }
+
+        ++Version;
+        Entries.emplace_back(value, entry);
+        return entry;
+    }
+
+    void Pack(GlyphEntry & entry)
+    {
+        if (Sheets.empty() || ShelfX + entry.Width > Sheets.back().Width)
+        {
+            ShelfX = 0;
+            ShelfY += ShelfHeight;
+            ShelfHeight = 0;
+        }
+
+        if (Sheets.empty() || ShelfY + entry.Height > std::max(GlyphSheetHeight, entry.Height))
+        {
+            Sheets.emplace_back();
+            Sheets.back().Width = std::max(GlyphSheetWidth, entry.Width);
+            ShelfX = 0;
+            ShelfY = 0;
+            ShelfHeight = 0;
+        }
+
+        AlphaMask & sheet = Sheets.back();
+
+        entry.Sheet = static_cast<unsigned>(Sheets.size() - 1);
+        entry.X = ShelfX;
+        entry.Y = ShelfY;
+        ShelfX += entry.Width;
+        ShelfHeight = std::max(ShelfHeight, entry.Height);
+
+        if (ShelfY + ShelfHeight > sheet.Height)
+        {
+            sheet.Height = ShelfY + ShelfHeight;
+            sheet.Coverage.resize(sheet.Width * sheet.Height);
+        }
+    }
+};
+
+struct GlyphAtlas
+{
+    std::vector<GlyphPage> Pages;
+    unsigned Current = 0;
+    unsigned Hits = 0;
+    unsigned Misses = 0;
+
+    GlyphPage & Select(std::wstring const & font,
+                       float const size,
+                       float const dpiX,
+                       float const dpiY)
+    {
+        for (Current = 0; Current != Pages.size(); ++Current)
+        {
+            GlyphPage const & page = Pages[Current];
+
+            if (page.Font == font &&
+                page.Size == size &&
+                page.DpiX == dpiX &&
+                page.DpiY == dpiY)
+            {
+                return Pages[Current];
+            }
+        }
+
+        Pages.emplace_back();
+        GlyphPage & page = Pages.back();
+        page.Font = font;
+        page.Size = size;
+        page.DpiX = dpiX;
+        page.DpiY = dpiY;
+        return page;
+    }
+
+    // Rasterize is called on a miss with the glyph value and must return a
+    // card sized coverage mask with the glyph positioned on it.
+    template <typename Rasterize>
+    GlyphEntry Find(wchar_t const value,
+                    Rasterize && rasterize)
+    {
+        GlyphPage & page = Pages[Current];
+
+        if (GlyphEntry const * entry = page.Find(value))
+        {
+            ++Hits;
+            return *entry;
+        }
+
+        ++Misses;
+        return page.Add(value, rasterize(value));
+    }
+};
+
+inline void RenderCardFront(Bitmap & target,
+                            GlyphPage const & page,
+                            GlyphEntry const & glyph)
+{
+    Clear(target, OpaqueWhite);
+
+    // A blank glyph is never packed so it may name a sheet that is not there
+    if (0 == glyph.Width) return;
+
+    DrawMask(target,
+             page.Sheets[glyph.Sheet],
+             glyph.X,
+             glyph.Y,
+             glyph.Width,
+             glyph.Height,
+             glyph.OffsetX,
+             glyph.OffsetY);
+}
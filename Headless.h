@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#ifndef ASSERT
+#include <cassert>
+#define ASSERT assert
+#endif
+
+//
+// Just enough of the Win32 windowing API for Window<T> to run without a
+// desktop, as on Linux. A headless window has a window procedure and user
+// data like any other. Messages sent to it are handled at once, and posted
+// messages wait in the queue of the thread that created it until
+// PumpMessages handles them. Nothing is drawn and no input arrives other
+// than what is sent or posted, so a window can be driven synthetically.
+//
+
+#ifndef CALLBACK
+#define CALLBACK
+#endif
+
+typedef unsigned UINT;
+typedef uintptr_t WPARAM;
+typedef intptr_t LPARAM;
+typedef intptr_t LRESULT;
+typedef intptr_t LONG_PTR;
+
+struct HeadlessWindow;
+typedef HeadlessWindow * HWND;
+
+typedef LRESULT (CALLBACK * WNDPROC)(HWND, UINT, WPARAM, LPARAM);
+
+UINT const WM_NULL = 0x0000;
+UINT const WM_CREATE = 0x0001;
+UINT const WM_DESTROY = 0x0002;
+UINT const WM_PAINT = 0x000F;
+UINT const WM_WINDOWPOSCHANGING = 0x0046;
+UINT const WM_NCCREATE = 0x0081;
+UINT const WM_LBUTTONUP = 0x0202;
+UINT const WM_DPICHANGED = 0x02E0;
+UINT const WM_APP = 0x8000;
+
+int const GWLP_USERDATA = -21;
+
+inline unsigned LOWORD(uintptr_t const value)
+{
+    return static_cast<unsigned>(value & 0xFFFF);
+}
+
+inline unsigned HIWORD(uintptr_t const value)
+{
+    return static_cast<unsigned>((value >> 16) & 0xFFFF);
+}
+
+inline LPARAM MAKELPARAM(unsigned const low,
+                         unsigned const high)
+{
+    return static_cast<LPARAM>((low & 0xFFFF) | (high & 0xFFFF) << 16);
+}
+
+struct CREATESTRUCT
+{
+    void * lpCreateParams;
+};
+
+struct HeadlessMessage
+{
+    HWND Window;
+    UINT Message;
+    WPARAM WParam;
+    LPARAM LParam;
+};
+
+// Each thread has a queue, as each Win32 thread does
+struct HeadlessQueue
+{
+    std::mutex Lock;
+    std::deque<HeadlessMessage> Messages;
+    bool Quit = false;
+};
+
+inline HeadlessQueue & ThreadQueue()
+{
+    thread_local HeadlessQueue queue;
+    return queue;
+}
+
+struct HeadlessWindow
+{
+    WNDPROC Procedure;
+    LONG_PTR UserData;
+    HeadlessQueue * Queue;
+};
+
+inline LONG_PTR GetWindowLongPtr(HWND const window,
+                                 int const index)
+{
+    ASSERT(GWLP_USERDATA == index);
+    (void)index;
+
+    return window->UserData;
+}
+
+inline LONG_PTR SetWindowLongPtr(HWND const window,
+                                 int const index,
+                                 LONG_PTR const value)
+{
+    ASSERT(GWLP_USERDATA == index);
+    (void)index;
+
+    LONG_PTR const previous = window->UserData;
+    window->UserData = value;
+    return previous;
+}
+
+inline LRESULT DefWindowProc(HWND,
+                             UINT,
+                             WPARAM,
+                             LPARAM)
+{
+    return 0;
+}
+
+inline LRESULT SendMessage(HWND const window,
+                           UINT const message,
+                           WPARAM const wparam,
+                           LPARAM const lparam)
+{
+    return window->Procedure(window, message, wparam, lparam);
+}
+
+// May be called from any thread
+inline bool PostMessage(HWND const window,
+                        UINT const message,
+                        WPARAM const wparam,
+                        LPARAM const lparam)
+{
+    std::lock_guard<std::mutex> const lock(window->Queue->Lock);
+
+    window->Queue->Messages.push_back(HeadlessMessage{ window, message, wparam, lparam });
+    return true;
+}
+
+inline void PostQuitMessage(int)
+{
+    HeadlessQueue & queue = ThreadQueue();
+    std::lock_guard<std::mutex> const lock(queue.Lock);
+
+    queue.Quit = true;
+}
+
+//
+// Creates a window on the calling thread, sending WM_NCCREATE and WM_CREATE
+// with the parameter as CreateWindowEx does. The window lasts until it is
+// destroyed, which sends WM_DESTROY.
+//
+
+inline HWND CreateHeadlessWindow(WNDPROC const procedure,
+                                 void * const parameter)
+{
+    HWND const window = new HeadlessWindow{ procedure, 0, &ThreadQueue() };
+    CREATESTRUCT create = { parameter };
+
+    SendMessage(window, WM_NCCREATE, 0, reinterpret_cast<LPARAM>(&create));
+    SendMessage(window, WM_CREATE, 0, reinterpret_cast<LPARAM>(&create));
+    return window;
+}
+
+inline void DestroyWindow(HWND const window)
+{
+    SendMessage(window, WM_DESTROY, 0, 0);
+
+    // Messages still queued for the window are dropped with it
+    std::lock_guard<std::mutex> const lock(window->Queue->Lock);
+    std::deque<HeadlessMessage> & messages = window->Queue->Messages;
+
+    for (auto i = messages.begin(); i != messages.end();)
+    {
+        i = i->Window == window ? messages.erase(i) : i + 1;
+    }
+
+    delete window;
+}
+
+// Handles the messages posted to the calling thread's windows so far and
+// returns false once PostQuitMessage has been called
+inline bool PumpMessages()
+{
+    HeadlessQueue & queue = ThreadQueue();
+
+    for (;;)
+    {
+        HeadlessMessage message;
+
+        {
+            std::lock_guard<std::mutex> const lock(queue.Lock);
+
+            if (queue.Quit) return false;
+            if (queue.Messages.empty()) return true;
+
+            message = queue.Messages.front();
+            queue.Messages.pop_front();
+        }
+
+        SendMessage(message.Window, message.Message, message.WParam, message.LParam);
+    }
+}
@@ -0,0 +1,330 @@
+#pragma once
+
+#include "Animation.h"
+#include "Board.h"
+#include "Input.h"
+#include "Layout.h"
+#include "Parallel.h"
+#include "Picking.h"
+#include "Pool.h"
+#include "Random.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//
+// Hosts many games in one process without windows or devices, for bots,
+// tournaments and replays. A session plays by the same rules as the window:
+// a click picks the card under it as the cards are turned at that moment and
+// starts the same flips. Each session keeps its cards and animation tracks
+// in an arena of its own, and sessions at the same size and DPI share one
+// read only card grid. Input for any number of sessions is queued and then
+// processed as a batch, with the sessions spread over threads; a session's
+// events are always handled in order by one thread.
+//
+
+// The cards of a hosted game, kept in its session's arena
+struct CardSpan
+{
+    unsigned Rows = 0;
+    unsigned Columns = 0;
+    CardStatus * Status = nullptr;
+    wchar_t * Value = nullptr;
+
+    unsigned Count() const
+    {
+        return Rows * Columns;
+    }
+
+    template <typename Generator>
+    void Shuffle(Generator & generator)
+    {
+        DealCards(Value, Status, Count(), generator);
+    }
+};
+
+// The animation tracks of a hosted game, kept in its session's arena
+struct TrackSpan
+{
+    AnimationTrack * Tracks = nullptr;
+};
+
+typedef BasicGameState<CardSpan> HostedGame;
+
+struct HostedSession
+{
+    Arena Memory;
+    HostedGame Game;
+    TrackSpan Animations;
+    CardGrid const * Grid = nullptr;
+    Pcg32 Generator;
+    unsigned Games = 0;
+    bool Open = true;
+
+    HostedSession(unsigned const rows,
+                  unsigned const columns,
+                  uint64_t const seed) :
+        Memory(Arena::Footprint<CardStatus>(rows * columns) +
+               Arena::Footprint<wchar_t>(rows * columns) +
+               Arena::Footprint<AnimationTrack>(rows * columns)),
+        Game(AllocateCards(Memory, rows, columns)),
+        Animations{ Memory.Allocate<AnimationTrack>(rows * columns) },
+        Generator(seed)
+    {
+        Game.Reset(Generator);
+    }
+
+    static CardSpan AllocateCards(Arena & memory,
+                                  unsigned const rows,
+                                  unsigned const columns)
+    {
+        CardSpan cards;
+        cards.Rows = rows;
+        cards.Columns = columns;
+        cards.Status = memory.Allocate<CardStatus>(rows * columns);
+        cards.Value = memory.Allocate<wchar_t>(rows * columns);
+        return cards;
+    }
+
+    // The bytes this session occupies, its arena included
+    size_t Bytes() const
+    {
+        return sizeof(HostedSession) + Memory.Capacity;
+    }
+};
+
+// An event queued for a session
+struct HostEvent
+{
+    unsigned Session;
+    InputEvent Event;
+};
+
+struct SharedGrid
+{
+    unsigned DpiX;
+    unsigned DpiY;
+    CardGrid Grid;
+};
+
+struct SessionHost
+{
+    // The layout in logical units and the flip, as the window uses
+    float Margin = 15.0f;
+    float CardWidth = 150.0f;
+    float CardHeight = 210.0f;
+    AccelerateDecelerate Curve = AccelerateDecelerate(0.2f, 0.8f);
+
+    // Whether a completed game is dealt again, as bots expect, rather than
+    // ignoring further clicks as the window does
+    bool Redeal = false;
+
+    std::vector<HostedSession> Sessions;
+    std::vector<HostEvent> Pending;
+
+    std::vector<unsigned> m_free;
+    std::vector<std::unique_ptr<SharedGrid>> m_grids;
+    std::mutex m_gridLock;
+
+    // The pending events ordered by session, and where each session's end
+    std::vector<unsigned> m_order;
+    std::vector<unsigned> m_first;
+    std::vector<unsigned> m_active;
+
+    // Returns the new session, reusing one that was closed if possible
+    unsigned Open(unsigned const rows,
+                  unsigned const columns,
+                  uint64_t const seed,
+                  unsigned const dpiX = 96,
+                  unsigned const dpiY = 96)
+    {
+        HostedSession session(rows, columns, seed);
+        session.Grid = GridFor(rows, columns, dpiX, dpiY);
+
+        if (m_free.empty())
+        {
+            Sessions.push_back(std::move(session));
+            return static_cast<unsigned>(Sessions.size() - 1);
+        }
+
+        unsigned const index = m_free.back();
+        m_free.pop_back();
+        Sessions[index] = std::move(session);
+        return index;
+    }
+
+    // Releases the session's arena. Events still queued for it are dropped
+    // so that a session later opened at the same index never sees them.
+    void Close(unsigned const session)
+    {
+        if (!Sessions[session].Open) return;
+
+        Pending.erase(std::remove_if(Pending.begin(), Pending.end(), [&](HostEvent const & pending)
+        {
+            return pending.Session == session;
+        }),
+        Pending.end());
+
+        Sessions[session].Open = false;
+        Sessions[session].Memory = Arena();
+        m_free.push_back(session);
+    }
+
+    void Submit(unsigned const session,
+                InputEvent const & event)
+    {
+        if (session >= Sessions.size()) return;
+
+        Pending.push_back(HostEvent{ session, event });
+    }
+
+    //
+    // Handles every queued event. The events are grouped by session with a
+    // counting sort, which keeps each session's events in the order they
+    // were submitted, and the sessions with events are shared among threads.
+    //
+
+    void Process(unsigned const threads = HardwareThreads())
+    {
+        unsigned const count = static_cast<unsigned>(Sessions.size());
+
+        m_first.assign(count + 1, 0);
+
+        for (HostEvent const & pending : Pending)
+        {
+            ++m_first[pending.Session + 1];
+        }
+
+        m_active.clear();
+
+        for (unsigned session = 0; session != count; ++session)
+        {
+            if (m_first[session + 1] && Sessions[session].Open)
+            {
+                m_active.push_back(session);
+            }
+
+            m_first[session + 1] += m_first[session];
+        }
+
+        m_order.resize(Pending.size());
+
+        for (unsigned i = 0; i != Pending.size(); ++i)
+        {
+            m_order[m_first[Pending[i].Session]++] = i;
+        }
+
+        // Each session's range now begins where the previous one ends
+
+        ParallelForStealing(static_cast<unsigned>(m_active.size()), threads, [&](unsigned const index, unsigned)
+        {
+            unsigned const session = m_active[index];
+            unsigned const begin = session ? m_first[session - 1] : 0;
+
+            for (unsigned i = begin; i != m_first[session]; ++i)
+            {
+                Handle(Sessions[session], Pending[m_order[i]].Event);
+            }
+        });
+
+        Pending.clear();
+    }
+
+    void Handle(HostedSession & session,
+                InputEvent const & event)
+    {
+        if (InputKind::Click == event.Kind)
+        {
+            Click(session, event.X, event.Y, event.Time);
+        }
+        else if (InputKind::Dpi == event.Kind)
+        {
+            session.Grid = GridFor(session.Game.Cards.Rows,
+                                   session.Game.Cards.Columns,
+                                   event.X,
+                                   event.Y);
+        }
+
+        // There is nothing to paint
+    }
+
+    void Click(HostedSession & session,
+               unsigned const x,
+               unsigned const y,
+               double const time)
+    {
+        CardPicker const picker;
+        HostedGame & game = session.Game;
+
+        unsigned const next = picker.CardAt(*session.Grid,
+                                            session.Animations,
+                                            time,
+                                            static_cast<float>(x),
+                                            static_cast<float>(y));
+
+        unsigned const first = game.FirstCard;
+        ClickResult const result = game.Click(next);
+
+        AnimateClick(session.Animations, result, first, next, time, Curve);
+
+        if (Redeal && game.IsComplete())
+        {
+            game.Reset(session.Generator);
+            ++session.Games;
+
+            for (unsigned card = 0; card != game.Cards.Count(); ++card)
+            {
+                session.Animations.Tracks[card].Set(0.0f);
+            }
+        }
+    }
+
+    CardGrid const * GridFor(unsigned const rows,
+                             unsigned const columns,
+                             unsigned const dpiX,
+                             unsigned const dpiY)
+    {
+        std::lock_guard<std::mutex> const lock(m_gridLock);
+
+        for (std::unique_ptr<SharedGrid> const & shared : m_grids)
+        {
+            if (shared->Grid.Rows == rows &&
+                shared->Grid.Columns == columns &&
+                shared->DpiX == dpiX &&
+                shared->DpiY == dpiY)
+            {
+                return &shared->Grid;
+            }
+        }
+
+        std::unique_ptr<SharedGrid> shared(new SharedGrid{ dpiX, dpiY, CardGrid() });
+
+        shared->Grid.Build(rows,
+                           columns,
+                           Margin,
+                           CardWidth,
+                           CardHeight,
+                           static_cast<float>(dpiX),
+                           static_cast<float>(dpiY));
+
+        m_grids.push_back(std::move(shared));
+        return &m_grids.back()->Grid;
+    }
+
+    // The bytes the open sessions occupy, excluding the shared grids
+    size_t SessionBytes() const
+    {
+        size_t bytes = 0;
+
+        for (HostedSession const & session : Sessions)
+        {
+            if (session.Open)
+            {
+                bytes += session.Bytes();
+            }
+        }
+
+        return bytes;
+    }
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "File.h"
+#include "Raster.h"
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+//
+// Decoded BGRX pixels are cached on disk with a small header identifying the
+// source file they came from. Later launches map the cache straight into
+// memory and skip decoding entirely. A cache whose source has changed since
+// it was written is ignored and rewritten.
+//
+
+uint32_t const ImageCacheMagic = 0x58524742; // "BGRX"
+
+// Identifies the version of a source file by its size and modification time
+struct ImageStamp
+{
+    uint64_t Size = 0;
+    uint64_t Time = 0;
+};
+
+struct ImageCacheHeader
+{
+    uint32_t Magic;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Reserved;
+    uint64_t SourceSize;
+    uint64_t SourceTime;
+};
+
+inline bool GetImageStamp(PathChar const * path,
+                          ImageStamp & stamp)
+{
+    #ifdef _WIN32
+
+    WIN32_FILE_ATTRIBUTE_DATA data = {};
+
+    if (!GetFileAttributesEx(path, GetFileExInfoStandard, &data)) return false;
+
+    stamp.Size = static_cast<uint64_t>(data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+    stamp.Time = static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+
+    #else
+
+    struct stat data = {};
+
+    if (0 != stat(path, &data)) return false;
+
+    stamp.Size = static_cast<uint64_t>(data.st_size);
+    stamp.Time = static_cast<uint64_t>(data.st_mtime);
+
+    #endif
+
+    return true;
+}
+
+// Pixels that were either decoded into memory or mapped from the cache
+struct Image
+{
+    BitmapView View;
+    Bitmap Decoded;
+    MappedFile Mapping;
+};
+
+inline bool WriteImageCache(PathChar const * path,
+                            BitmapView const & image,
+                            ImageStamp const & stamp)
+{
+    FILE * file = nullptr;
+
+    #ifdef _WIN32
+    if (0 != _wfopen_s(&file, path, L"wb")) return false;
+    #else
+    file = fopen(path, "wb");
+    if (!file) return false;
+    #endif
+
+    ImageCacheHeader const header =
+    {
+        ImageCacheMagic,
+        image.Width,
+        image.Height,
+        0,
+        stamp.Size,
+        stamp.Time
+    };
+
+    size_t const count = static_cast<size_t>(image.Width) * image.Height;
+
+    bool const written =
+        1 == fwrite(&header, sizeof(header), 1, file) &&
+        count == fwrite(image.Pixels, sizeof(uint32_t), count, file);
+
+    return 0 == fclose(file) && written;
+}
+
+inline bool MapImageCache(PathChar const * path,
+                          ImageStamp const & stamp,
+                          Image & image)
+{
+    MappedFile mapping;
+
+    if (!mapping.Open(path)) return false;
+
+    if (mapping.Size < sizeof(ImageCacheHeader)) return false;
+
+    ImageCacheHeader const & header = *static_cast<ImageCacheHeader const *>(mapping.Data);
+
+    if (ImageCacheMagic != header.Magic ||
+        stamp.Size != header.SourceSize ||
+        stamp.Time != header.SourceTime ||
+        mapping.Size != sizeof(header) + static_cast<size_t>(header.Width) * header.Height * sizeof(uint32_t))
+    {
+        return false;
+    }
+
+    image.View = BitmapView(header.Width,
+                            header.Height,
+                            reinterpret_cast<uint32_t const *>(&header + 1));
+
+    image.Mapping = std::move(mapping);
+    return true;
+}
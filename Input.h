@@ -0,0 +1,231 @@
+#pragma once
+
+#include "Board.h"
+#include "File.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+//
+// A compact binary log of the input a session receives, so that a session
+// can be replayed without a window. The header gives the board size and the
+// seed the cards were shuffled with, and a log whose board could not be
+// dealt is refused when loaded. Each event follows as its kind, the
+// microseconds since the previous event and two values, all as variable
+// length integers, so a click usually takes no more than eight bytes.
+//
+
+uint32_t const InputLogMagic = 0x53445243; // "CRDS"
+
+enum class InputKind : uint8_t
+{
+    Click, // X and Y are the position on the board in physical pixels
+    Dpi,   // X and Y are the new DPI
+    Paint,
+};
+
+struct InputEvent
+{
+    InputKind Kind;
+    double Time; // Seconds since the session began
+    unsigned X;
+    unsigned Y;
+};
+
+struct InputLogHeader
+{
+    uint32_t Magic;
+    uint32_t Rows;
+    uint32_t Columns;
+    uint32_t Seed;
+    uint64_t Count;
+};
+
+struct InputLog
+{
+    unsigned Rows = 0;
+    unsigned Columns = 0;
+    uint32_t Seed = 0;
+    uint64_t Count = 0;
+    std::vector<uint8_t> Bytes;
+    uint64_t m_last = 0;
+
+    void Record(InputKind const kind,
+                double const time,
+                unsigned const x = 0,
+                unsigned const y = 0)
+    {
+        uint64_t const microseconds = time > 0.0 ? static_cast<uint64_t>(time * 1e6 + 0.5) : 0;
+        uint64_t const delta = microseconds > m_last ? microseconds - m_last : 0;
+
+        m_last += delta;
+
+        Write(static_cast<uint8_t>(kind));
+        Write(delta);
+        Write(x);
+        Write(y);
+        ++Count;
+    }
+
+    void Write(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            Bytes.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+
+        Bytes.push_back(static_cast<uint8_t>(value));
+    }
+
+    // Calls handler(InputEvent const &) for every event in order and returns
+    // false if the log ends part way through an event.
+    template <typename Handler>
+    bool Replay(Handler && handler) const
+    {
+        size_t offset = 0;
+        uint64_t time = 0;
+
+        for (uint64_t i = 0; i != Count; ++i)
+        {
+            uint64_t kind = 0;
+            uint64_t delta = 0;
+            uint64_t x = 0;
+            uint64_t y = 0;
+
+            if (!Read(offset, kind) ||
+                !Read(offset, delta) ||
+                !Read(offset, x) ||
+                !Read(offset, y) ||
+                kind > static_cast<uint64_t>(InputKind::Paint))
+            {
+                return false;
+            }
+
+            time += delta;
+
+            handler(InputEvent
+            {
+                static_cast<InputKind>(kind),
+                time / 1e6,
+                static_cast<unsigned>(x),
+                static_cast<unsigned>(y)
+            });
+        }
+
+        return true;
+    }
+
+    bool Read(size_t & offset,
+              uint64_t & value) const
+    {
+        value = 0;
+
+        for (unsigned shift = 0; shift < 64 && offset != Bytes.size(); shift += 7)
+        {
+            uint8_t const byte = Bytes[offset++];
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+            if (0 == (byte & 0x80)) return true;
+        }
+
+        return false;
+    }
+
+    bool Save(PathChar const * path) const
+    {
+        FILE * file = nullptr;
+
+        #ifdef _WIN32
+        if (0 != _wfopen_s(&file, path, L"wb")) return false;
+        #else
+        file = fopen(path, "wb");
+        if (!file) return false;
+        #endif
+
+        InputLogHeader const header =
+        {
+            InputLogMagic,
+            Rows,
+            Columns,
+            Seed,
+            Count
+        };
+
+        bool const written =
+            1 == fwrite(&header, sizeof(header), 1, file) &&
+            Bytes.size() == fwrite(Bytes.data(), 1, Bytes.size(), file);
+
+        return 0 == fclose(file) && written;
+    }
+
+    bool Load(PathChar const * path)
+    {
+        MappedFile mapping;
+
+        if (!mapping.Open(path) || mapping.Size < sizeof(InputLogHeader)) return false;
+
+        InputLogHeader header;
+        memcpy(&header, mapping.Data, sizeof(header));
+
+        if (InputLogMagic != header.Magic) return false;
+
+        if (!IsValidBoard(header.Rows, header.Columns)) return false;
+
+        uint8_t const * const events = static_cast<uint8_t const *>(mapping.Data) + sizeof(header);
+
+        Rows = header.Rows;
+        Columns = header.Columns;
+        Seed = header.Seed;
+        Count = header.Count;
+        Bytes.assign(events, events + (mapping.Size - sizeof(header)));
+        m_last = 0;
+        return true;
+    }
+};
+
+//
+// Generates a random click stream for load testing. Clicks land anywhere in
+// the window, margins included, with intervals from a rapid double click up
+// to a leisurely pause so that flips are often interrupted. Every so often
+// the DPI changes and the window paints.
+//
+
+template <typename Generator>
+void FuzzClicks(InputLog & log,
+                Generator & generator,
+                unsigned const count,
+                unsigned const width,
+                unsigned const height)
+{
+    std::uniform_int_distribution<unsigned> x(0, width - 1);
+    std::uniform_int_distribution<unsigned> y(0, height - 1);
+    std::exponential_distribution<double> interval(1.0 / 0.4);
+    std::uniform_int_distribution<unsigned> other(0, 99);
+    unsigned const dpis[] = { 96, 120, 144, 192 };
+    double time = 0.0;
+
+    for (unsigned i = 0; i != count; ++i)
+    {
+        time += interval(generator);
+
+        unsigned const roll = other(generator);
+
+        if (0 == roll)
+        {
+            unsigned const dpi = dpis[i % 4];
+            log.Record(InputKind::Dpi, time, dpi, dpi);
+            log.Record(InputKind::Paint, time);
+        }
+        else if (roll < 5)
+        {
+            log.Record(InputKind::Paint, time);
+        }
+        else
+        {
+            log.Record(InputKind::Click, time, x(generator), y(generator));
+        }
+    }
+}
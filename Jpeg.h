@@ -0,0 +1,1009 @@
+#pragma once
+
+#include "Parallel.h"
+#include "Raster.h"
+#include <climits>
+#include <cmath>
+#include <cstddef>
+
+//
+// A decoder for baseline JPEG that produces the same 32bppBGR layout the WIC
+// format converter does: tightly packed BGRX rows with an opaque X byte.
+//
+// Entropy decoding is sequential within a restart interval, so images with
+// restart markers decode their intervals in parallel. The inverse DCT and
+// color conversion then run in parallel over MCU rows. Both have SSE2 paths,
+// color conversion also has an AVX2 path, and scalar code covers the rest.
+// Chroma halved horizontally is upsampled with the triangle filter libjpeg
+// uses by default and other ratios by replication.
+//
+
+struct JpegException
+{
+    char const * message;
+
+    JpegException(char const * const value) :
+        message(value)
+    {}
+};
+
+// Maps the zigzag order of the coefficients in the stream to natural order
+uint8_t const JpegNaturalOrder[64] =
+{
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63
+};
+
+struct JpegHuffman
+{
+    // Codes of up to nine bits resolve with a single lookup of the next nine
+    // bits giving the code length in the high byte and the symbol in the low.
+    uint16_t Fast[512] = {};
+    uint8_t Symbols[256] = {};
+    int MaxCode[18] = {};
+    int Offset[17] = {};
+
+    void Build(uint8_t const * counts,
+               uint8_t const * symbols,
+               unsigned const total)
+    {
+        std::fill(std::begin(Fast), std::end(Fast), static_cast<uint16_t>(0));
+        std::copy(symbols, symbols + total, Symbols);
+
+        int code = 0;
+        int index = 0;
+
+        for (int length = 1; length <= 16; ++length)
+        {
+            Offset[length] = index - code;
+
+            for (unsigned i = 0; i != counts[length - 1]; ++i, ++code, ++index)
+            {
+                if (length <= 9)
+                {
+                    int const first = code << (9 - length);
+
+                    std::fill(Fast + first,
+                              Fast + first + (1 << (9 - length)),
+                              static_cast<uint16_t>(length << 8 | Symbols[index]));
+                }
+            }
+
+            MaxCode[length] = counts[length - 1] ? code - 1 : -1;
+            code <<= 1;
+        }
+
+        MaxCode[17] = INT_MAX;
+    }
+};
+
+// Reads the entropy coded data, removing stuffed zero bytes. Once a marker is
+// reached it supplies zero bits rather than reading past it.
+struct JpegBits
+{
+    uint8_t const * m_data;
+    uint8_t const * m_end;
+    uint32_t m_buffer = 0;
+    int m_count = 0;
+
+    JpegBits(uint8_t const * const data,
+             uint8_t const * const end) :
+        m_data(data),
+        m_end(end)
+    {}
+
+    void Fill()
+    {
+        while (m_count <= 24)
+        {
+            uint32_t byte = 0;
+
+            if (m_data < m_end)
+            {
+                byte = *m_data;
+
+                if (0xFF != byte)
+                {
+                    ++m_data;
+                }
+                else if (m_data + 1 < m_end && 0 == m_data[1])
+                {
+                    m_data += 2;
+                }
+                else
+                {
+                    byte = 0;
+                }
+            }
+
+            m_buffer |= byte << (24 - m_count);
+            m_count += 8;
+        }
+    }
+
+    int Receive(int const bits)
+    {
+        Fill();
+        int const value = static_cast<int>(m_buffer >> (32 - bits));
+        m_buffer <<= bits;
+        m_count -= bits;
+        return value;
+    }
+
+    // Reads a magnitude category and sign extends it
+    int ReceiveExtend(int const bits)
+    {
+        if (0 == bits) return 0;
+
+        int const value = Receive(bits);
+
+        return value < (1 << (bits - 1)) ? value - (1 << bits) + 1 : value;
+    }
+
+    int Decode(JpegHuffman const & table)
+    {
+        Fill();
+
+        uint32_t const peek = m_buffer >> 16;
+        uint16_t const fast = table.Fast[peek >> 7];
+
+        if (fast)
+        {
+            m_buffer <<= fast >> 8;
+            m_count -= fast >> 8;
+            return fast & 0xFF;
+        }
+
+        for (int length = 10; length <= 16; ++length)
+        {
+            int const code = static_cast<int>(peek >> (16 - length));
+
+            if (code <= table.MaxCode[length])
+            {
+                m_buffer <<= length;
+                m_count -= length;
+                return table.Symbols[(code + table.Offset[length]) & 0xFF];
+            }
+        }
+
+        // Corrupt data decodes as zero so that the remaining blocks are empty
+        return 0;
+    }
+};
+
+struct JpegComponent
+{
+    unsigned Id = 0;
+    unsigned H = 1;
+    unsigned V = 1;
+    unsigned Quant = 0;
+    unsigned DcTable = 0;
+    unsigned AcTable = 0;
+    unsigned BlocksPerLine = 0;
+    unsigned BlocksPerColumn = 0;
+
+    // Size of the component without the padding to whole MCUs
+    unsigned Width = 0;
+    unsigned Height = 0;
+
+    std::vector<int16_t> Coefficients;
+    std::vector<uint8_t> Plane;
+};
+
+#if SIMD_SSE2
+
+struct JpegFloat4
+{
+    __m128 v;
+};
+
+inline JpegFloat4 operator+(JpegFloat4 const a, JpegFloat4 const b)
+{
+    return { _mm_add_ps(a.v, b.v) };
+}
+
+inline JpegFloat4 operator-(JpegFloat4 const a, JpegFloat4 const b)
+{
+    return { _mm_sub_ps(a.v, b.v) };
+}
+
+inline JpegFloat4 operator*(JpegFloat4 const a, float const b)
+{
+    return { _mm_mul_ps(a.v, _mm_set1_ps(b)) };
+}
+
+#endif
+
+// One dimensional AAN inverse DCT in place. The inputs must have been scaled
+// by the AAN factors, which the decoder folds into its quantization tables.
+template <typename T>
+void JpegIdct(T * v)
+{
+    T tmp10 = v[0] + v[4];
+    T tmp11 = v[0] - v[4];
+    T tmp13 = v[2] + v[6];
+    T tmp12 = (v[2] - v[6]) * 1.414213562f - tmp13;
+
+    T const tmp0 = tmp10 + tmp13;
+    T const tmp3 = tmp10 - tmp13;
+    T const tmp1 = tmp11 + tmp12;
+    T const tmp2 = tmp11 - tmp12;
+
+    T const z13 = v[5] + v[3];
+    T const z10 = v[5] - v[3];
+    T const z11 = v[1] + v[7];
+    T const z12 = v[1] - v[7];
+
+    T const tmp7 = z11 + z13;
+    tmp11 = (z11 - z13) * 1.414213562f;
+
+    T const z5 = (z10 + z12) * 1.847759065f;
+    tmp10 = z12 * 1.082392200f - z5;
+    tmp12 = z10 * -2.613125930f + z5;
+
+    T const tmp6 = tmp12 - tmp7;
+    T const tmp5 = tmp11 - tmp6;
+    T const tmp4 = tmp10 + tmp5;
+
+    v[0] = tmp0 + tmp7;
+    v[7] = tmp0 - tmp7;
+    v[1] = tmp1 + tmp6;
+    v[6] = tmp1 - tmp6;
+    v[2] = tmp2 + tmp5;
+    v[5] = tmp2 - tmp5;
+    v[4] = tmp3 + tmp4;
+    v[3] = tmp3 - tmp4;
+}
+
+inline uint8_t JpegClamp(float const value)
+{
+    long const result = lrintf(value) + 128;
+
+    return static_cast<uint8_t>(std::min(255L, std::max(0L, result)));
+}
+
+// Transforms one block of coefficients into 8x8 samples
+inline void JpegTransformBlock(int16_t const * coefficients,
+                               float const * scale,
+                               uint8_t * target,
+                               unsigned const stride)
+{
+    #if SIMD_SSE2
+
+    // Each row is held as two vectors of four columns. The column pass runs
+    // on all columns at once, the block is transposed and the row pass runs
+    // the same way before transposing back.
+
+    JpegFloat4 left[8];
+    JpegFloat4 right[8];
+    __m128i const zero = _mm_setzero_si128();
+
+    for (unsigned row = 0; row != 8; ++row)
+    {
+        __m128i const values = _mm_loadu_si128(reinterpret_cast<__m128i const *>(coefficients + row * 8));
+        __m128i const sign = _mm_cmpgt_epi16(zero, values);
+
+        left[row].v = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(values, sign)), _mm_loadu_ps(scale + row * 8));
+        right[row].v = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(values, sign)), _mm_loadu_ps(scale + row * 8 + 4));
+    }
+
+    JpegIdct(left);
+    JpegIdct(right);
+
+    JpegFloat4 top[8] = { left[0], left[1], left[2], left[3], right[0], right[1], right[2], right[3] };
+    JpegFloat4 bottom[8] = { left[4], left[5], left[6], left[7], right[4], right[5], right[6], right[7] };
+
+    for (JpegFloat4 * half : { top, bottom })
+    {
+        _MM_TRANSPOSE4_PS(half[0].v, half[1].v, half[2].v, half[3].v);
+        _MM_TRANSPOSE4_PS(half[4].v, half[5].v, half[6].v, half[7].v);
+        JpegIdct(half);
+        _MM_TRANSPOSE4_PS(half[0].v, half[1].v, half[2].v, half[3].v);
+        _MM_TRANSPOSE4_PS(half[4].v, half[5].v, half[6].v, half[7].v);
+    }
+
+    __m128i const bias = _mm_set1_epi16(128);
+
+    for (unsigned row = 0; row != 8; ++row)
+    {
+        JpegFloat4 const * half = row < 4 ? top : bottom;
+        unsigned const index = row % 4;
+
+        __m128i const words = _mm_add_epi16(_mm_packs_epi32(_mm_cvtps_epi32(half[index].v),
+                                                            _mm_cvtps_epi32(half[index + 4].v)),
+                                            bias);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(target + row * stride),
+                         _mm_packus_epi16(words, words));
+    }
+
+    #else
+
+    float block[64];
+
+    for (unsigned i = 0; i != 64; ++i)
+    {
+        block[i] = coefficients[i] * scale[i];
+    }
+
+    float column[8];
+
+    for (unsigned x = 0; x != 8; ++x)
+    {
+        for (unsigned y = 0; y != 8; ++y) column[y] = block[y * 8 + x];
+        JpegIdct(column);
+        for (unsigned y = 0; y != 8; ++y) block[y * 8 + x] = column[y];
+    }
+
+    for (unsigned y = 0; y != 8; ++y)
+    {
+        JpegIdct(block + y * 8);
+
+        for (unsigned x = 0; x != 8; ++x)
+        {
+            target[y * stride + x] = JpegClamp(block[y * 8 + x]);
+        }
+    }
+
+    #endif
+}
+
+inline uint32_t JpegPixel(float const y,
+                          float const cb,
+                          float const cr)
+{
+    long const r = lrintf(std::min(255.0f, std::max(0.0f, y + 1.402f * cr)));
+    long const g = lrintf(std::min(255.0f, std::max(0.0f, y - 0.344136f * cb - 0.714136f * cr)));
+    long const b = lrintf(std::min(255.0f, std::max(0.0f, y + 1.772f * cb)));
+
+    return static_cast<uint32_t>(b | g << 8 | r << 16) | 0xFF000000;
+}
+
+// Converts a row of full resolution samples to opaque BGRX pixels
+inline void JpegConvertRow(uint32_t * target,
+                           uint8_t const * y,
+                           uint8_t const * cb,
+                           uint8_t const * cr,
+                           unsigned count)
+{
+    #if SIMD_AVX2
+
+    {
+        __m256 const center = _mm256_set1_ps(128.0f);
+        __m256 const low = _mm256_setzero_ps();
+        __m256 const high = _mm256_set1_ps(255.0f);
+        __m256i const alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+
+        for (; count >= 8; count -= 8, target += 8, y += 8, cb += 8, cr += 8)
+        {
+            __m256 const luma = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(y))));
+            __m256 const blue = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(cb)))), center);
+            __m256 const red = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(cr)))), center);
+
+            __m256 r = _mm256_add_ps(luma, _mm256_mul_ps(red, _mm256_set1_ps(1.402f)));
+            __m256 g = _mm256_sub_ps(_mm256_sub_ps(luma, _mm256_mul_ps(blue, _mm256_set1_ps(0.344136f))), _mm256_mul_ps(red, _mm256_set1_ps(0.714136f)));
+            __m256 b = _mm256_add_ps(luma, _mm256_mul_ps(blue, _mm256_set1_ps(1.772f)));
+
+            r = _mm256_min_ps(high, _mm256_max_ps(low, r));
+            g = _mm256_min_ps(high, _mm256_max_ps(low, g));
+            b = _mm256_min_ps(high, _mm256_max_ps(low, b));
+
+            __m256i const pixels = _mm256_or_si256(_mm256_or_si256(_mm256_cvtps_epi32(b),
+                                                                   _mm256_slli_epi32(_mm256_cvtps_epi32(g), 8)),
+                                                   _mm256_or_si256(_mm256_slli_epi32(_mm256_cvtps_epi32(r), 16),
+                                                                   alpha));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(target), pixels);
+        }
+    }
+
+    #endif
+
+    #if SIMD_SSE2
+
+    __m128 const center = _mm_set1_ps(128.0f);
+    __m128 const low = _mm_setzero_ps();
+    __m128 const high = _mm_set1_ps(255.0f);
+    __m128i const alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    __m128i const zero = _mm_setzero_si128();
+
+    auto load = [&](uint8_t const * source)
+    {
+        int bytes = 0;
+        memcpy(&bytes, source, sizeof(bytes));
+        __m128i const words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+    };
+
+    for (; count >= 4; count -= 4, target += 4, y += 4, cb += 4, cr += 4)
+    {
+        __m128 const luma = load(y);
+        __m128 const blue = _mm_sub_ps(load(cb), center);
+        __m128 const red = _mm_sub_ps(load(cr), center);
+
+        __m128 r = _mm_add_ps(luma, _mm_mul_ps(red, _mm_set1_ps(1.402f)));
+        __m128 g = _mm_sub_ps(_mm_sub_ps(luma, _mm_mul_ps(blue, _mm_set1_ps(0.344136f))), _mm_mul_ps(red, _mm_set1_ps(0.714136f)));
+        __m128 b = _mm_add_ps(luma, _mm_mul_ps(blue, _mm_set1_ps(1.772f)));
+
+        r = _mm_min_ps(high, _mm_max_ps(low, r));
+        g = _mm_min_ps(high, _mm_max_ps(low, g));
+        b = _mm_min_ps(high, _mm_max_ps(low, b));
+
+        __m128i const pixels = _mm_or_si128(_mm_or_si128(_mm_cvtps_epi32(b),
+                                                         _mm_slli_epi32(_mm_cvtps_epi32(g), 8)),
+                                            _mm_or_si128(_mm_slli_epi32(_mm_cvtps_epi32(r), 16),
+                                                         alpha));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(target), pixels);
+    }
+
+    #endif
+
+    for (; count; --count)
+    {
+        *target++ = JpegPixel(*y++, *cb++ - 128.0f, *cr++ - 128.0f);
+    }
+}
+
+// Replicates each sample factor times
+inline void JpegUpsampleRow(uint8_t * target,
+                            uint8_t const * source,
+                            unsigned const factor,
+                            unsigned count)
+{
+    #if SIMD_SSE2
+
+    if (2 == factor)
+    {
+        for (; count >= 32; count -= 32, target += 32, source += 16)
+        {
+            __m128i const samples = _mm_loadu_si128(reinterpret_cast<__m128i const *>(source));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(target), _mm_unpacklo_epi8(samples, samples));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(target + 16), _mm_unpackhi_epi8(samples, samples));
+        }
+    }
+
+    #endif
+
+    for (unsigned i = 0; i != count; ++i)
+    {
+        target[i] = source[i / factor];
+    }
+}
+
+// Doubles a row of chroma horizontally with the triangle filter libjpeg calls
+// fancy upsampling. The sums are the samples already filtered vertically and
+// scaled by four, with the first and last repeated once beyond each end.
+inline void JpegUpsampleFancy(uint8_t * target,
+                              int16_t const * sums,
+                              unsigned const count,
+                              int16_t const evenBias,
+                              int16_t const oddBias)
+{
+    unsigned i = 0;
+
+    #if SIMD_SSE2
+
+    __m128i const even = _mm_set1_epi16(evenBias);
+    __m128i const odd = _mm_set1_epi16(oddBias);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i const previous = _mm_loadu_si128(reinterpret_cast<__m128i const *>(sums + i));
+        __m128i const current = _mm_loadu_si128(reinterpret_cast<__m128i const *>(sums + i + 1));
+        __m128i const next = _mm_loadu_si128(reinterpret_cast<__m128i const *>(sums + i + 2));
+        __m128i const scaled = _mm_add_epi16(current, _mm_add_epi16(current, current));
+
+        __m128i const bytes = _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(scaled, previous), even), 4),
+                                               _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(scaled, next), odd), 4));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(target + i * 2),
+                         _mm_unpacklo_epi8(bytes, _mm_srli_si128(bytes, 8)));
+    }
+
+    #endif
+
+    for (; i != count; ++i)
+    {
+        int const scaled = sums[i + 1] * 3;
+        target[i * 2] = static_cast<uint8_t>((scaled + sums[i] + evenBias) >> 4);
+        target[i * 2 + 1] = static_cast<uint8_t>((scaled + sums[i + 2] + oddBias) >> 4);
+    }
+}
+
+struct JpegDecoder
+{
+    unsigned Width = 0;
+    unsigned Height = 0;
+    unsigned RestartInterval = 0;
+    unsigned MaxH = 1;
+    unsigned MaxV = 1;
+    unsigned McusX = 0;
+    unsigned McusY = 0;
+    std::vector<JpegComponent> Components;
+    uint16_t Quant[4][64] = {};
+    float Scale[4][64] = {};
+    JpegHuffman Dc[4];
+    JpegHuffman Ac[4];
+    uint8_t const * Scan = nullptr;
+    uint8_t const * ScanEnd = nullptr;
+
+    static unsigned Read16(uint8_t const * data)
+    {
+        return data[0] << 8 | data[1];
+    }
+
+    void Parse(uint8_t const * const data,
+               size_t const size)
+    {
+        if (size < 4 || 0xFF != data[0] || 0xD8 != data[1])
+        {
+            throw JpegException("Not a JPEG image");
+        }
+
+        size_t position = 2;
+
+        while (position + 4 <= size)
+        {
+            if (0xFF != data[position])
+            {
+                throw JpegException("Expected a marker");
+            }
+
+            uint8_t const marker = data[position + 1];
+            position += 2;
+
+            if (0xFF == marker)
+            {
+                --position;
+                continue;
+            }
+
+            if (0xD8 == marker || 0x01 == marker || (0xD0 <= marker && 0xD7 >= marker))
+            {
+                continue;
+            }
+
+            if (0xD9 == marker)
+            {
+                break;
+            }
+
+            unsigned const length = Read16(data + position);
+
+            if (length < 2 || position + length > size)
+            {
+                throw JpegException("Truncated segment");
+            }
+
+            uint8_t const * const segment = data + position + 2;
+            uint8_t const * const end = data + position + length;
+
+            if (0xC0 == marker || 0xC1 == marker)
+            {
+                ParseFrame(segment, end);
+            }
+            else if (0xC2 <= marker && 0xCF >= marker && 0xC4 != marker && 0xC8 != marker && 0xCC != marker)
+            {
+                throw JpegException("Only baseline JPEG is supported");
+            }
+            else if (0xC4 == marker)
+            {
+                ParseHuffman(segment, end);
+            }
+            else if (0xDB == marker)
+            {
+                ParseQuantization(segment, end);
+            }
+            else if (0xDD == marker)
+            {
+                if (end - segment < 2) throw JpegException("Truncated restart interval");
+
+                RestartInterval = Read16(segment);
+            }
+            else if (0xDA == marker)
+            {
+                ParseScan(segment, end);
+                FindScanEnd(end, data + size);
+                return;
+            }
+
+            position += length;
+        }
+
+        throw JpegException("No scan found");
+    }
+
+    void ParseFrame(uint8_t const * segment,
+                    uint8_t const * const end)
+    {
+        if (end - segment < 6 || 8 != segment[0])
+        {
+            throw JpegException("Only 8 bit precision is supported");
+        }
+
+        Height = Read16(segment + 1);
+        Width = Read16(segment + 3);
+        unsigned const count = segment[5];
+        segment += 6;
+
+        if (0 == Width || 0 == Height)
+        {
+            throw JpegException("Unsupported image size");
+        }
+
+        if ((1 != count && 3 != count) || end - segment < static_cast<ptrdiff_t>(count * 3))
+        {
+            throw JpegException("Only grayscale and YCbCr are supported");
+        }
+
+        Components.resize(count);
+
+        for (JpegComponent & component : Components)
+        {
+            component.Id = segment[0];
+            component.H = 1 == count ? 1 : segment[1] >> 4;
+            component.V = 1 == count ? 1 : segment[1] & 15;
+            component.Quant = segment[2] & 3;
+            segment += 3;
+
+            if (component.H < 1 || component.H > 4 || component.V < 1 || component.V > 4)
+            {
+                throw JpegException("Invalid sampling factors");
+            }
+
+            MaxH = std::max(MaxH, component.H);
+            MaxV = std::max(MaxV, component.V);
+        }
+
+        McusX = (Width + 8 * MaxH - 1) / (8 * MaxH);
+        McusY = (Height + 8 * MaxV - 1) / (8 * MaxV);
+
+        for (JpegComponent & component : Components)
+        {
+            if (MaxH % component.H || MaxV % component.V)
+            {
+                throw JpegException("Unsupported sampling factors");
+            }
+
+            component.BlocksPerLine = McusX * component.H;
+            component.BlocksPerColumn = McusY * component.V;
+            component.Width = (Width * component.H + MaxH - 1) / MaxH;
+            component.Height = (Height * component.V + MaxV - 1) / MaxV;
+            component.Coefficients.assign(component.BlocksPerLine * component.BlocksPerColumn * 64, 0);
+            component.Plane.resize(component.BlocksPerLine * component.BlocksPerColumn * 64);
+        }
+    }
+
+    void ParseHuffman(uint8_t const * segment,
+                      uint8_t const * const end)
+    {
+        while (end - segment >= 17)
+        {
+            unsigned const type = segment[0] >> 4;
+            unsigned const id = segment[0] & 3;
+            uint8_t const * const counts = segment + 1;
+            unsigned total = 0;
+
+            for (unsigned i = 0; i != 16; ++i)
+            {
+                total += counts[i];
+            }
+
+            segment += 17;
+
+            if (total > 256 || end - segment < static_cast<ptrdiff_t>(total))
+            {
+                throw JpegException("Invalid Huffman table");
+            }
+
+            (type ? Ac : Dc)[id].Build(counts, segment, total);
+            segment += total;
+        }
+    }
+
+    void ParseQuantization(uint8_t const * segment,
+                           uint8_t const * const end)
+    {
+        float const factors[8] =
+        {
+            1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+            1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+        };
+
+        while (end - segment >= 65)
+        {
+            bool const wide = 0 != (segment[0] >> 4);
+            unsigned const id = segment[0] & 3;
+            ++segment;
+
+            if (wide && end - segment < 128)
+            {
+                throw JpegException("Truncated quantization table");
+            }
+
+            for (unsigned k = 0; k != 64; ++k)
+            {
+                unsigned const value = wide ? Read16(segment + k * 2) : segment[k];
+                unsigned const natural = JpegNaturalOrder[k];
+
+                Quant[id][natural] = static_cast<uint16_t>(value);
+
+                // The AAN scaling and the final division by eight are folded in
+                Scale[id][natural] = value * factors[natural / 8] * factors[natural % 8] / 8.0f;
+            }
+
+            segment += wide ? 128 : 64;
+        }
+    }
+
+    void ParseScan(uint8_t const * segment,
+                   uint8_t const * const end)
+    {
+        if (end - segment < 1 || Components.empty())
+        {
+            throw JpegException("Scan before frame");
+        }
+
+        unsigned const count = segment[0];
+        ++segment;
+
+        if (count != Components.size() || end - segment < static_cast<ptrdiff_t>(count * 2 + 3))
+        {
+            throw JpegException("Only single scan images are supported");
+        }
+
+        for (unsigned i = 0; i != count; ++i, segment += 2)
+        {
+            for (JpegComponent & component : Components)
+            {
+                if (component.Id == segment[0])
+                {
+                    component.DcTable = segment[1] >> 4 & 3;
+                    component.AcTable = segment[1] & 3;
+                }
+            }
+        }
+    }
+
+    void FindScanEnd(uint8_t const * const start,
+                     uint8_t const * const end)
+    {
+        Scan = start;
+        ScanEnd = start;
+
+        while (ScanEnd + 1 < end)
+        {
+            if (0xFF == ScanEnd[0] && 0 != ScanEnd[1] && (0xD0 > ScanEnd[1] || 0xD7 < ScanEnd[1]))
+            {
+                return;
+            }
+
+            ++ScanEnd;
+        }
+
+        ScanEnd = end;
+    }
+
+    void DecodeMcus(JpegBits & bits,
+                    unsigned const first,
+                    unsigned const last)
+    {
+        int predictors[3] = {};
+
+        for (unsigned mcu = first; mcu != last; ++mcu)
+        {
+            unsigned const mcuX = mcu % McusX;
+            unsigned const mcuY = mcu / McusX;
+
+            for (unsigned c = 0; c != Components.size(); ++c)
+            {
+                JpegComponent & component = Components[c];
+
+                for (unsigned v = 0; v != component.V; ++v)
+                for (unsigned h = 0; h != component.H; ++h)
+                {
+                    unsigned const blockX = mcuX * component.H + h;
+                    unsigned const blockY = mcuY * component.V + v;
+
+                    DecodeBlock(bits,
+                                component,
+                                predictors[c],
+                                &component.Coefficients[(blockY * component.BlocksPerLine + blockX) * 64]);
+                }
+            }
+        }
+    }
+
+    void DecodeBlock(JpegBits & bits,
+                     JpegComponent const & component,
+                     int & predictor,
+                     int16_t * block)
+    {
+        predictor += bits.ReceiveExtend(bits.Decode(Dc[component.DcTable]));
+        block[0] = static_cast<int16_t>(predictor);
+
+        JpegHuffman const & table = Ac[component.AcTable];
+
+        for (unsigned k = 1; k < 64;)
+        {
+            int const symbol = bits.Decode(table);
+            int const run = symbol >> 4;
+            int const size = symbol & 15;
+
+            if (0 == size)
+            {
+                if (15 != run) break;
+
+                k += 16;
+                continue;
+            }
+
+            k += run;
+
+            if (k > 63) break;
+
+            block[JpegNaturalOrder[k++]] = static_cast<int16_t>(bits.ReceiveExtend(size));
+        }
+    }
+
+    void DecodeScan(unsigned const threads)
+    {
+        unsigned const total = McusX * McusY;
+
+        if (0 == RestartInterval)
+        {
+            JpegBits bits(Scan, ScanEnd);
+            DecodeMcus(bits, 0, total);
+            return;
+        }
+
+        // Each restart interval starts on a byte boundary after a marker and
+        // resets the predictors, so the intervals decode independently.
+
+        std::vector<uint8_t const *> starts(1, Scan);
+
+        for (uint8_t const * data = Scan; data + 1 < ScanEnd; ++data)
+        {
+            if (0xFF == data[0] && 0xD0 <= data[1] && 0xD7 >= data[1])
+            {
+                starts.push_back(data + 2);
+                ++data;
+            }
+        }
+
+        unsigned const intervals = std::min(static_cast<unsigned>(starts.size()),
+                                            (total + RestartInterval - 1) / RestartInterval);
+
+        ParallelFor(intervals, threads, [&](unsigned const interval)
+        {
+            JpegBits bits(starts[interval], ScanEnd);
+
+            DecodeMcus(bits,
+                       interval * RestartInterval,
+                       std::min(total, (interval + 1) * RestartInterval));
+        });
+    }
+
+    void Transform(unsigned const threads)
+    {
+        ParallelFor(McusY, threads, [&](unsigned const mcuY)
+        {
+            for (JpegComponent & component : Components)
+            {
+                unsigned const stride = component.BlocksPerLine * 8;
+
+                for (unsigned blockY = mcuY * component.V; blockY != (mcuY + 1) * component.V; ++blockY)
+                for (unsigned blockX = 0; blockX != component.BlocksPerLine; ++blockX)
+                {
+                    JpegTransformBlock(&component.Coefficients[(blockY * component.BlocksPerLine + blockX) * 64],
+                                       Scale[component.Quant],
+                                       &component.Plane[blockY * 8 * stride + blockX * 8],
+                                       stride);
+                }
+            }
+        });
+    }
+
+    Bitmap Convert(unsigned const threads)
+    {
+        Bitmap image(Width, Height);
+        unsigned const rowsPerBand = 8 * MaxV;
+        unsigned const bands = (Height + rowsPerBand - 1) / rowsPerBand;
+
+        ParallelFor(bands, threads, [&](unsigned const band)
+        {
+            std::vector<uint8_t> rows[3];
+            std::vector<int16_t> sums(Width + 2);
+            uint8_t const * samples[3] = {};
+
+            for (unsigned c = 0; c != 3; ++c)
+            {
+                rows[c].resize(Width + 32, 128);
+                samples[c] = rows[c].data();
+            }
+
+            unsigned const last = std::min(Height, (band + 1) * rowsPerBand);
+
+            for (unsigned y = band * rowsPerBand; y != last; ++y)
+            {
+                for (unsigned c = 0; c != Components.size(); ++c)
+                {
+                    JpegComponent const & component = Components[c];
+                    unsigned const stride = component.BlocksPerLine * 8;
+                    unsigned const row = y * component.V / MaxV;
+                    uint8_t const * source = &component.Plane[row * stride];
+
+                    if (component.H == MaxH)
+                    {
+                        samples[c] = source;
+                        continue;
+                    }
+
+                    samples[c] = rows[c].data();
+
+                    if (MaxH != component.H * 2 || (MaxV != component.V && MaxV != component.V * 2))
+                    {
+                        JpegUpsampleRow(rows[c].data(), source, MaxH / component.H, Width);
+                        continue;
+                    }
+
+                    // Halved vertically, each output row blends in the
+                    // nearest neighbouring row by a quarter, clamped at the
+                    // edges.
+
+                    uint8_t const * neighbour = source;
+
+                    if (MaxV != component.V)
+                    {
+                        unsigned const other = y % 2 ? std::min(row + 1, component.Height - 1) : (row ? row - 1 : 0);
+                        neighbour = &component.Plane[other * stride];
+                    }
+
+                    for (unsigned x = 0; x != component.Width; ++x)
+                    {
+                        sums[x + 1] = static_cast<int16_t>(source[x] * 3 + neighbour[x]);
+                    }
+
+                    sums[0] = sums[1];
+                    sums[component.Width + 1] = sums[component.Width];
+
+                    if (MaxV != component.V)
+                    {
+                        JpegUpsampleFancy(rows[c].data(), sums.data(), component.Width, 8, 7);
+                    }
+                    else
+                    {
+                        // Scaled by four instead so the rounding matches
+                        JpegUpsampleFancy(rows[c].data(), sums.data(), component.Width, 4, 8);
+                    }
+                }
+
+                JpegConvertRow(image.Row(y),
+                               samples[0],
+                               samples[1],
+                               samples[2],
+                               Width);
+            }
+        });
+
+        return image;
+    }
+};
+
+inline Bitmap DecodeJpeg(uint8_t const * const data,
+                         size_t const size,
+                         unsigned const threads = HardwareThreads())
+{
+    JpegDecoder decoder;
+    decoder.Parse(data, size);
+    decoder.DecodeScan(threads);
+    decoder.Transform(threads);
+    return decoder.Convert(threads);
+}
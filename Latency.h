@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+//
+// Records the most recent latencies, in seconds, for reporting percentiles.
+// Recording never allocates once the buffer has filled.
+//
+
+struct LatencyRecorder
+{
+    std::vector<double> Samples;
+    unsigned Capacity;
+    unsigned Next = 0;
+    unsigned long long Count = 0;
+
+    explicit LatencyRecorder(unsigned const capacity = 1024) :
+        Capacity(capacity)
+    {
+        Samples.reserve(capacity);
+    }
+
+    void Record(double const seconds)
+    {
+        if (Samples.size() < Capacity)
+        {
+            Samples.push_back(seconds);
+        }
+        else
+        {
+            Samples[Next] = seconds;
+        }
+
+        Next = (Next + 1) % Capacity;
+        ++Count;
+    }
+
+    // The fraction is between 0 and 1, so 0.99 is the 99th percentile
+    double Percentile(double const fraction) const
+    {
+        if (Samples.empty()) return 0.0;
+
+        std::vector<double> sorted(Samples);
+        size_t const index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+
+        std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+        return sorted[index];
+    }
+};
+
+//
+// Counts every latency of a session in a fixed number of buckets. Each power
+// of two of nanoseconds is split into four buckets, so a percentile is given
+// to within a quarter of its value however many latencies are recorded and
+// recording costs no more than finding the highest set bit.
+//
+
+struct LatencyHistogram
+{
+    static unsigned const SubBuckets = 4;
+    static unsigned const Buckets = 40 * SubBuckets;
+
+    unsigned long long Counts[Buckets] = {};
+    unsigned long long Count = 0;
+    double Worst = 0.0;
+
+    void Record(double const seconds)
+    {
+        unsigned long long const nanoseconds = seconds > 0.0 ? static_cast<unsigned long long>(seconds * 1e9) : 0;
+
+        ++Counts[std::min(Buckets - 1, Bucket(nanoseconds))];
+        ++Count;
+        Worst = std::max(Worst, seconds);
+    }
+
+    static unsigned Bucket(unsigned long long const nanoseconds)
+    {
+        if (nanoseconds < SubBuckets) return static_cast<unsigned>(nanoseconds);
+
+        unsigned exponent = 2;
+
+        while (nanoseconds >> (exponent + 1))
+        {
+            ++exponent;
+        }
+
+        unsigned const sub = static_cast<unsigned>(nanoseconds >> (exponent - 2)) - SubBuckets;
+
+        return (exponent - 1) * SubBuckets + sub;
+    }
+
+    // The nanoseconds at which a bucket ends
+    static double BucketEnd(unsigned const bucket)
+    {
+        if (bucket < SubBuckets) return bucket + 1.0;
+
+        unsigned const exponent = bucket / SubBuckets + 1;
+        unsigned const sub = bucket % SubBuckets;
+
+        return static_cast<double>((SubBuckets + sub + 1ull) << (exponent - 2));
+    }
+
+    // The fraction is between 0 and 1, and the result is the end of the
+    // bucket holding that percentile, in seconds
+    double Percentile(double const fraction) const
+    {
+        if (0 == Count) return 0.0;
+
+        unsigned long long const rank = std::min(Count - 1, static_cast<unsigned long long>(fraction * Count));
+        unsigned long long seen = 0;
+
+        for (unsigned bucket = 0; bucket != Buckets; ++bucket)
+        {
+            seen += Counts[bucket];
+
+            if (seen > rank) return std::min(Worst, BucketEnd(bucket) / 1e9);
+        }
+
+        return Worst;
+    }
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Board.h"
+#include <vector>
+
+template <typename T>
+float PhysicalToLogical(T const pixel,
+                        float const dpi)
+{
+    return pixel * 96.0f / dpi;
+}
+
+template <typename T>
+float LogicalToPhysical(T const pixel,
+                        float const dpi)
+{
+    return pixel * dpi / 96.0f;
+}
+
+//
+// Maps a physical pixel straight to a card slot. Each axis is divided by the
+// card pitch to find a candidate row and column, which is then tested against
+// the exact offsets so that clicks landing in the margins are rejected. The
+// offsets are computed with the same expression used to place the visuals.
+//
+
+struct CardGrid
+{
+    unsigned Rows = 0;
+    unsigned Columns = 0;
+    float Width = 0.0f;
+    float Height = 0.0f;
+    float OriginX = 0.0f;
+    float OriginY = 0.0f;
+    float PitchX = 1.0f;
+    float PitchY = 1.0f;
+    std::vector<float> OffsetX;
+    std::vector<float> OffsetY;
+
+    void Build(unsigned const rows,
+               unsigned const columns,
+               float const margin,
+               float const width,
+               float const height,
+               float const dpiX,
+               float const dpiY)
+    {
+        Rows = rows;
+        Columns = columns;
+        Width = LogicalToPhysical(width, dpiX);
+        Height = LogicalToPhysical(height, dpiY);
+        OriginX = LogicalToPhysical(margin, dpiX);
+        OriginY = LogicalToPhysical(margin, dpiY);
+        PitchX = LogicalToPhysical(width + margin, dpiX);
+        PitchY = LogicalToPhysical(height + margin, dpiY);
+
+        OffsetX.resize(columns);
+        OffsetY.resize(rows);
+
+        for (unsigned column = 0; column != columns; ++column)
+        {
+            OffsetX[column] = LogicalToPhysical(column * (width + margin) + margin, dpiX);
+        }
+
+        for (unsigned row = 0; row != rows; ++row)
+        {
+            OffsetY[row] = LogicalToPhysical(row * (height + margin) + margin, dpiY);
+        }
+    }
+
+    unsigned CardAt(float const x,
+                    float const y) const
+    {
+        unsigned const column = Slot(x, OriginX, PitchX, Width, OffsetX);
+
+        if (NoCard == column) return NoCard;
+
+        unsigned const row = Slot(y, OriginY, PitchY, Height, OffsetY);
+
+        if (NoCard == row) return NoCard;
+
+        return row * Columns + column;
+    }
+
+    static unsigned Slot(float const position,
+                         float const origin,
+                         float const pitch,
+                         float const size,
+                         std::vector<float> const & offsets)
+    {
+        if (!(position > origin)) return NoCard;
+
+        // Rounding may place a point just inside a card's leading edge in the
+        // previous slot, so the following slot is also considered.
+
+        unsigned const candidate = static_cast<unsigned>((position - origin) / pitch);
+
+        for (unsigned slot = candidate; slot != candidate + 2 && slot < offsets.size(); ++slot)
+        {
+            if (position > offsets[slot] &&
+                position < offsets[slot] + size)
+            {
+                return slot;
+            }
+        }
+
+        return NoCard;
+    }
+};
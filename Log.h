@@ -0,0 +1,455 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define LOG_TICKS 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LOG_TICKS 1
+#else
+#define LOG_TICKS 0
+#endif
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+
+//
+// An asynchronous logger cheap enough for hot paths and release builds. A
+// call copies the format string's address, a timestamp and its arguments
+// into a slot of a lock free ring buffer; a background thread formats them
+// later and writes the line out. Nothing is formatted, locked, allocated or
+// written on the calling thread. If the ring is full the message is dropped
+// and counted rather than making the caller wait. The background thread
+// sleeps until there is something to write, so an idle process is never
+// woken by it.
+//
+// The format must be a string literal, since only its address is kept.
+// Strings passed as arguments are copied, up to the space a message has for
+// them, so they need not outlive the call. Every other argument must be a
+// scalar of no more than eight bytes.
+//
+
+unsigned const LogCapacity = 4096; // A power of two
+unsigned const LogArgumentCapacity = 6;
+unsigned const LogTextCapacity = 176;
+unsigned const LogLineCapacity = 512;
+
+struct LogRecord;
+
+typedef int (*LogFormatter)(LogRecord const & record,
+                            wchar_t * buffer,
+                            size_t size);
+
+typedef void (*LogSink)(wchar_t const * line);
+
+struct LogRecord
+{
+    wchar_t const * Format;
+    LogFormatter Formatter;
+    uint64_t Ticks;
+    uint64_t Words[LogArgumentCapacity];
+    unsigned char Text[LogTextCapacity];
+};
+
+struct LogSlot
+{
+    std::atomic<uint64_t> Sequence;
+    LogRecord Record;
+};
+
+// Stores a scalar argument in its word and loads it back when formatting
+template <typename Arg>
+struct LogArgument
+{
+    static_assert(std::is_trivially_copyable<Arg>::value && sizeof(Arg) <= sizeof(uint64_t),
+                  "Log arguments must be scalars or strings");
+
+    static void Store(LogRecord &,
+                      unsigned &,
+                      uint64_t & word,
+                      Arg const value)
+    {
+        memcpy(&word, &value, sizeof(value));
+    }
+
+    static Arg Load(LogRecord const &,
+                    uint64_t const word)
+    {
+        Arg value;
+        memcpy(&value, &word, sizeof(value));
+        return value;
+    }
+};
+
+// Copies a string argument into the message's text and keeps its offset
+template <typename Char>
+struct LogText
+{
+    static void Store(LogRecord & record,
+                      unsigned & used,
+                      uint64_t & word,
+                      Char const * value)
+    {
+        used = (used + alignof(Char) - 1) / alignof(Char) * alignof(Char);
+        word = used;
+
+        Char * const text = reinterpret_cast<Char *>(record.Text + used);
+        unsigned const capacity = (LogTextCapacity - used) / sizeof(Char);
+
+        if (0 == capacity)
+        {
+            word = LogTextCapacity;
+            return;
+        }
+
+        unsigned length = 0;
+
+        while (value && value[length] && length + 1 < capacity)
+        {
+            text[length] = value[length];
+            ++length;
+        }
+
+        text[length] = 0;
+        used += (length + 1) * sizeof(Char);
+    }
+
+    static Char const * Load(LogRecord const & record,
+                             uint64_t const word)
+    {
+        static Char const empty[] = { 0 };
+
+        if (LogTextCapacity == word) return empty;
+
+        return reinterpret_cast<Char const *>(record.Text + word);
+    }
+};
+
+template <> struct LogArgument<wchar_t const *> : LogText<wchar_t> {};
+template <> struct LogArgument<wchar_t *> : LogText<wchar_t> {};
+template <> struct LogArgument<char const *> : LogText<char> {};
+template <> struct LogArgument<char *> : LogText<char> {};
+
+template <typename... Args>
+int PrintLog(wchar_t * buffer,
+             size_t const size,
+             wchar_t const * format,
+             Args... args)
+{
+    #ifdef _WIN32
+    return _snwprintf_s(buffer, size, _TRUNCATE, format, args...);
+    #else
+    return swprintf(buffer, size, format, args...);
+    #endif
+}
+
+template <typename... Args, size_t... Indices>
+int FormatLogRecord(LogRecord const & record,
+                    wchar_t * buffer,
+                    size_t const size,
+                    std::index_sequence<Indices...>)
+{
+    return PrintLog(buffer,
+                    size,
+                    record.Format,
+                    LogArgument<Args>::Load(record, record.Words[Indices])...);
+}
+
+template <typename... Args>
+int FormatLogRecord(LogRecord const & record,
+                    wchar_t * buffer,
+                    size_t const size)
+{
+    return FormatLogRecord<Args...>(record, buffer, size, std::index_sequence_for<Args...>());
+}
+
+inline uint64_t LogTicks()
+{
+    #if LOG_TICKS
+    return __rdtsc();
+    #else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    #endif
+}
+
+inline void DefaultLogSink(wchar_t const * line)
+{
+    #ifdef _WIN32
+    OutputDebugStringW(line);
+    #else
+    fputws(line, stderr);
+    #endif
+}
+
+struct Logger
+{
+    std::unique_ptr<LogSlot[]> m_slots;
+    std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_consumed;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<LogSink> m_sink;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_sleeping;
+    std::mutex m_wakeLock;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+
+    // Ticks are converted to seconds against the steady clock
+    uint64_t const m_startTicks;
+    std::chrono::steady_clock::time_point const m_startTime;
+
+    Logger() :
+        m_slots(new LogSlot[LogCapacity]),
+        m_head(0),
+        m_consumed(0),
+        m_dropped(0),
+        m_sink(DefaultLogSink),
+        m_stop(false),
+        m_sleeping(false),
+        m_startTicks(LogTicks()),
+        m_startTime(std::chrono::steady_clock::now())
+    {
+        for (unsigned i = 0; i != LogCapacity; ++i)
+        {
+            m_slots[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+
+        m_thread = std::thread([this]
+        {
+            Run();
+        });
+    }
+
+    ~Logger()
+    {
+        {
+            // Under the lock so that the consumer cannot miss it on its way
+            // to sleep
+            std::lock_guard<std::mutex> const lock(m_wakeLock);
+            m_stop.store(true, std::memory_order_release);
+            m_sleeping.store(false, std::memory_order_relaxed);
+        }
+
+        m_wake.notify_one();
+        m_thread.join();
+    }
+
+    Logger(Logger const &) = delete;
+    Logger & operator=(Logger const &) = delete;
+
+    template <typename... Args>
+    bool Write(wchar_t const * format,
+               Args... args)
+    {
+        static_assert(sizeof...(Args) <= LogArgumentCapacity, "Too many log arguments");
+
+        uint64_t position = m_head.load(std::memory_order_relaxed);
+        LogSlot * slot = nullptr;
+
+        for (;;)
+        {
+            slot = &m_slots[position % LogCapacity];
+
+            uint64_t const sequence = slot->Sequence.load(std::memory_order_acquire);
+            int64_t const difference = static_cast<int64_t>(sequence - position);
+
+            if (0 == difference)
+            {
+                if (m_head.compare_exchange_weak(position,
+                                                 position + 1,
+                                                 std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed)) break;
+            }
+            else if (difference < 0)
+            {
+                // The consumer has yet to free the slot a lap behind
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                position = m_head.load(std::memory_order_relaxed);
+            }
+        }
+
+        LogRecord & record = slot->Record;
+        record.Format = format;
+        record.Formatter = FormatLogRecord<Args...>;
+        record.Ticks = LogTicks();
+
+        unsigned used = 0;
+        unsigned index = 0;
+
+        int const stored[] =
+        {
+            0,
+            (LogArgument<Args>::Store(record, used, record.Words[index++], args), 0)...
+        };
+
+        (void)stored;
+
+        slot->Sequence.store(position + 1, std::memory_order_release);
+
+        // The claim on the slot and this load are ordered with the consumer's
+        // going to sleep, so either it sees the claim or this sees it asleep.
+        // Both are free on x86, where the claim is a locked instruction.
+        if (m_sleeping.load(std::memory_order_seq_cst))
+        {
+            Wake();
+        }
+
+        return true;
+    }
+
+    // Replaces where lines are written, from then on
+    void Redirect(LogSink const sink)
+    {
+        m_sink.store(sink, std::memory_order_release);
+    }
+
+    // Waits until every message written so far has been written out
+    void Flush()
+    {
+        uint64_t const target = m_head.load(std::memory_order_acquire);
+
+        while (m_consumed.load(std::memory_order_acquire) < target)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    uint64_t Dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    void Run()
+    {
+        uint64_t reported = 0;
+
+        for (;;)
+        {
+            bool const stopping = m_stop.load(std::memory_order_acquire);
+            unsigned const drained = Drain();
+
+            uint64_t const dropped = Dropped();
+
+            if (dropped != reported)
+            {
+                wchar_t line[64];
+                PrintLog(line, 64, L"%llu log messages dropped\n", static_cast<unsigned long long>(dropped - reported));
+                m_sink.load(std::memory_order_acquire)(line);
+                reported = dropped;
+            }
+
+            if (stopping && 0 == drained) return;
+
+            if (0 == drained)
+            {
+                Sleep();
+            }
+        }
+    }
+
+    // Waits until a message is written or the logger is stopping
+    void Sleep()
+    {
+        std::unique_lock<std::mutex> lock(m_wakeLock);
+        m_sleeping.store(true, std::memory_order_seq_cst);
+
+        // A slot claimed but not yet written is waited for without sleeping
+        if (m_head.load(std::memory_order_seq_cst) != m_consumed.load(std::memory_order_relaxed) ||
+            m_stop.load(std::memory_order_relaxed))
+        {
+            m_sleeping.store(false, std::memory_order_relaxed);
+            lock.unlock();
+            std::this_thread::yield();
+            return;
+        }
+
+        m_wake.wait(lock, [this]
+        {
+            return !m_sleeping.load(std::memory_order_relaxed);
+        });
+    }
+
+    // Only the writer that finds the consumer asleep takes the lock
+    void Wake()
+    {
+        if (!m_sleeping.exchange(false, std::memory_order_acq_rel)) return;
+
+        std::lock_guard<std::mutex> const lock(m_wakeLock);
+        m_wake.notify_one();
+    }
+
+    unsigned Drain()
+    {
+        unsigned drained = 0;
+        uint64_t position = m_consumed.load(std::memory_order_relaxed);
+
+        // The tick rate is measured over the whole run so far
+        double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+        uint64_t const ticks = LogTicks() - m_startTicks;
+        double const rate = seconds > 0.0 && ticks ? seconds / ticks : 0.0;
+
+        for (;;)
+        {
+            LogSlot & slot = m_slots[position % LogCapacity];
+
+            if (slot.Sequence.load(std::memory_order_acquire) != position + 1) break;
+
+            LogRecord const & record = slot.Record;
+            wchar_t line[LogLineCapacity];
+
+            int const prefix = PrintLog(line,
+                                        LogLineCapacity,
+                                        L"[%10.6f] ",
+                                        static_cast<double>(record.Ticks - m_startTicks) * rate);
+
+            if (0 <= prefix && 0 > record.Formatter(record, line + prefix, LogLineCapacity - prefix))
+            {
+                // Too long for a line, so it is cut short
+                line[LogLineCapacity - 2] = L'\n';
+                line[LogLineCapacity - 1] = 0;
+            }
+
+            slot.Sequence.store(position + LogCapacity, std::memory_order_release);
+
+            m_sink.load(std::memory_order_acquire)(line);
+            m_consumed.store(++position, std::memory_order_release);
+            ++drained;
+        }
+
+        return drained;
+    }
+};
+
+inline Logger & Logs()
+{
+    static Logger logger;
+    return logger;
+}
+
+template <typename... Args>
+void Log(wchar_t const * format,
+         Args... args)
+{
+    Logs().Write(format, args...);
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "Simd.h"
+
+//
+// A 4x4 matrix with the same layout and conventions as D2D1_MATRIX_4X4_F:
+// row major, applied to row vectors, so a * b applies a first. The factories
+// and product evaluate the same float expressions in the same order as
+// D2D1::Matrix4x4F, so the results are identical bit for bit and the card
+// projection can be reproduced away from Direct2D.
+//
+
+struct Matrix4x4
+{
+    float M[4][4];
+
+    static Matrix4x4 Identity()
+    {
+        return Translation(0.0f, 0.0f, 0.0f);
+    }
+
+    static Matrix4x4 Translation(float const x,
+                                 float const y,
+                                 float const z)
+    {
+        return
+        {{
+            { 1.0f, 0.0f, 0.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f, 0.0f },
+            { 0.0f, 0.0f, 1.0f, 0.0f },
+            { x,    y,    z,    1.0f },
+        }};
+    }
+
+    static Matrix4x4 RotationY(float const degrees)
+    {
+        float sine = 0.0f;
+        float cosine = 0.0f;
+        SinCos(degrees * (3.141592654f / 180.0f), sine, cosine);
+
+        return
+        {{
+            { cosine, 0.0f, -sine,  0.0f },
+            { 0.0f,   1.0f, 0.0f,   0.0f },
+            { sine,   0.0f, cosine, 0.0f },
+            { 0.0f,   0.0f, 0.0f,   1.0f },
+        }};
+    }
+
+    static Matrix4x4 PerspectiveProjection(float const depth)
+    {
+        float const projection = depth > 0.0f ? -1.0f / depth : 0.0f;
+
+        return
+        {{
+            { 1.0f, 0.0f, 0.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f, 0.0f },
+            { 0.0f, 0.0f, 1.0f, projection },
+            { 0.0f, 0.0f, 0.0f, 1.0f },
+        }};
+    }
+
+    // The sine and cosine Direct2D uses for its rotations: the angle is
+    // reduced to [-pi/2, pi/2] and fed to minimax polynomials, so that a half
+    // turn has a sine of exactly zero.
+    static void SinCos(float const radians,
+                       float & sine,
+                       float & cosine)
+    {
+        float quotient = 0.159154943f * radians;
+
+        quotient = radians >= 0.0f ?
+            static_cast<float>(static_cast<int>(quotient + 0.5f)) :
+            static_cast<float>(static_cast<int>(quotient - 0.5f));
+
+        float y = radians - 6.283185307f * quotient;
+        float sign = 1.0f;
+
+        if (y > 1.570796327f)
+        {
+            y = 3.141592654f - y;
+            sign = -1.0f;
+        }
+        else if (y < -1.570796327f)
+        {
+            y = -3.141592654f - y;
+            sign = -1.0f;
+        }
+
+        float const y2 = y * y;
+
+        sine = (((((-2.3889859e-08f * y2 + 2.7525562e-06f) * y2 - 0.00019840874f) * y2 + 0.0083333310f) * y2 - 0.16666667f) * y2 + 1.0f) * y;
+
+        float const p = ((((-2.6051615e-07f * y2 + 2.4760495e-05f) * y2 - 0.0013888378f) * y2 + 0.041666638f) * y2 - 0.5f) * y2 + 1.0f;
+
+        cosine = sign * p;
+    }
+};
+
+inline Matrix4x4 operator*(Matrix4x4 const & a,
+                           Matrix4x4 const & b)
+{
+    Matrix4x4 result;
+
+    #if SIMD_SSE2
+
+    // Each row of the product is a sum of the rows of b scaled by one row of
+    // a. The products are added in the same order as the scalar expression
+    // so rounding is unchanged.
+
+    __m128 const b0 = _mm_loadu_ps(b.M[0]);
+    __m128 const b1 = _mm_loadu_ps(b.M[1]);
+    __m128 const b2 = _mm_loadu_ps(b.M[2]);
+    __m128 const b3 = _mm_loadu_ps(b.M[3]);
+
+    for (unsigned row = 0; row != 4; ++row)
+    {
+        float const * const r = a.M[row];
+
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(r[0]), b0);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(r[1]), b1));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(r[2]), b2));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(r[3]), b3));
+
+        _mm_storeu_ps(result.M[row], sum);
+    }
+
+    #else
+
+    for (unsigned row = 0; row != 4; ++row)
+    {
+        for (unsigned column = 0; column != 4; ++column)
+        {
+            result.M[row][column] = a.M[row][0] * b.M[0][column] +
+                                    a.M[row][1] * b.M[1][column] +
+                                    a.M[row][2] * b.M[2][column] +
+                                    a.M[row][3] * b.M[3][column];
+        }
+    }
+
+    #endif
+
+    return result;
+}
+
+//
+// The transforms either side of a card's rotation. They depend only on the
+// card size and which face they are for, so every card shares them. The pre
+// transform centres the card on the axis of rotation, turning the front
+// around so that it faces away while the back is showing. The post transform
+// adds perspective and moves the card back into place.
+//
+
+inline Matrix4x4 CardPreTransform(float const width,
+                                  float const height,
+                                  bool const front)
+{
+    return Matrix4x4::Translation(-width / 2.0f, -height / 2.0f, 0.0f) *
+           Matrix4x4::RotationY(front ? 180.0f : 0.0f);
+}
+
+inline Matrix4x4 CardPostTransform(float const width,
+                                   float const height)
+{
+    return Matrix4x4::PerspectiveProjection(width * 2.0f) *
+           Matrix4x4::Translation(width / 2.0f, height / 2.0f, 0.0f);
+}
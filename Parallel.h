@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline unsigned HardwareThreads()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+//
+// Calls body(index) once for every index below count using up to the given
+// number of threads, the calling thread included. Indices are handed out one
+// at a time so uneven work balances itself. The body must not throw.
+//
+
+template <typename Body>
+void ParallelFor(unsigned const count,
+                 unsigned const threads,
+                 Body && body)
+{
+    unsigned const workers = std::min(threads, count);
+
+    if (workers <= 1)
+    {
+        for (unsigned i = 0; i != count; ++i)
+        {
+            body(i);
+        }
+
+        return;
+    }
+
+    std::atomic<unsigned> next(0);
+
+    auto work = [&]
+    {
+        for (unsigned i = next++; i < count; i = next++)
+        {
+            body(i);
+        }
+    };
+
+    std::vector<std::thread> helpers;
+
+    for (unsigned i = 1; i != workers; ++i)
+    {
+        helpers.emplace_back(work);
+    }
+
+    work();
+
+    for (std::thread & helper : helpers)
+    {
+        helper.join();
+    }
+}
+
+//
+// Like ParallelFor but suited to many small tasks: each thread starts with an
+// equal share of the indices and works through it without contention. A
+// thread that runs out steals the later half of whatever remains of the
+// largest share. The body is called as body(index, thread) so that it can
+// keep state per thread without locking. The body must not throw.
+//
+
+struct StealingRange
+{
+    std::mutex Lock;
+    unsigned Begin = 0;
+    unsigned End = 0;
+};
+
+template <typename Body>
+void ParallelForStealing(unsigned const count,
+                         unsigned const threads,
+                         Body && body)
+{
+    unsigned const workers = std::max(1u, std::min(threads, count));
+    std::unique_ptr<StealingRange[]> const ranges(new StealingRange[workers]);
+
+    for (unsigned i = 0; i != workers; ++i)
+    {
+        ranges[i].Begin = static_cast<unsigned>(static_cast<unsigned long long>(count) * i / workers);
+        ranges[i].End = static_cast<unsigned>(static_cast<unsigned long long>(count) * (i + 1) / workers);
+    }
+
+    auto work = [&](unsigned const worker)
+    {
+        StealingRange & own = ranges[worker];
+
+        for (;;)
+        {
+            unsigned index = count;
+
+            {
+                std::lock_guard<std::mutex> const lock(own.Lock);
+
+                if (own.Begin != own.End)
+                {
+                    index = own.Begin++;
+                }
+            }
+
+            if (index != count)
+            {
+                body(index, worker);
+                continue;
+            }
+
+            // Find the largest share and take the later half of it
+
+            unsigned victim = worker;
+            unsigned largest = 0;
+
+            for (unsigned i = 0; i != workers; ++i)
+            {
+                std::lock_guard<std::mutex> const lock(ranges[i].Lock);
+
+                if (ranges[i].End - ranges[i].Begin > largest)
+                {
+                    largest = ranges[i].End - ranges[i].Begin;
+                    victim = i;
+                }
+            }
+
+            if (0 == largest) return;
+
+            unsigned begin = 0;
+            unsigned end = 0;
+
+            {
+                std::lock_guard<std::mutex> const lock(ranges[victim].Lock);
+
+                end = ranges[victim].End;
+                begin = end - (end - ranges[victim].Begin + 1) / 2;
+                ranges[victim].End = begin;
+            }
+
+            std::lock_guard<std::mutex> const lock(own.Lock);
+            own.Begin = begin;
+            own.End = end;
+        }
+    };
+
+    std::vector<std::thread> helpers;
+
+    for (unsigned i = 1; i < workers; ++i)
+    {
+        helpers.emplace_back(work, i);
+    }
+
+    work(0);
+
+    for (std::thread & helper : helpers)
+    {
+        helper.join();
+    }
+}
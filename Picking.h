@@ -0,0 +1,281 @@
+#pragma once
+
+#include "Animation.h"
+#include "Layout.h"
+#include "Matrix.h"
+#include <cmath>
+
+//
+// Projects the corners of a batch of cards, each turned to its own angle,
+// through the same pre, rotation and post transforms the compositor applies.
+// The pre and post transforms depend only on the card size so they are built
+// once for the whole batch. Corners are stored in order around the card,
+// relative to its offset. Either face gives the same quad so the back's
+// transforms are used whichever face is showing.
+//
+
+inline void ProjectCardCorners(float const width,
+                               float const height,
+                               unsigned const count,
+                               float const * const angles,
+                               float (* const cornerX)[4],
+                               float (* const cornerY)[4])
+{
+    Matrix4x4 const pre = CardPreTransform(width, height, false);
+    Matrix4x4 const post = CardPostTransform(width, height);
+
+    #if SIMD_SSE2
+
+    __m128 const u = _mm_setr_ps(0.0f, width, width, 0.0f);
+    __m128 const v = _mm_setr_ps(0.0f, 0.0f, height, height);
+
+    #else
+
+    float const u[4] = { 0.0f, width, width, 0.0f };
+    float const v[4] = { 0.0f, 0.0f, height, height };
+
+    #endif
+
+    for (unsigned card = 0; card != count; ++card)
+    {
+        Matrix4x4 const m = pre * Matrix4x4::RotationY(angles[card]) * post;
+
+        #if SIMD_SSE2
+
+        // The four corners are projected together
+
+        __m128 const w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, _mm_set1_ps(m.M[0][3])),
+                                               _mm_mul_ps(v, _mm_set1_ps(m.M[1][3]))),
+                                    _mm_set1_ps(m.M[3][3]));
+
+        _mm_storeu_ps(cornerX[card],
+                      _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(u, _mm_set1_ps(m.M[0][0])),
+                                                       _mm_mul_ps(v, _mm_set1_ps(m.M[1][0]))),
+                                            _mm_set1_ps(m.M[3][0])),
+                                 w));
+
+        _mm_storeu_ps(cornerY[card],
+                      _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(u, _mm_set1_ps(m.M[0][1])),
+                                                       _mm_mul_ps(v, _mm_set1_ps(m.M[1][1]))),
+                                            _mm_set1_ps(m.M[3][1])),
+                                 w));
+
+        #else
+
+        for (unsigned i = 0; i != 4; ++i)
+        {
+            float const w = u[i] * m.M[0][3] + v[i] * m.M[1][3] + m.M[3][3];
+
+            cornerX[card][i] = (u[i] * m.M[0][0] + v[i] * m.M[1][0] + m.M[3][0]) / w;
+            cornerY[card][i] = (u[i] * m.M[0][1] + v[i] * m.M[1][1] + m.M[3][1]) / w;
+        }
+
+        #endif
+    }
+}
+
+//
+// Whether a point lands inside a projected quad, tested against every edge.
+//
+
+inline bool QuadContains(float const (& cornerX)[4],
+                         float const (& cornerY)[4],
+                         float const x,
+                         float const y)
+{
+    #if SIMD_SSE2
+
+    __m128 const currentX = _mm_loadu_ps(cornerX);
+    __m128 const currentY = _mm_loadu_ps(cornerY);
+    __m128 const nextX = _mm_shuffle_ps(currentX, currentX, _MM_SHUFFLE(0, 3, 2, 1));
+    __m128 const nextY = _mm_shuffle_ps(currentY, currentY, _MM_SHUFFLE(0, 3, 2, 1));
+
+    __m128 const cross = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(nextX, currentX), _mm_sub_ps(_mm_set1_ps(y), currentY)),
+                                    _mm_mul_ps(_mm_sub_ps(nextY, currentY), _mm_sub_ps(_mm_set1_ps(x), currentX)));
+
+    // The quad winds one way or the other depending on the face showing
+    int const inside = _mm_movemask_ps(_mm_cmpgt_ps(cross, _mm_setzero_ps()));
+    int const outside = _mm_movemask_ps(_mm_cmplt_ps(cross, _mm_setzero_ps()));
+
+    return 15 == inside || 15 == outside;
+
+    #else
+
+    unsigned inside = 0;
+    unsigned outside = 0;
+
+    for (unsigned i = 0; i != 4; ++i)
+    {
+        unsigned const next = (i + 1) % 4;
+
+        float const cross = (cornerX[next] - cornerX[i]) * (y - cornerY[i]) -
+                            (cornerY[next] - cornerY[i]) * (x - cornerX[i]);
+
+        inside += cross > 0.0f;
+        outside += cross < 0.0f;
+    }
+
+    return 4 == inside || 4 == outside;
+
+    #endif
+}
+
+//
+// Whether a point, relative to a card's offset, lands on the card turned to
+// the given angle.
+//
+
+inline bool CardContains(float const width,
+                         float const height,
+                         float const angle,
+                         float const x,
+                         float const y)
+{
+    float cornerX[1][4];
+    float cornerY[1][4];
+    ProjectCardCorners(width, height, 1, &angle, cornerX, cornerY);
+
+    return QuadContains(cornerX[0], cornerY[0], x, y);
+}
+
+//
+// Finds the card under a point while cards may be mid flip. A card at rest
+// face on fills its slot exactly so the grid answers for it directly, and
+// only cards in flight are projected. A card in flight leans out of its slot
+// by at most a sixth of its size, since the perspective never brings an edge
+// more than a quarter closer, so only the slot under the point and its
+// neighbours need to be considered however large the board. Cards later in
+// the board are drawn on top so the last card found under the point wins.
+// Only the animations' Tracks are used.
+//
+
+struct CardPicker
+{
+    template <typename Animations>
+    unsigned CardAt(CardGrid const & grid,
+                    Animations & animations,
+                    double const time,
+                    float const x,
+                    float const y) const
+    {
+        unsigned found = grid.CardAt(x, y);
+
+        if (NoCard != found)
+        {
+            AnimationTrack const & track = animations.Tracks[found];
+
+            if (InFlight(track, time))
+            {
+                found = NoCard;
+            }
+            else if (0.0f != track.Final && 180.0f != track.Final &&
+                     !Contains(grid, found, track.Final, x, y))
+            {
+                // Resting at any other angle, such as edge on once matched
+                found = NoCard;
+            }
+        }
+
+        float const reachX = grid.Width / 6.0f;
+        float const reachY = grid.Height / 6.0f;
+
+        if (NoCard != found)
+        {
+            // Away from its edges no neighbour can reach over the card
+
+            float const insetX = reachX - (grid.PitchX - grid.Width);
+            float const insetY = reachY - (grid.PitchY - grid.Height);
+            float const left = grid.OffsetX[found % grid.Columns];
+            float const top = grid.OffsetY[found / grid.Columns];
+
+            if (x > left + insetX && x < left + grid.Width - insetX &&
+                y > top + insetY && y < top + grid.Height - insetY)
+            {
+                return found;
+            }
+        }
+
+        int const row = static_cast<int>(std::floor((y - grid.OriginY) / grid.PitchY));
+        int const column = static_cast<int>(std::floor((x - grid.OriginX) / grid.PitchX));
+
+        // Neighbours in flight within reach of the point are gathered from
+        // the top of the drawing order down, stopping below the card already
+        // found, and then projected together in one pass
+
+        unsigned cards[9];
+        float angles[9];
+        unsigned count = 0;
+
+        for (int r = row + 1; r >= row - 1; --r)
+        {
+            if (r < 0 || r >= static_cast<int>(grid.Rows)) continue;
+
+            float const top = grid.OffsetY[r];
+
+            if (y < top - reachY || y > top + grid.Height + reachY) continue;
+
+            for (int c = column + 1; c >= column - 1; --c)
+            {
+                if (c < 0 || c >= static_cast<int>(grid.Columns)) continue;
+
+                float const left = grid.OffsetX[c];
+
+                if (x < left - reachX || x > left + grid.Width + reachX) continue;
+
+                unsigned const card = r * grid.Columns + c;
+
+                if (NoCard != found && card < found) continue;
+
+                AnimationTrack & track = animations.Tracks[card];
+
+                if (InFlight(track, time))
+                {
+                    cards[count] = card;
+                    angles[count] = track.Evaluate(time);
+                    ++count;
+                }
+            }
+        }
+
+        if (0 == count)
+        {
+            return found;
+        }
+
+        float cornerX[9][4];
+        float cornerY[9][4];
+        ProjectCardCorners(grid.Width, grid.Height, count, angles, cornerX, cornerY);
+
+        for (unsigned i = 0; i != count; ++i)
+        {
+            if (QuadContains(cornerX[i],
+                             cornerY[i],
+                             x - grid.OffsetX[cards[i] % grid.Columns],
+                             y - grid.OffsetY[cards[i] / grid.Columns]))
+            {
+                return cards[i];
+            }
+        }
+
+        return found;
+    }
+
+    static bool InFlight(AnimationTrack const & track,
+                         double const time)
+    {
+        return 0 != track.Count && time < track.End;
+    }
+
+    static bool Contains(CardGrid const & grid,
+                         unsigned const card,
+                         float const angle,
+                         float const x,
+                         float const y)
+    {
+        return CardContains(grid.Width,
+                            grid.Height,
+                            angle,
+                            x - grid.OffsetX[card % grid.Columns],
+                            y - grid.OffsetY[card / grid.Columns]);
+    }
+};
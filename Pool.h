@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+//
+// Keeps objects for reuse rather than creating new ones for every use. The
+// objects handed out since the last Recycle remain in use; Recycle makes them
+// all available again, so a pool suits work that needs the same number of
+// objects each time, such as one kind of click.
+//
+
+template <typename Object>
+struct ObjectPool
+{
+    std::vector<Object> Objects;
+    unsigned Used = 0;
+    unsigned Created = 0;
+    unsigned Reused = 0;
+
+    // Create is called to make a new object when none is free
+    template <typename Create>
+    Object & Acquire(Create && create)
+    {
+        if (Used == Objects.size())
+        {
+            Objects.push_back(create());
+            ++Created;
+        }
+        else
+        {
+            ++Reused;
+        }
+
+        return Objects[Used++];
+    }
+
+    void Recycle()
+    {
+        Used = 0;
+    }
+
+    void Clear()
+    {
+        Objects.clear();
+        Used = 0;
+    }
+};
+
+//
+// Hands out memory from a single block reserved up front, for objects that
+// live and die together such as the state of one game. There is one heap
+// allocation however many arrays are made, they sit side by side, and all
+// of them are released at once with the arena. Only objects that need no
+// destructor may be made in an arena.
+//
+
+struct Arena
+{
+    std::unique_ptr<unsigned char[]> Block;
+    size_t Capacity = 0;
+    size_t Used = 0;
+
+    Arena() = default;
+
+    explicit Arena(size_t const capacity) :
+        Block(new unsigned char[capacity]),
+        Capacity(capacity)
+    {}
+
+    // The most an array may take including any padding to align it, for
+    // adding up the capacity an arena needs
+    template <typename Object>
+    static size_t Footprint(size_t const count)
+    {
+        return count * sizeof(Object) + alignof(Object) - 1;
+    }
+
+    // Returns count value initialized objects, or nullptr if they do not fit
+    template <typename Object>
+    Object * Allocate(size_t const count)
+    {
+        static_assert(std::is_trivially_destructible<Object>::value, "Arena objects are never destroyed");
+
+        size_t const address = reinterpret_cast<size_t>(Block.get()) + Used;
+        size_t const padding = (alignof(Object) - address % alignof(Object)) % alignof(Object);
+
+        if (Capacity - Used < padding + count * sizeof(Object)) return nullptr;
+
+        Object * const objects = reinterpret_cast<Object *>(Block.get() + Used + padding);
+        Used += padding + count * sizeof(Object);
+
+        for (size_t i = 0; i != count; ++i)
+        {
+            new (objects + i) Object();
+        }
+
+        return objects;
+    }
+
+    void Reset()
+    {
+        Used = 0;
+    }
+};
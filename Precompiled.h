@@ -10,10 +10,10 @@
 #include <d2d1_2helper.h>
 #include <dcomp.h>
 #include <array>
+#include <future>
 #include <random>
 #include <dwrite_2.h>
 #include <wincodec.h>
-#include <UIAnimation.h>
 
 #include "Debug.h"
 
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+//
+// A small, fast generator from the PCG family (pcg32, XSH RR output) with 16
+// bytes of state. The same seed gives the same sequence with any compiler or
+// standard library, which std::mt19937 paired with the standard
+// distributions does not promise, so boards and replays are reproducible
+// from a seed alone. It meets the requirements of a uniform random bit
+// generator and can be evaluated at compile time.
+//
+
+struct Pcg32
+{
+    typedef uint32_t result_type;
+
+    uint64_t State = 0;
+    uint64_t Increment = 0;
+
+    explicit constexpr Pcg32(uint64_t const seed,
+                             uint64_t const stream = 0x0A02BDBF7BB3C0A7ull) :
+        Increment(stream << 1 | 1)
+    {
+        Next();
+        State += seed;
+        Next();
+    }
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return 0xFFFFFFFF;
+    }
+
+    constexpr result_type operator()()
+    {
+        return Next();
+    }
+
+    constexpr uint32_t Next()
+    {
+        uint64_t const previous = State;
+        State = previous * 6364136223846793005ull + Increment;
+
+        uint32_t const shifted = static_cast<uint32_t>(((previous >> 18) ^ previous) >> 27);
+        uint32_t const rotation = static_cast<uint32_t>(previous >> 59);
+
+        return shifted >> rotation | shifted << ((0u - rotation) & 31);
+    }
+};
+
+//
+// Returns a uniformly distributed integer below the bound from any generator
+// producing 32 random bits. The bound is scaled by multiplication rather
+// than division and only the rare biased results are redrawn, so it usually
+// costs one multiply. Unlike std::uniform_int_distribution the result is the
+// same everywhere.
+//
+
+template <typename Generator>
+uint32_t RandomBelow(Generator & generator,
+                     uint32_t const bound)
+{
+    static_assert(Generator::min() == 0 && Generator::max() == 0xFFFFFFFF, "A 32 bit generator is required");
+
+    uint64_t product = static_cast<uint64_t>(static_cast<uint32_t>(generator())) * bound;
+    uint32_t low = static_cast<uint32_t>(product);
+
+    if (low < bound)
+    {
+        uint32_t const threshold = (0u - bound) % bound;
+
+        while (low < threshold)
+        {
+            product = static_cast<uint64_t>(static_cast<uint32_t>(generator())) * bound;
+            low = static_cast<uint32_t>(product);
+        }
+    }
+
+    return static_cast<uint32_t>(product >> 32);
+}
+
+// Fisher-Yates shuffle using RandomBelow, so the order depends only on the
+// generator's sequence.
+template <typename Iterator, typename Generator>
+void RandomShuffle(Iterator const first,
+                   Iterator const last,
+                   Generator & generator)
+{
+    for (uint32_t count = static_cast<uint32_t>(last - first); count > 1; --count)
+    {
+        uint32_t const other = RandomBelow(generator, count);
+
+        using std::swap;
+        swap(first[count - 1], first[other]);
+    }
+}
@@ -0,0 +1,253 @@
+#pragma once
+
+#include "Simd.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//
+// A CPU rendering backend for the card faces and backs, whose scaling lives
+// in Resample.h. Bitmaps hold premultiplied BGRA8 pixels, the same format as
+// the composition surfaces, so they can be uploaded as is or compared pixel
+// for pixel.
+//
+
+uint32_t const OpaqueWhite = 0xFFFFFFFF;
+
+struct Bitmap
+{
+    unsigned Width = 0;
+    unsigned Height = 0;
+    std::vector<uint32_t> Pixels;
+
+    Bitmap() = default;
+
+    Bitmap(unsigned const width,
+           unsigned const height) :
+        Width(width),
+        Height(height),
+        Pixels(width * height)
+    {}
+
+    uint32_t * Row(unsigned const y)
+    {
+        return Pixels.data() + y * Width;
+    }
+
+    uint32_t const * Row(unsigned const y) const
+    {
+        return Pixels.data() + y * Width;
+    }
+};
+
+// Pixels owned elsewhere, such as a bitmap or a mapped file
+struct BitmapView
+{
+    unsigned Width = 0;
+    unsigned Height = 0;
+    uint32_t const * Pixels = nullptr;
+
+    BitmapView() = default;
+
+    BitmapView(unsigned const width,
+               unsigned const height,
+               uint32_t const * pixels) :
+        Width(width),
+        Height(height),
+        Pixels(pixels)
+    {}
+
+    BitmapView(Bitmap const & bitmap) :
+        Width(bitmap.Width),
+        Height(bitmap.Height),
+        Pixels(bitmap.Pixels.data())
+    {}
+
+    uint32_t const * Row(unsigned const y) const
+    {
+        return Pixels + y * Width;
+    }
+};
+
+// Glyph coverage with one byte per pixel
+struct AlphaMask
+{
+    unsigned Width = 0;
+    unsigned Height = 0;
+    std::vector<uint8_t> Coverage;
+
+    AlphaMask() = default;
+
+    AlphaMask(unsigned const width,
+              unsigned const height) :
+        Width(width),
+        Height(height),
+        Coverage(width * height)
+    {}
+
+    uint8_t const * Row(unsigned const y) const
+    {
+        return Coverage.data() + y * Width;
+    }
+};
+
+inline void FillPixels(uint32_t * target,
+                       unsigned count,
+                       uint32_t const color)
+{
+    #if SIMD_SSE2
+
+    __m128i const value = _mm_set1_epi32(static_cast<int>(color));
+
+    for (; count >= 4; count -= 4, target += 4)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(target), value);
+    }
+
+    #endif
+
+    for (; count; --count)
+    {
+        *target++ = color;
+    }
+}
+
+// Copies BGRX pixels and makes them opaque
+inline void CopyOpaque(uint32_t * target,
+                       uint32_t const * source,
+                       unsigned count)
+{
+    #if SIMD_SSE2
+
+    __m128i const alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+    for (; count >= 4; count -= 4, target += 4, source += 4)
+    {
+        __m128i const pixels = _mm_loadu_si128(reinterpret_cast<__m128i const *>(source));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(target), _mm_or_si128(pixels, alpha));
+    }
+
+    #endif
+
+    for (; count; --count)
+    {
+        *target++ = *source++ | 0xFF000000;
+    }
+}
+
+// Composites opaque black through the coverage over premultiplied pixels
+inline void DarkenPixels(uint32_t * target,
+                         uint8_t const * coverage,
+                         unsigned count)
+{
+    #if SIMD_SSE2
+
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const ones = _mm_set1_epi8(-1);
+    __m128i const alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    __m128i const half = _mm_set1_epi16(128);
+
+    for (; count >= 4; count -= 4, target += 4, coverage += 4)
+    {
+        int bytes = 0;
+        memcpy(&bytes, coverage, sizeof(bytes));
+
+        __m128i cover = _mm_cvtsi32_si128(bytes);
+        cover = _mm_unpacklo_epi8(cover, cover);
+        cover = _mm_unpacklo_epi16(cover, cover);
+
+        __m128i const inverse = _mm_xor_si128(cover, ones);
+        __m128i const pixels = _mm_loadu_si128(reinterpret_cast<__m128i const *>(target));
+
+        __m128i low = _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), _mm_unpacklo_epi8(inverse, zero));
+        __m128i high = _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), _mm_unpackhi_epi8(inverse, zero));
+
+        // Exact division by 255 with rounding
+        low = _mm_add_epi16(low, half);
+        high = _mm_add_epi16(high, half);
+        low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+        high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+
+        __m128i const result = _mm_packus_epi16(low, high);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(target),
+                         _mm_adds_epu8(result, _mm_and_si128(cover, alpha)));
+    }
+
+    #endif
+
+    for (; count; --count, ++target, ++coverage)
+    {
+        uint32_t const inverse = 255 - *coverage;
+        uint32_t const pixel = *target;
+        uint32_t result = 0;
+
+        for (unsigned shift = 0; shift != 32; shift += 8)
+        {
+            uint32_t value = ((pixel >> shift) & 0xFF) * inverse + 128;
+            value = (value + (value >> 8)) >> 8;
+            result |= value << shift;
+        }
+
+        uint32_t const a = std::min(255u, (result >> 24) + *coverage);
+        *target = (result & 0x00FFFFFF) | (a << 24);
+    }
+}
+
+inline void Clear(Bitmap & target,
+                  uint32_t const color)
+{
+    FillPixels(target.Pixels.data(),
+               static_cast<unsigned>(target.Pixels.size()),
+               color);
+}
+
+// Draws part of the mask with its top left corner at x and y
+inline void DrawMask(Bitmap & target,
+                     AlphaMask const & mask,
+                     unsigned const maskX,
+                     unsigned const maskY,
+                     unsigned const width,
+                     unsigned const height,
+                     int const x,
+                     int const y)
+{
+    int const left = std::max(0, x);
+    int const top = std::max(0, y);
+    int const right = std::min(static_cast<int>(target.Width), x + static_cast<int>(width));
+    int const bottom = std::min(static_cast<int>(target.Height), y + static_cast<int>(height));
+
+    for (int row = top; row < bottom; ++row)
+    {
+        DarkenPixels(target.Row(row) + left,
+                     mask.Row(maskY + row - y) + maskX + (left - x),
+                     right - left);
+    }
+}
+
+inline void DrawMask(Bitmap & target,
+                     AlphaMask const & mask,
+                     int const x,
+                     int const y)
+{
+    DrawMask(target,
+             mask,
+             0,
+             0,
+             mask.Width,
+             mask.Height,
+             x,
+             y);
+}
+
+inline void RenderCardFront(Bitmap & target,
+                            AlphaMask const & glyph)
+{
+    Clear(target, OpaqueWhite);
+
+    DrawMask(target,
+             glyph,
+             (static_cast<int>(target.Width) - static_cast<int>(glyph.Width)) / 2,
+             (static_cast<int>(target.Height) - static_cast<int>(glyph.Height)) / 2);
+}
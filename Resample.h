@@ -0,0 +1,528 @@
+#pragma once
+
+#include "Parallel.h"
+#include "Raster.h"
+#include <cmath>
+
+//
+// Scales the background for the card backs. A separable resampler applies a
+// box, bilinear or Lanczos filter through precomputed fixed point weights,
+// and a mip pyramid of the source keeps large reductions to a ratio below
+// two so that no filter has to cover more than a few taps. Scaled images are
+// cached by DPI so that returning to a monitor reuses the earlier work.
+//
+
+enum class ResampleFilter
+{
+    Box,
+    Bilinear,
+    Lanczos,
+};
+
+int const ResampleShift = 14;
+
+inline float ResampleRadius(ResampleFilter const filter)
+{
+    switch (filter)
+    {
+    case ResampleFilter::Box: return 0.5f;
+    case ResampleFilter::Bilinear: return 1.0f;
+    default: return 3.0f;
+    }
+}
+
+inline float ResampleKernel(ResampleFilter const filter,
+                            float const x)
+{
+    float const distance = std::fabs(x);
+
+    if (ResampleFilter::Box == filter)
+    {
+        return x >= -0.5f && x < 0.5f ? 1.0f : 0.0f;
+    }
+
+    if (ResampleFilter::Bilinear == filter)
+    {
+        return std::max(0.0f, 1.0f - distance);
+    }
+
+    if (distance >= 3.0f) return 0.0f;
+    if (distance < 1e-5f) return 1.0f;
+
+    float const pi = 3.14159265f * x;
+    return 3.0f * std::sin(pi) * std::sin(pi / 3.0f) / (pi * pi);
+}
+
+// The source pixels and weights contributing to each target pixel along one
+// axis. Every target pixel has the same even number of taps so the kernels
+// can consume them in pairs; unused taps have a weight of zero.
+struct ResampleWeights
+{
+    unsigned Taps = 0;
+    std::vector<unsigned> Index;
+    std::vector<int16_t> Weight;
+
+    ResampleWeights(unsigned const targetCount,
+                    unsigned const sourceCount,
+                    float const offset,
+                    float const scale,
+                    ResampleFilter const filter)
+    {
+        // Reductions widen the kernel so that every source pixel contributes
+        float const stretch = std::max(scale, 1.0f);
+        float const radius = ResampleRadius(filter) * stretch;
+
+        Taps = static_cast<unsigned>(std::ceil(radius * 2.0f)) + 1;
+        Taps += Taps % 2;
+        Index.resize(targetCount * Taps);
+        Weight.resize(targetCount * Taps);
+
+        std::vector<float> weights(Taps);
+
+        for (unsigned i = 0; i != targetCount; ++i)
+        {
+            float const center = offset + (i + 0.5f) * scale - 0.5f;
+            int const first = static_cast<int>(std::ceil(center - radius));
+            float total = 0.0f;
+
+            for (unsigned t = 0; t != Taps; ++t)
+            {
+                weights[t] = ResampleKernel(filter, (first + static_cast<int>(t) - center) / stretch);
+                total += weights[t];
+            }
+
+            if (0.0f == total)
+            {
+                weights.assign(Taps, 0.0f);
+                weights[std::min(Taps - 1, static_cast<unsigned>(std::max(0.0f, center - first + 0.5f)))] = 1.0f;
+                total = 1.0f;
+            }
+
+            unsigned * index = &Index[i * Taps];
+            int16_t * weight = &Weight[i * Taps];
+            int sum = 0;
+            unsigned largest = 0;
+
+            for (unsigned t = 0; t != Taps; ++t)
+            {
+                index[t] = static_cast<unsigned>(std::min(std::max(first + static_cast<int>(t), 0),
+                                                          static_cast<int>(sourceCount) - 1));
+
+                weight[t] = static_cast<int16_t>(std::lround(weights[t] / total * (1 << ResampleShift)));
+                sum += weight[t];
+
+                if (weights[t] > weights[largest]) largest = t;
+            }
+
+            // Rounding error goes to the largest weight so they sum to one
+            weight[largest] = static_cast<int16_t>(weight[largest] + (1 << ResampleShift) - sum);
+        }
+    }
+};
+
+inline uint32_t ResamplePixel(int const (&sum)[4])
+{
+    uint32_t result = 0xFF000000;
+
+    for (unsigned channel = 0; channel != 3; ++channel)
+    {
+        int const value = (sum[channel] + (1 << (ResampleShift - 1))) >> ResampleShift;
+        result |= static_cast<uint32_t>(std::min(255, std::max(0, value))) << (channel * 8);
+    }
+
+    return result;
+}
+
+// Filters one row horizontally
+inline void ResampleRow(uint32_t * target,
+                        uint32_t const * source,
+                        ResampleWeights const & weights,
+                        unsigned const count)
+{
+    unsigned const taps = weights.Taps;
+
+    for (unsigned i = 0; i != count; ++i)
+    {
+        unsigned const * index = &weights.Index[i * taps];
+        int16_t const * weight = &weights.Weight[i * taps];
+
+        #if SIMD_SSE2
+
+        // Interleaving two pixels channel by channel lets one multiply-add
+        // apply a pair of taps to all four channels.
+
+        __m128i const zero = _mm_setzero_si128();
+        __m128i sum = zero;
+
+        for (unsigned t = 0; t != taps; t += 2)
+        {
+            __m128i const pair = _mm_unpacklo_epi8(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(source[index[t]])),
+                                                                     _mm_cvtsi32_si128(static_cast<int>(source[index[t + 1]]))),
+                                                   zero);
+
+            __m128i const factors = _mm_set1_epi32(static_cast<uint16_t>(weight[t]) | weight[t + 1] * 65536);
+
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pair, factors));
+        }
+
+        sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (ResampleShift - 1))), ResampleShift);
+        sum = _mm_packs_epi32(sum, sum);
+        target[i] = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum))) | 0xFF000000;
+
+        #else
+
+        int sum[4] = {};
+
+        for (unsigned t = 0; t != taps; ++t)
+        {
+            for (unsigned channel = 0; channel != 3; ++channel)
+            {
+                sum[channel] += static_cast<int>(source[index[t]] >> (channel * 8) & 0xFF) * weight[t];
+            }
+        }
+
+        target[i] = ResamplePixel(sum);
+
+        #endif
+    }
+}
+
+// Filters one row vertically from the rows selected by the weights
+inline void ResampleColumns(uint32_t * target,
+                            uint32_t const * const * rows,
+                            int16_t const * weight,
+                            unsigned const taps,
+                            unsigned const count)
+{
+    unsigned x = 0;
+
+    #if SIMD_SSE2
+
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const round = _mm_set1_epi32(1 << (ResampleShift - 1));
+    __m128i const alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128i sums[4] = { zero, zero, zero, zero };
+
+        for (unsigned t = 0; t != taps; t += 2)
+        {
+            __m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(rows[t] + x));
+            __m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(rows[t + 1] + x));
+            __m128i const factors = _mm_set1_epi32(static_cast<uint16_t>(weight[t]) | weight[t + 1] * 65536);
+            __m128i const low = _mm_unpacklo_epi8(a, b);
+            __m128i const high = _mm_unpackhi_epi8(a, b);
+
+            sums[0] = _mm_add_epi32(sums[0], _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), factors));
+            sums[1] = _mm_add_epi32(sums[1], _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), factors));
+            sums[2] = _mm_add_epi32(sums[2], _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), factors));
+            sums[3] = _mm_add_epi32(sums[3], _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), factors));
+        }
+
+        for (__m128i & sum : sums)
+        {
+            sum = _mm_srai_epi32(_mm_add_epi32(sum, round), ResampleShift);
+        }
+
+        __m128i const pixels = _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]),
+                                                _mm_packs_epi32(sums[2], sums[3]));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(target + x), _mm_or_si128(pixels, alpha));
+    }
+
+    #endif
+
+    for (; x != count; ++x)
+    {
+        int sum[4] = {};
+
+        for (unsigned t = 0; t != taps; ++t)
+        {
+            for (unsigned channel = 0; channel != 3; ++channel)
+            {
+                sum[channel] += static_cast<int>(rows[t][x] >> (channel * 8) & 0xFF) * weight[t];
+            }
+        }
+
+        target[x] = ResamplePixel(sum);
+    }
+}
+
+//
+// Fills the target from the source starting at the given source position,
+// where the scale is the number of source pixels per target pixel. The
+// rows are filtered horizontally first and then combined vertically.
+//
+
+inline void Resample(Bitmap & target,
+                     BitmapView const & source,
+                     float const sourceX,
+                     float const sourceY,
+                     float const scaleX,
+                     float const scaleY,
+                     ResampleFilter const filter,
+                     unsigned const threads = HardwareThreads())
+{
+    ResampleWeights const columns(target.Width, source.Width, sourceX, scaleX, filter);
+    ResampleWeights const rows(target.Height, source.Height, sourceY, scaleY, filter);
+
+    unsigned const first = *std::min_element(rows.Index.begin(), rows.Index.end());
+    unsigned const last = *std::max_element(rows.Index.begin(), rows.Index.end());
+
+    Bitmap filtered(target.Width, last - first + 1);
+    unsigned const band = 16;
+
+    ParallelFor((filtered.Height + band - 1) / band, threads, [&](unsigned const index)
+    {
+        for (unsigned y = index * band; y != std::min(filtered.Height, (index + 1) * band); ++y)
+        {
+            ResampleRow(filtered.Row(y), source.Row(first + y), columns, target.Width);
+        }
+    });
+
+    ParallelFor((target.Height + band - 1) / band, threads, [&](unsigned const index)
+    {
+        std::vector<uint32_t const *> sources(rows.Taps);
+
+        for (unsigned y = index * band; y != std::min(target.Height, (index + 1) * band); ++y)
+        {
+            for (unsigned t = 0; t != rows.Taps; ++t)
+            {
+                sources[t] = filtered.Row(rows.Index[y * rows.Taps + t] - first);
+            }
+
+            ResampleColumns(target.Row(y),
+                            sources.data(),
+                            &rows.Weight[y * rows.Taps],
+                            rows.Taps,
+                            target.Width);
+        }
+    });
+}
+
+//
+// Crops a card back out of the BGRX image. The source position is in image
+// pixels and the scale is the number of image pixels per target pixel. A
+// back at one image pixel per target pixel is copied, and any other is
+// filtered bilinearly through the resampler on the calling thread. Large
+// reductions should go through a ResampleCache, whose pyramid keeps the
+// filter short.
+//
+
+inline void RenderCardBack(Bitmap & target,
+                           BitmapView const & image,
+                           float const sourceX,
+                           float const sourceY,
+                           float const scaleX,
+                           float const scaleY)
+{
+    int const left = static_cast<int>(sourceX);
+    int const top = static_cast<int>(sourceY);
+
+    if (scaleX == 1.0f && scaleY == 1.0f &&
+        left == sourceX && top == sourceY &&
+        left >= 0 && top >= 0 &&
+        left + target.Width <= image.Width &&
+        top + target.Height <= image.Height)
+    {
+        for (unsigned row = 0; row != target.Height; ++row)
+        {
+            CopyOpaque(target.Row(row),
+                       image.Row(top + row) + left,
+                       target.Width);
+        }
+
+        return;
+    }
+
+    Resample(target,
+             image,
+             sourceX,
+             sourceY,
+             scaleX,
+             scaleY,
+             ResampleFilter::Bilinear,
+             1);
+}
+
+// Halves the image with a 2x2 box filter, repeating the last row and column
+// of an odd sized image.
+inline Bitmap Downsample(BitmapView const & source)
+{
+    Bitmap target((source.Width + 1) / 2, (source.Height + 1) / 2);
+
+    for (unsigned y = 0; y != target.Height; ++y)
+    {
+        uint32_t const * a = source.Row(y * 2);
+        uint32_t const * b = source.Row(std::min(y * 2 + 1, source.Height - 1));
+        uint32_t * pixels = target.Row(y);
+        unsigned x = 0;
+
+        #if SIMD_SSE2
+
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const two = _mm_set1_epi16(2);
+
+        for (; x * 2 + 4 <= source.Width; x += 2)
+        {
+            __m128i const top = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + x * 2));
+            __m128i const bottom = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + x * 2));
+            __m128i const low = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+            __m128i const high = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+
+            __m128i const sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high),
+                                              _mm_unpackhi_epi64(low, high));
+
+            __m128i const average = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(pixels + x), _mm_packus_epi16(average, average));
+        }
+
+        #endif
+
+        for (; x != target.Width; ++x)
+        {
+            unsigned const left = x * 2;
+            unsigned const right = std::min(left + 1, source.Width - 1);
+            uint32_t result = 0;
+
+            for (unsigned shift = 0; shift != 32; shift += 8)
+            {
+                uint32_t const sum = (a[left] >> shift & 0xFF) + (a[right] >> shift & 0xFF) +
+                                     (b[left] >> shift & 0xFF) + (b[right] >> shift & 0xFF);
+
+                result |= (sum + 2) / 4 << shift;
+            }
+
+            pixels[x] = result;
+        }
+    }
+
+    return target;
+}
+
+// Levels are built on demand since only large reductions need them
+struct MipPyramid
+{
+    BitmapView Base;
+    std::vector<Bitmap> Levels;
+
+    void Reset(BitmapView const & image)
+    {
+        Base = image;
+        Levels.clear();
+    }
+
+    unsigned Select(float scaleX,
+                    float scaleY) const
+    {
+        unsigned level = 0;
+        unsigned width = Base.Width;
+        unsigned height = Base.Height;
+
+        while (scaleX >= 2.0f && scaleY >= 2.0f && width > 1 && height > 1)
+        {
+            scaleX /= 2.0f;
+            scaleY /= 2.0f;
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+            ++level;
+        }
+
+        return level;
+    }
+
+    BitmapView Level(unsigned const level)
+    {
+        while (Levels.size() < level)
+        {
+            Levels.push_back(Downsample(Levels.empty() ? Base : BitmapView(Levels.back())));
+        }
+
+        return level ? BitmapView(Levels[level - 1]) : Base;
+    }
+};
+
+//
+// Holds the background scaled to each DPI it has been shown at. The image is
+// drawn one image pixel per DIP, so the scale at a given DPI is 96 / DPI.
+//
+
+struct ResampleCache
+{
+    struct Entry
+    {
+        float DpiX = 0.0f;
+        float DpiY = 0.0f;
+        Bitmap Pixels;
+    };
+
+    MipPyramid Pyramid;
+    ResampleFilter Filter = ResampleFilter::Lanczos;
+    unsigned Capacity = 4;
+    unsigned Hits = 0;
+    unsigned Misses = 0;
+
+    // Least recently used first
+    std::vector<Entry> Entries;
+
+    void Reset(BitmapView const & image)
+    {
+        Pyramid.Reset(image);
+        Entries.clear();
+    }
+
+    // Returns the top left of the scaled image at the given size
+    Bitmap const & Find(float const dpiX,
+                        float const dpiY,
+                        unsigned const width,
+                        unsigned const height)
+    {
+        for (unsigned i = 0; i != Entries.size(); ++i)
+        {
+            Entry & entry = Entries[i];
+
+            if (entry.DpiX == dpiX &&
+                entry.DpiY == dpiY &&
+                entry.Pixels.Width == width &&
+                entry.Pixels.Height == height)
+            {
+                ++Hits;
+                std::rotate(Entries.begin() + i, Entries.begin() + i + 1, Entries.end());
+                return Entries.back().Pixels;
+            }
+        }
+
+        ++Misses;
+
+        if (Entries.size() == Capacity)
+        {
+            Entries.erase(Entries.begin());
+        }
+
+        float scaleX = 96.0f / dpiX;
+        float scaleY = 96.0f / dpiY;
+        unsigned const level = Pyramid.Select(scaleX, scaleY);
+        BitmapView const source = Pyramid.Level(level);
+
+        scaleX = scaleX * source.Width / Pyramid.Base.Width;
+        scaleY = scaleY * source.Height / Pyramid.Base.Height;
+
+        Entries.emplace_back();
+        Entry & entry = Entries.back();
+        entry.DpiX = dpiX;
+        entry.DpiY = dpiY;
+        entry.Pixels = Bitmap(width, height);
+
+        Resample(entry.Pixels,
+                 source,
+                 0.0f,
+                 0.0f,
+                 scaleX,
+                 scaleY,
+                 Filter);
+
+        return entry.Pixels;
+    }
+};
@@ -0,0 +1,353 @@
+#pragma once
+
+#include "Board.h"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+//
+// Tracks how current each card's device resources are so that only what was
+// actually invalidated is recreated or redrawn. A card's resources are valid
+// while its recorded generations match the current ones:
+//
+//   Device  - bumped when the device is lost; every resource is recreated
+//   Layout  - bumped when the DPI changes; surfaces are resized and redrawn
+//   Content - bumped per card when its face changes; the card is redrawn
+//
+// A hidden card's face is not drawn until it is about to be shown, so its
+// content may be left out of date while its device and layout are current.
+// Content generations start at one and a card whose face is owed is marked
+// with zero, which never matches. Likewise a card that is given visuals it
+// has not had before, as when it is scrolled into view, is marked with a
+// device generation of zero and so has everything made for it.
+//
+
+unsigned const DirtyDevice = 1;
+unsigned const DirtyLayout = 2;
+unsigned const DirtyContent = 4;
+
+struct ResourceGenerations
+{
+    unsigned Device = 1;
+    unsigned Layout = 1;
+    std::vector<unsigned> Content;
+    std::vector<unsigned> CardDevice;
+    std::vector<unsigned> CardLayout;
+    std::vector<unsigned> CardContent;
+
+    // Resources shared by all cards such as the atlases
+    unsigned SharedDevice = 0;
+    unsigned SharedLayout = 0;
+
+    explicit ResourceGenerations(unsigned const count) :
+        Content(count, 1),
+        CardDevice(count),
+        CardLayout(count),
+        CardContent(count)
+    {}
+
+    void InvalidateDevice()
+    {
+        ++Device;
+    }
+
+    void InvalidateLayout()
+    {
+        ++Layout;
+    }
+
+    void InvalidateContent(unsigned const card)
+    {
+        ++Content[card];
+    }
+
+    unsigned Dirty(unsigned const card) const
+    {
+        if (CardDevice[card] != Device)
+        {
+            return DirtyDevice | DirtyLayout | DirtyContent;
+        }
+
+        unsigned dirty = 0;
+
+        if (CardLayout[card] != Layout)
+        {
+            dirty |= DirtyLayout | DirtyContent;
+        }
+
+        if (CardContent[card] != Content[card])
+        {
+            dirty |= DirtyContent;
+        }
+
+        return dirty;
+    }
+
+    void Update(unsigned const card)
+    {
+        CardDevice[card] = Device;
+        CardLayout[card] = Layout;
+        CardContent[card] = Content[card];
+    }
+
+    void Forget(unsigned const card)
+    {
+        CardDevice[card] = 0;
+    }
+
+    // Marks all but the card's face current
+    void Defer(unsigned const card)
+    {
+        CardDevice[card] = Device;
+        CardLayout[card] = Layout;
+        CardContent[card] = 0;
+    }
+
+    unsigned SharedDirty() const
+    {
+        if (SharedDevice != Device)
+        {
+            return DirtyDevice | DirtyLayout;
+        }
+
+        return SharedLayout != Layout ? DirtyLayout : 0;
+    }
+
+    void UpdateShared()
+    {
+        SharedDevice = Device;
+        SharedLayout = Layout;
+    }
+};
+
+//
+// Brings every card that is still in play up to date and returns the number
+// of cards that needed work. The device provides CreateCard, LayoutCard and
+// DrawCard and reports failure by throwing. A card is only marked current
+// once all of its work has succeeded, so an interrupted update resumes with
+// the cards that were not yet done. The faces of hidden cards are left for
+// ShowCard, so the work scales with the cards face up rather than the board.
+//
+
+template <typename Device>
+void UpdateCard(Device & device,
+                ResourceGenerations & generations,
+                unsigned const card,
+                unsigned const dirty)
+{
+    if (dirty & DirtyDevice)
+    {
+        device.CreateCard(card);
+    }
+
+    if (dirty & DirtyLayout)
+    {
+        device.LayoutCard(card);
+    }
+
+    if (dirty & DirtyContent)
+    {
+        device.DrawCard(card);
+        generations.Update(card);
+    }
+    else
+    {
+        generations.Defer(card);
+    }
+}
+
+template <typename Device>
+bool UpdateCardInPlay(Device & device,
+                      ResourceGenerations & generations,
+                      Board const & board,
+                      unsigned const card)
+{
+    if (board.Status[card] == CardStatus::Matched) return false;
+
+    unsigned dirty = generations.Dirty(card);
+
+    if (board.Status[card] == CardStatus::Hidden)
+    {
+        dirty &= ~DirtyContent;
+    }
+
+    if (!dirty) return false;
+
+    UpdateCard(device, generations, card, dirty);
+    return true;
+}
+
+template <typename Device>
+unsigned UpdateCards(Device & device,
+                     ResourceGenerations & generations,
+                     Board const & board)
+{
+    unsigned updated = 0;
+
+    for (unsigned card = 0; card != board.Count(); ++card)
+    {
+        updated += UpdateCardInPlay(device, generations, board, card);
+    }
+
+    return updated;
+}
+
+// Updates only the cards given, such as those in view
+template <typename Device>
+unsigned UpdateCards(Device & device,
+                     ResourceGenerations & generations,
+                     Board const & board,
+                     std::vector<unsigned> const & cards)
+{
+    unsigned updated = 0;
+
+    for (unsigned const card : cards)
+    {
+        updated += UpdateCardInPlay(device, generations, board, card);
+    }
+
+    return updated;
+}
+
+// Brings the card up to date with its face drawn, as it is about to be
+// shown, and returns whether it needed work
+template <typename Device>
+bool ShowCard(Device & device,
+              ResourceGenerations & generations,
+              unsigned const card)
+{
+    unsigned const dirty = generations.Dirty(card);
+
+    if (!dirty) return false;
+
+    UpdateCard(device, generations, card, dirty);
+    return true;
+}
+
+//
+// Calls back as the animations that hide matched cards complete, so that
+// their resources are reclaimed as soon as they can no longer be seen
+// rather than when the device is next rebuilt. Each card is due at the end
+// of its track.
+//
+
+struct HideCompletions
+{
+    struct Pending
+    {
+        unsigned Card;
+        double Due;
+    };
+
+    std::vector<Pending> Cards;
+
+    void Add(unsigned const card,
+             double const due)
+    {
+        Cards.push_back(Pending{ card, due });
+    }
+
+    bool Contains(unsigned const card) const
+    {
+        for (Pending const & pending : Cards)
+        {
+            if (pending.Card == card) return true;
+        }
+
+        return false;
+    }
+
+    // When the next card is due, or infinity if none are waiting
+    double NextDue() const
+    {
+        double next = std::numeric_limits<double>::infinity();
+
+        for (Pending const & pending : Cards)
+        {
+            next = std::min(next, pending.Due);
+        }
+
+        return next;
+    }
+
+    // Calls complete with each card due by the time given and returns how
+    // many there were. A card is dropped before its callback is made, so
+    // one that throws is not called back again.
+    template <typename Callback>
+    unsigned Complete(double const time,
+                      Callback && complete)
+    {
+        unsigned completed = 0;
+
+        for (size_t i = 0; i != Cards.size();)
+        {
+            Pending const pending = Cards[i];
+
+            if (pending.Due > time)
+            {
+                ++i;
+                continue;
+            }
+
+            Cards[i] = Cards.back();
+            Cards.pop_back();
+            ++completed;
+
+            complete(pending.Card);
+        }
+
+        return completed;
+    }
+};
+
+//
+// Counts the surface bytes the cards hold by their status, so that a game's
+// footprint may be watched as it is played. Each card's bytes are counted
+// under the status it had when it last held or changed them.
+//
+
+struct CardFootprint
+{
+    std::vector<size_t> Held;
+    std::vector<CardStatus> Status;
+    size_t Bytes[3] = {}; // By CardStatus
+
+    explicit CardFootprint(unsigned const count) :
+        Held(count),
+        Status(count, CardStatus::Hidden)
+    {}
+
+    void Hold(unsigned const card,
+              CardStatus const status,
+              size_t const bytes)
+    {
+        Bytes[static_cast<unsigned>(Status[card])] -= Held[card];
+        Bytes[static_cast<unsigned>(status)] += bytes;
+        Held[card] = bytes;
+        Status[card] = status;
+    }
+
+    void Restate(unsigned const card,
+                 CardStatus const status)
+    {
+        Hold(card, status, Held[card]);
+    }
+
+    void Release(unsigned const card)
+    {
+        Hold(card, Status[card], 0);
+    }
+
+    // Everything held went with the device
+    void Clear()
+    {
+        std::fill(Held.begin(), Held.end(), 0);
+        std::fill(std::begin(Bytes), std::end(Bytes), 0);
+    }
+
+    size_t Total() const
+    {
+        return Bytes[0] + Bytes[1] + Bytes[2];
+    }
+};
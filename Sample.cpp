@@ -1,5 +1,22 @@
 #include "Precompiled.h"
 #include "window.h"
+#include "Animation.h"
+#include "Board.h"
+#include "Layout.h"
+#include "Pool.h"
+#include "Glyphs.h"
+#include "Resources.h"
+#include "ImageCache.h"
+#include "Input.h"
+#include "Jpeg.h"
+#include "Latency.h"
+#include "Matrix.h"
+#include "Picking.h"
+#include "Random.h"
+#include "Resample.h"
+#include "Surfaces.h"
+#include "Trace.h"
+#include "Viewport.h"
 
 using namespace Microsoft::WRL;
 using namespace D2D1;
@@ -12,12 +29,30 @@ static unsigned const CardColumns = 6;
 static float const CardMargin = 15.0f;
 static float const CardWidth = 150.0f;
 static float const CardHeight = 210.0f;
+static wchar_t const CardFont[] = L"Candara";
+static float const CardFontSize = CardHeight / 2.0f;
+static wchar_t const ImagePath[] = L"background.jpg";
+static wchar_t const ImageCacheName[] = L"cards-background.bgrx";
+static unsigned const ImageLoadedMessage = WM_APP;
+static unsigned const GlyphRasterizedMessage = WM_APP + 1;
+static AccelerateDecelerate const FlipCurve(0.2f, 0.8f);
+static unsigned const LatencyReportInterval = 32;
+static unsigned const InputLogReserve = 64 * 1024;
+static wchar_t const TracePath[] = L"cards-trace.json";
+static size_t const SurfacePoolBudget = 64 * 1024 * 1024;
+static unsigned const ViewportRows = 4;     // A larger board scrolls within
+static unsigned const ViewportColumns = 8;  // a window of this many cards
+static UINT_PTR const ReclaimTimer = 1;
+
+static float WindowWidth(unsigned const columns)
+{
+    return columns * (CardWidth + CardMargin) + CardMargin;
+}
 
-static float const WindowWidth =
-    CardColumns * (CardWidth + CardMargin) + CardMargin;
-
-static float const WindowHeight =
-    CardRows * (CardHeight + CardMargin) + CardMargin;
+static float WindowHeight(unsigned const rows)
+{
+    return rows * (CardHeight + CardMargin) + CardMargin;
+}
 
 struct ComException
 {
@@ -36,38 +71,133 @@ static void HR(HRESULT const result)
     }
 }
 
-template <typename T>
-static float PhysicalToLogical(T const pixel,
-                               float const dpi)
+static Bitmap DecodeImageWithWic(wchar_t const * path)
 {
-    return pixel * 96.0f / dpi;
+    ComPtr<IWICImagingFactory2> factory;
+
+    HR(CoCreateInstance(CLSID_WICImagingFactory,
+                        nullptr,
+                        CLSCTX_INPROC,
+                        __uuidof(factory),
+                        reinterpret_cast<void **>(factory.GetAddressOf())));
+
+    ComPtr<IWICBitmapDecoder> decoder;
+
+    HR(factory->CreateDecoderFromFilename(path,
+                                          nullptr,
+                                          GENERIC_READ,
+                                          WICDecodeMetadataCacheOnDemand,
+                                          decoder.GetAddressOf()));
+
+    ComPtr<IWICBitmapFrameDecode> source;
+
+    HR(decoder->GetFrame(0, source.GetAddressOf()));
+
+    ComPtr<IWICFormatConverter> image;
+
+    HR(factory->CreateFormatConverter(image.GetAddressOf()));
+
+    HR(image->Initialize(source.Get(),
+                         GUID_WICPixelFormat32bppBGR,
+                         WICBitmapDitherTypeNone,
+                         nullptr,
+                         0.0,
+                         WICBitmapPaletteTypeMedianCut));
+
+    unsigned width = 0;
+    unsigned height = 0;
+
+    HR(image->GetSize(&width, &height));
+
+    Bitmap bitmap(width, height);
+
+    HR(image->CopyPixels(nullptr,
+                         width * sizeof(uint32_t),
+                         width * height * sizeof(uint32_t),
+                         reinterpret_cast<BYTE *>(bitmap.Pixels.data())));
+
+    return bitmap;
 }
 
-template <typename T>
-static float LogicalToPhysical(T const pixel,
-                               float const dpi)
+// Baseline JPEG is decoded directly and anything else is left to WIC
+static Bitmap DecodeImage(wchar_t const * path)
 {
-    return pixel * dpi / 96.0f;
+    MappedFile file;
+
+    if (file.Open(path))
+    {
+        try
+        {
+            return DecodeJpeg(static_cast<uint8_t const *>(file.Data), file.Size);
+        }
+        catch (JpegException const & e)
+        {
+            TRACE(L"DecodeJpeg failed: %S\n", e.message);
+        }
+    }
+
+    return DecodeImageWithWic(path);
 }
 
-enum class CardStatus
+// Runs on a worker thread, which is implicitly part of the process's
+// multithreaded apartment. The window is told when the pixels are ready
+// whether or not they could be loaded.
+static Image LoadBackground(HWND const window)
 {
-    Hidden,
-    Selected,
-    Matched
-};
+    Image image;
+    ImageStamp stamp;
+    wchar_t cache[MAX_PATH];
 
-struct Card
-{
-    // Device independent resources
-    CardStatus Status = CardStatus::Hidden;
-    wchar_t Value = L' ';
-    float OffsetX = 0.0f;
-    float OffsetY = 0.0f;
-    ComPtr<IUIAnimationVariable2> Variable;
+    bool const cacheable =
+        GetImageStamp(ImagePath, stamp) &&
+        0 != GetTempPath(_countof(cache), cache) &&
+        0 == wcscat_s(cache, ImageCacheName);
 
-    // Device resources
+    if (cacheable && MapImageCache(cache, stamp, image))
+    {
+        TRACE(L"Mapped %s\n", cache);
+    }
+    else
+    {
+        try
+        {
+            image.Decoded = DecodeImage(ImagePath);
+            image.View = image.Decoded;
+
+            if (cacheable && !WriteImageCache(cache, image.View, stamp))
+            {
+                TRACE(L"Failed to write %s\n", cache);
+            }
+        }
+        catch (ComException const & e)
+        {
+            TRACE(L"DecodeImage failed 0x%X\n", e.result);
+        }
+    }
+
+    VERIFY(PostMessage(window, ImageLoadedMessage, 0, 0));
+
+    return image;
+}
+
+struct CardVisuals
+{
+    ComPtr<IDCompositionVisual2> Front;
+    ComPtr<IDCompositionVisual2> Back;
+    ComPtr<IDCompositionVisual2> BackContent;
+    ComPtr<IDCompositionSurface> FrontSurface;
+    SurfaceKey FrontKey = {};
     ComPtr<IDCompositionRotateTransform3D> Rotation;
+    unsigned Device = 0;  // The device generation the visuals belong to
+    bool Shown = false;   // Whether they are in the visual tree
+};
+
+// A glyph being rasterized on a worker thread for a card about to be shown
+struct GlyphRequest
+{
+    wchar_t Value;
+    unsigned Page;
+    future<AlphaMask> Mask;
 };
 
 struct SampleWindow : Window<SampleWindow>
@@ -75,50 +205,105 @@ struct SampleWindow : Window<SampleWindow>
     // Device independent resources
     float m_dpiX = 0.0f;
     float m_dpiY = 0.0f;
+    CardGrid m_grid;
+    CardPicker m_picker;
     ComPtr<IDWriteTextFormat> m_textFormat;
-    ComPtr<IWICFormatConverter> m_image;
-    ComPtr<IUIAnimationManager2> m_manager;
-    ComPtr<IUIAnimationTransitionLibrary2> m_library;
-    Card * m_firstCard = nullptr;
-
-    // Contains some device resources
-    array<Card, CardRows * CardColumns> m_cards;
+    ComPtr<IWICImagingFactory2> m_imageFactory;
+    future<Image> m_imageLoader;
+    Image m_background;
+    ResampleCache m_backImages;
+    GlyphAtlas m_glyphs;
+    vector<GlyphRequest> m_glyphRequests;
+    vector<unsigned> m_waitingFronts;
+    GameState m_game;
+    Pcg32 m_random;
+    Viewport m_viewport;
+    VisualSlots m_slots;
+
+    // Card data is kept in parallel arrays indexed by card. The status and
+    // value arrays live in m_game.Cards, the offsets in m_grid and the flip
+    // angles in m_animations.
+    AnimationSet m_animations;
+    LatencyRecorder m_clickLatency;
+
+    #if TRACING
+    LatencyHistogram m_clickHistogram;
+    LatencyHistogram m_rebuildHistogram;
+    #endif
+
+    // Input is logged from the start so a session can be saved and replayed
+    InputLog m_input;
+    LARGE_INTEGER m_inputStart = {};
 
     // Device resources
     ComPtr<ID3D11Device> m_device3D;
     ComPtr<IDCompositionDesktopDevice> m_device;
     ComPtr<IDCompositionTarget> m_target;
-
-    SampleWindow()
+    ComPtr<IDCompositionVisual2> m_rootVisual;
+    ComPtr<ID2D1DeviceContext> m_dc;
+    ComPtr<ID2D1SolidColorBrush> m_brush;
+    ComPtr<IDCompositionSurface> m_backAtlas;
+    vector<ComPtr<ID2D1Bitmap1>> m_glyphBitmaps;
+    unsigned m_glyphVersion = 0;
+    bool m_software = false;
+    ResourceGenerations m_generations;
+    vector<GlyphEntry> m_glyphEntries;
+    vector<CardVisuals> m_visuals; // By slot, see m_slots
+
+    // The card fronts are taken from and given back to the pool, which
+    // outlives the device so that it knows what to create after device loss.
+    SurfacePool<ComPtr<IDCompositionSurface>> m_surfaces;
+    CardFootprint m_footprint;
+
+    // The matched cards that are still turning away. Each gives up its
+    // visuals and front as it finishes.
+    HideCompletions m_hiding;
+
+    // The transforms either side of each card's rotation are shared by every
+    // card so that a card only adds its own rotation.
+    ComPtr<IDCompositionMatrixTransform3D> m_frontTransform;
+    ComPtr<IDCompositionMatrixTransform3D> m_backTransform;
+    ComPtr<IDCompositionMatrixTransform3D> m_perspective;
+
+    // Composition animations indexed by ClickResult. Setting an animation
+    // copies it, so each kind of click reuses the same few objects.
+    ObjectPool<ComPtr<IDCompositionAnimation>> m_animationPools[4];
+
+    // Animations for the cards that come into view part way through a flip
+    ObjectPool<ComPtr<IDCompositionAnimation>> m_enteringAnimations;
+
+    SampleWindow(unsigned const rows,
+                 unsigned const columns) :
+        m_game(rows, columns),
+        m_random(random_device()()),
+        m_slots(rows * columns),
+        m_animations(rows * columns),
+        m_generations(rows * columns),
+        m_glyphEntries(rows * columns),
+        m_footprint(rows * columns)
     {
+        m_surfaces.Budget = SurfacePoolBudget;
+
+        VERIFY(QueryPerformanceCounter(&m_inputStart));
+        m_input.Rows = rows;
+        m_input.Columns = columns;
+        m_input.Bytes.reserve(InputLogReserve);
+
         CreateDesktopWindow();
         ShuffleCards();
         CreateTextFormat();
-        CreateImage();
-        PrepareAnimationManager();
-    }
-
-    void PrepareAnimationManager()
-    {
-        HR(CoCreateInstance(__uuidof(UIAnimationManager2),
-                            nullptr,
-                            CLSCTX_INPROC,
-                            __uuidof(m_manager),
-                            reinterpret_cast<void **>(m_manager.GetAddressOf())));
+        m_imageFactory = CreateImageFactory();
 
-        HR(CoCreateInstance(__uuidof(UIAnimationTransitionLibrary2),
-                            nullptr,
-                            CLSCTX_INPROC,
-                            __uuidof(m_library),
-                            reinterpret_cast<void **>(m_library.GetAddressOf())));
+        // The background is decoded while the cards are laid out. The backs
+        // appear once it arrives.
 
-        for (Card & card : m_cards)
+        m_imageLoader = async(launch::async, [window = m_window]
         {
-            HR(m_manager->CreateAnimationVariable(0.0, card.Variable.GetAddressOf()));
-        }
+            return LoadBackground(window);
+        });
     }
 
-    void CreateImage()
+    static ComPtr<IWICImagingFactory2> CreateImageFactory()
     {
         ComPtr<IWICImagingFactory2> factory;
 
@@ -128,26 +313,7 @@ struct SampleWindow : Window<SampleWindow>
                             __uuidof(factory),
                             reinterpret_cast<void **>(factory.GetAddressOf())));
 
-        ComPtr<IWICBitmapDecoder> decoder;
-
-        HR(factory->CreateDecoderFromFilename(L"background.jpg",
-                                              nullptr,
-                                              GENERIC_READ,
-                                              WICDecodeMetadataCacheOnDemand,
-                                              decoder.GetAddressOf()));
-
-        ComPtr<IWICBitmapFrameDecode> source;
-
-        HR(decoder->GetFrame(0, source.GetAddressOf()));
-
-        HR(factory->CreateFormatConverter(m_image.GetAddressOf()));
-
-        HR(m_image->Initialize(source.Get(),
-                               GUID_WICPixelFormat32bppBGR,
-                               WICBitmapDitherTypeNone,
-                               nullptr,
-                               0.0,
-                               WICBitmapPaletteTypeMedianCut));
+        return factory;
     }
 
     void CreateTextFormat()
@@ -159,12 +325,12 @@ struct SampleWindow : Window<SampleWindow>
             __uuidof(factory),
             reinterpret_cast<IUnknown **>(factory.GetAddressOf())));
 
-        HR(factory->CreateTextFormat(L"Candara",
+        HR(factory->CreateTextFormat(CardFont,
                                      nullptr,
                                      DWRITE_FONT_WEIGHT_NORMAL,
                                      DWRITE_FONT_STYLE_NORMAL,
                                      DWRITE_FONT_STRETCH_NORMAL,
-                                     CardHeight / 2.0f,
+                                     CardFontSize,
                                      L"en",
                                      m_textFormat.GetAddressOf()));
 
@@ -174,37 +340,21 @@ struct SampleWindow : Window<SampleWindow>
 
     void ShuffleCards()
     {
-        random_device device;
-        mt19937 generator(device());
-        uniform_int_distribution<short> const distribution(L'A', L'Z');
-
-        array<wchar_t, CardRows * CardColumns> values;
-
-        for (unsigned i = 0; i != CardRows * CardColumns / 2; ++i)
-        {
-            wchar_t const value = distribution(generator);
+        // Each deal has its own seed, logged with the input so that a
+        // replay deals the same board.
 
-            values[i * 2 + 0] = value;
-            values[i * 2 + 1] = towlower(value);
-        }
-
-        shuffle(begin(values), end(values), generator);
+        m_input.Seed = m_random();
+        Pcg32 generator(m_input.Seed);
 
-        for (unsigned i = 0; i != CardRows * CardColumns; ++i)
-        {
-            Card & card = m_cards[i];
-            card.Value = values[i];
-            card.Status = CardStatus::Hidden;
-        }
+        m_game.Reset(generator);
 
         #ifdef _DEBUG
 
-        for (unsigned row = 0; row != CardRows; ++row)
+        for (unsigned row = 0; row != m_game.Cards.Rows; ++row)
         {
-            for (unsigned column = 0; column != CardColumns; ++column)
+            for (unsigned column = 0; column != m_game.Cards.Columns; ++column)
             {
-                Card & card = m_cards[row * CardColumns + column];
-                TRACE(L"%c ", card.Value);
+                TRACE(L"%c ", m_game.Cards.Value[row * m_game.Cards.Columns + column]);
             }
 
             TRACE(L"\n");
@@ -250,12 +400,20 @@ struct SampleWindow : Window<SampleWindow>
     void ReleaseDeviceResources()
     {
         m_device3D.Reset();
+        m_generations.InvalidateDevice();
+        m_surfaces.Lose();
+        m_footprint.Clear();
+
+        for (ObjectPool<ComPtr<IDCompositionAnimation>> & pool : m_animationPools)
+        {
+            pool.Clear();
+        }
+
+        m_enteringAnimations.Clear();
     }
 
-    void CreateDevice3D()
+    HRESULT CreateDevice3D(D3D_DRIVER_TYPE const type)
     {
-        ASSERT(!IsDeviceCreated());
-
         unsigned flags = D3D11_CREATE_DEVICE_BGRA_SUPPORT |
                          D3D11_CREATE_DEVICE_SINGLETHREADED;
 
@@ -263,15 +421,36 @@ struct SampleWindow : Window<SampleWindow>
         flags |= D3D11_CREATE_DEVICE_DEBUG;
         #endif
 
-        HR(D3D11CreateDevice(nullptr,
-                             D3D_DRIVER_TYPE_HARDWARE,
-                             nullptr,
-                             flags,
-                             nullptr, 0,
-                             D3D11_SDK_VERSION,
-                             m_device3D.GetAddressOf(),
-                             nullptr,
-                             nullptr));
+        return D3D11CreateDevice(nullptr,
+                                 type,
+                                 nullptr,
+                                 flags,
+                                 nullptr, 0,
+                                 D3D11_SDK_VERSION,
+                                 m_device3D.GetAddressOf(),
+                                 nullptr,
+                                 nullptr);
+    }
+
+    void CreateDevice3D()
+    {
+        ASSERT(!IsDeviceCreated());
+
+        HRESULT result = CreateDevice3D(D3D_DRIVER_TYPE_HARDWARE);
+
+        // Without a hardware device the cards are rasterized on the CPU and
+        // composed with the WARP device.
+
+        m_software = S_OK != result;
+
+        if (m_software)
+        {
+            TRACE(L"Hardware device unavailable 0x%X\n", result);
+
+            result = CreateDevice3D(D3D_DRIVER_TYPE_WARP);
+        }
+
+        HR(result);
     }
 
     ComPtr<ID2D1Device> CreateDevice2D()
@@ -305,15 +484,33 @@ struct SampleWindow : Window<SampleWindow>
         return visual;
     }
 
+    template <typename T>
+    static SurfaceKey SurfaceKeyFor(T const width,
+                                    T const height)
+    {
+        return SurfaceKey
+        {
+            static_cast<unsigned>(width),
+            static_cast<unsigned>(height),
+            DXGI_FORMAT_B8G8R8A8_UNORM,
+            4
+        };
+    }
+
     template <typename T>
     ComPtr<IDCompositionSurface> CreateSurface(T const width,
                                                T const height)
+    {
+        return CreateSurface(SurfaceKeyFor(width, height));
+    }
+
+    ComPtr<IDCompositionSurface> CreateSurface(SurfaceKey const & key)
     {
         ComPtr<IDCompositionSurface> surface;
 
-        HR(m_device->CreateSurface(static_cast<unsigned>(width),
-                                   static_cast<unsigned>(height),
-                                   DXGI_FORMAT_B8G8R8A8_UNORM,
+        HR(m_device->CreateSurface(key.Width,
+                                   key.Height,
+                                   static_cast<DXGI_FORMAT>(key.Format),
                                    DXGI_ALPHA_MODE_PREMULTIPLIED,
                                    surface.GetAddressOf()));
 
@@ -322,6 +519,8 @@ struct SampleWindow : Window<SampleWindow>
 
     void CreateDeviceResources()
     {
+        TRACE_ZONE("CreateDeviceResources");
+
         ASSERT(!IsDeviceCreated());
 
         CreateDevice3D();
@@ -337,396 +536,958 @@ struct SampleWindow : Window<SampleWindow>
                                          true,
                                          m_target.ReleaseAndGetAddressOf()));
 
-        ComPtr<IDCompositionVisual2> rootVisual = CreateVisual();
+        m_rootVisual = CreateVisual();
 
-        HR(m_target->SetRoot(rootVisual.Get()));
+        HR(m_target->SetRoot(m_rootVisual.Get()));
 
-        ComPtr<ID2D1DeviceContext> dc;
+        HR(m_device->CreateMatrixTransform3D(m_frontTransform.ReleaseAndGetAddressOf()));
+        HR(m_device->CreateMatrixTransform3D(m_backTransform.ReleaseAndGetAddressOf()));
+        HR(m_device->CreateMatrixTransform3D(m_perspective.ReleaseAndGetAddressOf()));
 
         HR(device2D->CreateDeviceContext(D2D1_DEVICE_CONTEXT_OPTIONS_NONE,
-                                         dc.GetAddressOf()));
+                                         m_dc.ReleaseAndGetAddressOf()));
 
         D2D1_COLOR_F const color = ColorF(0.0f, 0.0f, 0.0f);
 
-        ComPtr<ID2D1SolidColorBrush> brush;
-
-        HR(dc->CreateSolidColorBrush(color,
-                                     brush.GetAddressOf()));
-
-        ComPtr<ID2D1Bitmap1> bitmap;
-
-        HR(dc->CreateBitmapFromWicBitmap(m_image.Get(),
-                                         bitmap.GetAddressOf()));
+        HR(m_dc->CreateSolidColorBrush(color,
+                                       m_brush.ReleaseAndGetAddressOf()));
+    }
 
-        float const width = LogicalToPhysical(CardWidth, m_dpiX);
-        float const height = LogicalToPhysical(CardHeight, m_dpiY);
+    // Recreates or redraws only the resources that have been invalidated
+    // since they were last brought up to date, for the cards in view, and
+    // returns how many cards needed work.
+    unsigned UpdateDeviceResources()
+    {
+        TRACE_ZONE("UpdateDeviceResources");
 
-        for (unsigned row = 0; row != CardRows; ++row)
-        for (unsigned column = 0; column != CardColumns; ++column)
+        if (m_generations.SharedDirty())
         {
-            Card & card = m_cards[row * CardColumns + column];
-
-            card.OffsetX = LogicalToPhysical(column * (CardWidth + CardMargin) + CardMargin, m_dpiX);
-            card.OffsetY = LogicalToPhysical(row * (CardHeight + CardMargin) + CardMargin, m_dpiY);
+            CreateSharedResources();
+            m_generations.UpdateShared();
+        }
 
-            if (card.Status == CardStatus::Matched) continue;
+        UpdateViewport();
 
-            ComPtr<IDCompositionVisual2> frontVisual = CreateVisual();
-            HR(frontVisual->SetOffsetX(card.OffsetX));
-            HR(frontVisual->SetOffsetY(card.OffsetY));
+        // Missing glyphs are rasterized before any card is drawn so that the
+        // glyph bitmap is uploaded at most once per update. Only the cards
+        // face up are drawn here; the rest are drawn as they are shown.
 
-            HR(rootVisual->AddVisual(frontVisual.Get(), false, nullptr));
+        for (unsigned const card : m_slots.Bound)
+        {
+            if (m_game.Cards.Status[card] != CardStatus::Selected) continue;
 
-            ComPtr<IDCompositionVisual2> backVisual = CreateVisual();
-            HR(backVisual->SetOffsetX(card.OffsetX));
-            HR(backVisual->SetOffsetY(card.OffsetY));
+            if (m_generations.Dirty(card) & DirtyContent)
+            {
+                m_glyphEntries[card] = FindGlyph(m_game.Cards.Value[card]);
+            }
+        }
 
-            HR(rootVisual->AddVisual(backVisual.Get(), false, nullptr));
+        UpdateGlyphBitmaps();
 
-            ComPtr<IDCompositionSurface> frontSurface =
-                CreateSurface(width, height);
+        unsigned updated = UpdateCards(*this,
+                                       m_generations,
+                                       m_game.Cards,
+                                       m_slots.Bound);
 
-            HR(frontVisual->SetContent(frontSurface.Get()));
+        // A card that comes into view part way through turning over needs
+        // its face whichever way it is turning
+        if (!m_slots.Entering.empty())
+        {
+            DCOMPOSITION_FRAME_STATISTICS stats = {};
+            HR(m_device->GetFrameStatistics(&stats));
 
-            DrawCardFront(frontSurface,
-                          card.Value,
-                          brush);
+            double const time = stats.lastFrameTime.QuadPart / static_cast<double>(stats.timeFrequency.QuadPart);
 
-            ComPtr<IDCompositionSurface> backSurface =
-                CreateSurface(width, height);
+            for (unsigned const card : m_slots.Entering)
+            {
+                if (CardPicker::InFlight(m_animations.Tracks[card], time))
+                {
+                    updated += ShowFront(card, false);
+                }
+            }
+        }
 
-            HR(backVisual->SetContent(backSurface.Get()));
+        // These run on every paint, scroll and timer tick so only debug
+        // builds log them
 
-            DrawCardBack(backSurface,
-                         card.OffsetX,
-                         card.OffsetY,
-                         bitmap);
+        #ifdef _DEBUG
 
-            HR(m_device->CreateRotateTransform3D(card.Rotation.ReleaseAndGetAddressOf()));
+        TRACE(L"Updated %u of %u cards in view, glyph atlas %u hits, %u misses\n",
+              updated,
+              static_cast<unsigned>(m_slots.Bound.size()),
+              m_glyphs.Hits,
+              m_glyphs.Misses);
 
-            if (card.Status == CardStatus::Selected)
-            {
-                HR(card.Rotation->SetAngle(180.0f));
-            }
+        TRACE(L"Card surfaces %llu bytes in use, %llu free, %llu at most, %u created, %u reused\n",
+              static_cast<unsigned long long>(m_surfaces.BytesInUse),
+              static_cast<unsigned long long>(m_surfaces.BytesFree),
+              static_cast<unsigned long long>(m_surfaces.HighWater),
+              m_surfaces.Created,
+              m_surfaces.Reused);
 
-            HR(card.Rotation->SetAxisZ(0.0f));
-            HR(card.Rotation->SetAxisY(1.0f));
+        TRACE(L"Card surfaces %llu bytes hidden, %llu selected, %llu matched\n",
+              static_cast<unsigned long long>(m_footprint.Bytes[static_cast<unsigned>(CardStatus::Hidden)]),
+              static_cast<unsigned long long>(m_footprint.Bytes[static_cast<unsigned>(CardStatus::Selected)]),
+              static_cast<unsigned long long>(m_footprint.Bytes[static_cast<unsigned>(CardStatus::Matched)]));
 
-            CreateEffect(frontVisual,
-                         card.Rotation,
-                         true);
+        #endif
 
-            CreateEffect(backVisual,
-                         card.Rotation,
-                         false);
+        if (updated)
+        {
+            Commit();
         }
 
-        HR(m_device->Commit());
+        return updated;
     }
 
-    void CreateEffect(ComPtr<IDCompositionVisual2> const & visual,
-                      ComPtr<IDCompositionRotateTransform3D> const & rotation,
-                      bool const front)
-    {
-        float const width = LogicalToPhysical(CardWidth, m_dpiX);
-        float const height = LogicalToPhysical(CardHeight, m_dpiY);
-
-        ComPtr<IDCompositionMatrixTransform3D> pre;
-        HR(m_device->CreateMatrixTransform3D(pre.GetAddressOf()));
+    //
+    // Gives visuals to the cards coming into view, taking them from the cards
+    // going out of it and those that have been matched and hidden. A card
+    // given visuals has everything made for it again, since its slot was
+    // last used by another card or on another device.
+    //
 
-        D2D1_MATRIX_4X4_F preMatrix =
-            Matrix4x4F::Translation(-width / 2.0f, -height / 2.0f, 0.0f) *
-            Matrix4x4F::RotationY(front ? 180.0f : 0.0f);
+    void UpdateViewport()
+    {
+        TRACE_ZONE("UpdateViewport");
 
-        HR(pre->SetMatrix(reinterpret_cast<D3DMATRIX const &>(preMatrix)));
+        auto const keep = [this](unsigned const card)
+        {
+            return m_game.Cards.Status[card] != CardStatus::Matched || m_hiding.Contains(card);
+        };
 
-        ComPtr<IDCompositionMatrixTransform3D> post;
-        HR(m_device->CreateMatrixTransform3D(post.GetAddressOf()));
+        m_slots.Update(m_viewport.Range(m_grid),
+                       m_grid.Columns,
+                       keep,
+                       [this](unsigned const card, unsigned const slot)
+        {
+            ReleaseVisuals(card, m_visuals[slot]);
+        });
 
-        D2D1_MATRIX_4X4_F postMatrix =
-            Matrix4x4F::PerspectiveProjection(width * 2.0f) *
-            Matrix4x4F::Translation(width / 2.0f, height / 2.0f, 0.0f);
+        if (m_visuals.size() < m_slots.Slots())
+        {
+            m_visuals.resize(m_slots.Slots());
+        }
 
-        HR(post->SetMatrix(reinterpret_cast<D3DMATRIX const &>(postMatrix)));
+        // The slots passed straight on to cards entering the view keep their
+        // visuals; those left over, as when matched cards are reclaimed on a
+        // board that fits the window, let go of them
+        for (unsigned const slot : m_slots.Free)
+        {
+            DropVisuals(m_visuals[slot]);
+        }
 
-        IDCompositionTransform3D * transforms[] =
+        for (unsigned const card : m_slots.Entering)
         {
-            pre.Get(),
-            rotation.Get(),
-            post.Get()
-        };
+            m_generations.Forget(card);
+        }
 
-        ComPtr<IDCompositionTransform3D> transform;
+        m_enteringAnimations.Recycle();
+    }
 
-        HR(m_device->CreateTransform3DGroup(transforms,
-                                            _countof(transforms),
-                                            transform.GetAddressOf()));
+    CardVisuals & VisualsOf(unsigned const card)
+    {
+        return m_visuals[m_slots.SlotOf[card]];
+    }
 
-        HR(visual->SetEffect(transform.Get()));
+    bool IsCurrent(CardVisuals const & visuals) const
+    {
+        return visuals.Device == m_generations.Device;
     }
 
-    void DrawCardBack(ComPtr<IDCompositionSurface> const & surface,
-                      float const offsetX,
-                      float const offsetY,
-                      ComPtr<ID2D1Bitmap1> const & bitmap)
+    void HideVisuals(CardVisuals & visuals)
     {
-        ComPtr<ID2D1DeviceContext> dc;
-        POINT offset = {};
+        // Visuals from a lost device went with its visual tree
+        if (!visuals.Shown || !IsCurrent(visuals)) return;
 
-        HR(surface->BeginDraw(nullptr,
-                              __uuidof(dc),
-                              reinterpret_cast<void **>(dc.GetAddressOf()),
-                              &offset));
+        visuals.Shown = false;
 
-        dc->SetDpi(m_dpiX,
-                   m_dpiY);
+        HR(m_rootVisual->RemoveVisual(visuals.Front.Get()));
+        HR(m_rootVisual->RemoveVisual(visuals.Back.Get()));
+    }
 
-        dc->SetTransform(Matrix3x2F::Translation(PhysicalToLogical(offset.x, m_dpiX),
-                                                 PhysicalToLogical(offset.y, m_dpiY)));
+    // Takes the card's visuals out of the tree and gives its front back to
+    // the pool. The visuals stay with the slot for the next card to use,
+    // unless no card takes the slot.
+    void ReleaseVisuals(unsigned const card,
+                        CardVisuals & visuals)
+    {
+        HideVisuals(visuals);
 
-        D2D1_RECT_F source = RectF(PhysicalToLogical(offsetX, m_dpiX),
-                                   PhysicalToLogical(offsetY, m_dpiY));
+        if (!visuals.FrontSurface || !IsCurrent(visuals)) return;
 
-        source.right = source.left + CardWidth;
-        source.bottom = source.top + CardHeight;
+        m_surfaces.Release(visuals.FrontKey, move(visuals.FrontSurface));
+        m_footprint.Release(card);
 
-        dc->DrawBitmap(bitmap.Get(),
-                       nullptr,
-                       1.0f,
-                       D2D1_INTERPOLATION_MODE_LINEAR,
-                       &source);
+        HR(visuals.Front->SetContent(nullptr));
+    }
 
-        HR(surface->EndDraw());
+    // Releases the visuals, rotation and back content of a slot that no card
+    // holds, leaving them to be made again should a card take it
+    static void DropVisuals(CardVisuals & visuals)
+    {
+        visuals.Front.Reset();
+        visuals.Back.Reset();
+        visuals.BackContent.Reset();
+        visuals.FrontSurface.Reset();
+        visuals.Rotation.Reset();
+        visuals.Device = 0;
+        visuals.Shown = false;
     }
 
-    void DrawCardFront(ComPtr<IDCompositionSurface> const & surface,
-                       wchar_t const value,
-                       ComPtr<ID2D1SolidColorBrush> const & brush)
+    // The cards are drawn in card order, as they are hit tested, so a card
+    // coming into view goes just above the nearest card before it that is
+    // shown, or else just below the nearest one after it.
+    void ShowVisuals(unsigned const card,
+                     CardVisuals & visuals)
     {
-        ComPtr<ID2D1DeviceContext> dc;
-        POINT offset = {};
+        if (visuals.Shown) return;
 
-        HR(surface->BeginDraw(nullptr,
-                              __uuidof(dc),
-                              reinterpret_cast<void **>(dc.GetAddressOf()),
-                              &offset));
+        auto const shown = [this](unsigned const other)
+        {
+            CardVisuals const & neighbour = VisualsOf(other);
 
-        dc->SetDpi(m_dpiX,
-                   m_dpiY);
+            return neighbour.Shown && IsCurrent(neighbour);
+        };
 
-        dc->SetTransform(Matrix3x2F::Translation(PhysicalToLogical(offset.x, m_dpiX),
-                                                 PhysicalToLogical(offset.y, m_dpiY)));
+        unsigned const below = m_slots.Previous(card, shown);
 
-        dc->Clear(ColorF(1.0f, 1.0f, 1.0f));
+        if (NoCard != below)
+        {
+            HR(m_rootVisual->AddVisual(visuals.Front.Get(), true, VisualsOf(below).Back.Get()));
+        }
+        else
+        {
+            unsigned const above = m_slots.Next(card, shown);
+
+            HR(m_rootVisual->AddVisual(visuals.Front.Get(),
+                                       false,
+                                       NoCard == above ? nullptr : VisualsOf(above).Front.Get()));
+        }
 
-        dc->DrawText(&value,
-                     1, 
-                     m_textFormat.Get(),
-                     RectF(0.0f, 0.0f, CardWidth, CardHeight),
-                     brush.Get());
+        HR(m_rootVisual->AddVisual(visuals.Back.Get(), true, visuals.Front.Get()));
 
-        HR(surface->EndDraw());
+        visuals.Shown = true;
     }
 
-    LRESULT MessageHandler(UINT const message,
-                           WPARAM const wparam,
-                           LPARAM const lparam)
+    void ScrollRoot()
     {
-        if (WM_LBUTTONUP == message)
-        {
-            LeftButtonUpHandler(lparam);
-        }
-        else if (WM_PAINT == message)
-        {
-            PaintHandler();
-        }
-        else if (WM_DPICHANGED == message)
-        {
-            DpiChangedHandler(wparam, lparam);
-        }
-        else if (WM_CREATE == message)
-        {
-            CreateHandler();
-        }
-        else if (WM_WINDOWPOSCHANGING == message)
+        HR(m_rootVisual->SetOffsetX(-m_viewport.ScrollX));
+        HR(m_rootVisual->SetOffsetY(-m_viewport.ScrollY));
+    }
+
+    // Glyphs are only ever added to the last sheet of a page, so that is the
+    // only bitmap that can be stale and any sheets after it are new.
+    void UpdateGlyphBitmaps()
+    {
+        if (m_software) return;
+
+        GlyphPage const & page = m_glyphs.Pages[m_glyphs.Current];
+
+        if (m_glyphVersion != page.Version && !m_glyphBitmaps.empty())
         {
-            // Prevent window resizing due to device loss
+            m_glyphBitmaps.pop_back();
         }
-        else
+
+        while (m_glyphBitmaps.size() < page.Sheets.size())
         {
-            return __super::MessageHandler(message,
-                                           wparam,
-                                           lparam);
+            m_glyphBitmaps.push_back(CreateGlyphBitmap(m_dc,
+                                                       page.Sheets[m_glyphBitmaps.size()]));
         }
 
-        return 0;
+        m_glyphVersion = page.Version;
     }
 
-    Card * CardAtPoint(LPARAM const lparam)
+    //
+    // Draws a card's face as it starts to turn over, returning whether it
+    // needed drawing. If its glyph has yet to be rasterized that is done on
+    // a worker thread, ahead of the face coming into view halfway through
+    // the flip, unless the card may not wait.
+    //
+
+    bool ShowFront(unsigned const card,
+                   bool const wait)
     {
-        float const x = static_cast<float>(LOWORD(lparam));
-        float const y = static_cast<float>(HIWORD(lparam));
+        // A card out of view is brought up to date when it comes back
+        if (NoCard == m_slots.SlotOf[card]) return false;
 
-        float const width = LogicalToPhysical(CardWidth, m_dpiX);
-        float const height = LogicalToPhysical(CardHeight, m_dpiY);
+        if (!m_generations.Dirty(card)) return false;
+
+        wchar_t const value = m_game.Cards.Value[card];
 
-        for (Card & card : m_cards)
+        if (wait && !m_glyphs.Pages[m_glyphs.Current].Find(value))
         {
-            if (x > card.OffsetX && 
-                y > card.OffsetY &&
-                x < card.OffsetX + width &&
-                y < card.OffsetY + height)
+            RasterizeGlyphAhead(value);
+
+            if (m_waitingFronts.end() == find(m_waitingFronts.begin(), m_waitingFronts.end(), card))
             {
-                return &card;
+                m_waitingFronts.push_back(card);
             }
+
+            return false;
         }
 
-        return nullptr;
+        m_glyphEntries[card] = FindGlyph(value);
+        UpdateGlyphBitmaps();
+
+        return ShowCard(*this, m_generations, card);
     }
 
-    bool IsMatch(wchar_t const first,
-                 wchar_t const second)
+    void RasterizeGlyphAhead(wchar_t const value)
     {
-        int const expected = 'a' - 'A';
+        for (GlyphRequest const & request : m_glyphRequests)
+        {
+            if (request.Value == value) return;
+        }
+
+        unsigned const width = static_cast<unsigned>(m_grid.Width);
+        unsigned const height = static_cast<unsigned>(m_grid.Height);
+        float const dpiX = m_dpiX;
+        float const dpiY = m_dpiY;
+
+        // The worker has an imaging factory of its own. The text format is
+        // immutable and may be shared.
+
+        future<AlphaMask> mask = async(launch::async, [=, window = m_window]
+        {
+            AlphaMask glyph;
+
+            try
+            {
+                glyph = CreateGlyphMask(CreateImageFactory(),
+                                        value,
+                                        width,
+                                        height,
+                                        dpiX,
+                                        dpiY);
+            }
+            catch (ComException const & e)
+            {
+                TRACE(L"CreateGlyphMask failed 0x%X\n", e.result);
+            }
+
+            VERIFY(PostMessage(window, GlyphRasterizedMessage, value, 0));
+
+            return glyph;
+        });
 
-        int const actual = abs(first - second);
+        m_glyphRequests.push_back(GlyphRequest{ value, m_glyphs.Current, move(mask) });
+    }
+
+    void Commit()
+    {
+        TRACE_ZONE("Commit");
 
-        return expected == actual;
+        HR(m_device->Commit());
     }
 
-    ComPtr<IUIAnimationTransition2> CreateTransition(double const duration,
-                                                     double const finalValue)
+    void CreateSharedResources()
     {
-        ComPtr<IUIAnimationTransition2> transition;
+        TRACE_ZONE("CreateSharedResources");
 
-        HR(m_library->CreateAccelerateDecelerateTransition(duration,
-                                                           finalValue,
-                                                           0.2,
-                                                           0.8,
-                                                           transition.GetAddressOf()));
+        CreateBackAtlas();
+        UpdateCardTransforms();
+        ScrollRoot();
 
-        return transition;
+        // Each distinct glyph is rasterized once per font and DPI and the
+        // card fronts are composed from the glyph atlas.
+
+        m_glyphs.Select(CardFont, CardFontSize, m_dpiX, m_dpiY);
+        m_glyphBitmaps.clear();
     }
 
-    UI_ANIMATION_KEYFRAME AddShowTransition(Card const & card,
-                                            ComPtr<IUIAnimationStoryboard2> const & storyboard)
+    void CreateBackAtlas()
     {
-        double angle = 0.0;
-        HR(card.Variable->GetValue(&angle));
+        TRACE_ZONE("CreateBackAtlas");
 
-        double const duration = (180.0 - angle) / 180.0;
+        BitmapView const & image = m_background.View;
 
-        ComPtr<IUIAnimationTransition2> transition =
-            CreateTransition(duration, 180.0);
+        m_backAtlas.Reset();
 
-        HR(storyboard->AddTransition(card.Variable.Get(),
-                                     transition.Get()));
+        if (!image.Pixels) return;
 
-        UI_ANIMATION_KEYFRAME keyframe = nullptr;
+        // The card backs are all cropped from a single surface holding the
+        // part of the background that lies behind the board.
 
-        HR(storyboard->AddKeyframeAfterTransition(transition.Get(),
-                                                  &keyframe));
+        unsigned const atlasWidth = static_cast<unsigned>(LogicalToPhysical(
+            min(static_cast<float>(image.Width), WindowWidth(m_grid.Columns)), m_dpiX));
 
-        return keyframe;
-    }
+        unsigned const atlasHeight = static_cast<unsigned>(LogicalToPhysical(
+            min(static_cast<float>(image.Height), WindowHeight(m_grid.Rows)), m_dpiY));
 
-    void AddHideTransition(Card const & card,
-                           ComPtr<IUIAnimationStoryboard2> const & storyboard,
-                           UI_ANIMATION_KEYFRAME keyframe,
-                           double const finalValue)
-    {
-        ComPtr<IUIAnimationTransition2> transition =
-            CreateTransition(1.0, finalValue);
+        m_backAtlas = CreateSurface(atlasWidth, atlasHeight);
+
+        // The scaled pixels are kept per DPI so moving back to a monitor
+        // that was used before only has to upload them again.
 
-        HR(storyboard->AddTransitionAtKeyframe(card.Variable.Get(),
-                                               transition.Get(),
-                                               keyframe));
+        UploadBitmap(m_backAtlas,
+                     m_backImages.Find(m_dpiX,
+                                       m_dpiY,
+                                       atlasWidth,
+                                       atlasHeight));
+
+        unsigned const backs = static_cast<unsigned>(count(begin(m_game.Cards.Status),
+                                                           end(m_game.Cards.Status),
+                                                           CardStatus::Hidden));
+
+        TRACE(L"Card backs use %llu surface bytes rather than %llu\n",
+              4ull * atlasWidth * atlasHeight,
+              4ull * static_cast<unsigned>(m_grid.Width) * static_cast<unsigned>(m_grid.Height) * backs);
     }
 
-    void UpdateAnimation(Card const & card)
+    GlyphEntry FindGlyph(wchar_t const value)
     {
-        ComPtr<IDCompositionAnimation> animation;
-        HR(m_device->CreateAnimation(animation.GetAddressOf()));
-        HR(card.Variable->GetCurve(animation.Get()));
-        HR(card.Rotation->SetAngle(animation.Get()));
+        return m_glyphs.Find(value, [&](wchar_t const glyph)
+        {
+            return CreateGlyphMask(m_imageFactory,
+                                   glyph,
+                                   static_cast<unsigned>(m_grid.Width),
+                                   static_cast<unsigned>(m_grid.Height),
+                                   m_dpiX,
+                                   m_dpiY);
+        });
     }
 
-    void LeftButtonUpHandler(LPARAM const lparam)
+    void CreateCard(unsigned const card)
     {
-        try
-        {
-            Card * nextCard = CardAtPoint(lparam);
+        TRACE_ZONE("CreateCard");
 
-            if (!nextCard) return;
+        CardVisuals & visuals = VisualsOf(card);
 
-            if (nextCard == m_firstCard) return;
+        // The visuals in a slot pass from card to card while the device lasts
+        if (!IsCurrent(visuals))
+        {
+            // A surface left from the lost device was dropped by the pool
+            visuals.FrontSurface.Reset();
+            visuals.Shown = false;
 
-            if (nextCard->Status == CardStatus::Matched) return;
+            visuals.Front = CreateVisual();
+            visuals.Back = CreateVisual();
 
-            DCOMPOSITION_FRAME_STATISTICS stats = {};
-            HR(m_device->GetFrameStatistics(&stats));
+            visuals.BackContent = CreateVisual();
+            HR(visuals.Back->AddVisual(visuals.BackContent.Get(), false, nullptr));
 
-            double const next = static_cast<double>(stats.nextEstimatedFrameTime.QuadPart) / stats.timeFrequency.QuadPart;
+            HR(m_device->CreateRotateTransform3D(visuals.Rotation.ReleaseAndGetAddressOf()));
 
-            HR(m_manager->Update(next));
+            HR(visuals.Rotation->SetAxisZ(0.0f));
+            HR(visuals.Rotation->SetAxisY(1.0f));
 
-            ComPtr<IUIAnimationStoryboard2> storyboard;
-            HR(m_manager->CreateStoryboard(storyboard.GetAddressOf()));
+            CreateEffect(visuals.Front,
+                         visuals.Rotation,
+                         m_frontTransform);
 
-            if (!m_firstCard)
+            CreateEffect(visuals.Back,
+                         visuals.Rotation,
+                         m_backTransform);
+
+            visuals.Device = m_generations.Device;
+        }
+
+        ShowVisuals(card, visuals);
+
+        // A card that left the view while turning over picks up its flip
+        // where it would be now
+        LARGE_INTEGER frequency = {};
+        VERIFY(QueryPerformanceFrequency(&frequency));
+
+        UpdateAnimation(card, frequency, m_enteringAnimations);
+    }
+
+    void LayoutCard(unsigned const card)
+    {
+        CardVisuals & visuals = VisualsOf(card);
+
+        float const offsetX = m_grid.OffsetX[card % m_grid.Columns];
+        float const offsetY = m_grid.OffsetY[card / m_grid.Columns];
+
+        HR(visuals.Front->SetOffsetX(offsetX));
+        HR(visuals.Front->SetOffsetY(offsetY));
+
+        HR(visuals.Back->SetOffsetX(offsetX));
+        HR(visuals.Back->SetOffsetY(offsetY));
+        HR(visuals.Back->SetClip(RectF(0.0f, 0.0f, m_grid.Width, m_grid.Height)));
+
+        HR(visuals.BackContent->SetOffsetX(-offsetX));
+        HR(visuals.BackContent->SetOffsetY(-offsetY));
+        HR(visuals.BackContent->SetContent(m_backAtlas.Get()));
+
+        // A front of the wrong size goes back to the pool, and the card takes
+        // another when it is next drawn
+        if (visuals.FrontSurface && visuals.FrontKey != SurfaceKeyFor(m_grid.Width, m_grid.Height))
+        {
+            m_surfaces.Release(visuals.FrontKey, move(visuals.FrontSurface));
+            m_footprint.Release(card);
+
+            HR(visuals.Front->SetContent(nullptr));
+        }
+    }
+
+    void DrawCard(unsigned const card)
+    {
+        CardVisuals & visuals = VisualsOf(card);
+
+        if (!visuals.FrontSurface)
+        {
+            SurfaceKey const key = SurfaceKeyFor(m_grid.Width, m_grid.Height);
+
+            visuals.FrontSurface = m_surfaces.Acquire(key, [this](SurfaceKey const & created)
             {
-                m_firstCard = nextCard;
-                nextCard->Status = CardStatus::Selected;
+                return CreateSurface(created);
+            });
 
-                AddShowTransition(*nextCard, storyboard);
-                HR(storyboard->Schedule(next));
-                UpdateAnimation(*nextCard);
-            }
-            else
+            visuals.FrontKey = key;
+            m_footprint.Hold(card, m_game.Cards.Status[card], key.Bytes());
+
+            HR(visuals.Front->SetContent(visuals.FrontSurface.Get()));
+        }
+
+        if (m_software)
+        {
+            DrawCardFrontSoftware(visuals.FrontSurface,
+                                  m_glyphEntries[card]);
+        }
+        else
+        {
+            DrawCardFront(visuals.FrontSurface,
+                          m_glyphEntries[card],
+                          m_glyphBitmaps,
+                          m_brush);
+        }
+    }
+
+    static void SetMatrix(ComPtr<IDCompositionMatrixTransform3D> const & transform,
+                          Matrix4x4 const & matrix)
+    {
+        static_assert(sizeof(matrix) == sizeof(D3DMATRIX), "Matrix4x4 and D3DMATRIX must share a layout");
+
+        HR(transform->SetMatrix(reinterpret_cast<D3DMATRIX const &>(matrix)));
+    }
+
+    // The shared transforms depend only on the card size, so a DPI change
+    // updates three matrices rather than every card.
+    void UpdateCardTransforms()
+    {
+        float const width = LogicalToPhysical(CardWidth, m_dpiX);
+        float const height = LogicalToPhysical(CardHeight, m_dpiY);
+
+        Matrix4x4 const front = CardPreTransform(width, height, true);
+        Matrix4x4 const back = CardPreTransform(width, height, false);
+        Matrix4x4 const perspective = CardPostTransform(width, height);
+
+        #ifdef _DEBUG
+        D2D1_MATRIX_4X4_F const expectedBack =
+            Matrix4x4F::Translation(-width / 2.0f, -height / 2.0f, 0.0f) *
+            Matrix4x4F::RotationY(0.0f);
+
+        Matrix4x4F const expectedPerspective =
+            Matrix4x4F::PerspectiveProjection(width * 2.0f) *
+            Matrix4x4F::Translation(width / 2.0f, height / 2.0f, 0.0f);
+
+        // The half turn of the front is where rounding is most likely to
+        // differ, and the card passes through other angles as it flips
+        Matrix4x4F const expectedFront =
+            Matrix4x4F::Translation(-width / 2.0f, -height / 2.0f, 0.0f) *
+            Matrix4x4F::RotationY(180.0f);
+
+        float const flipping = 180.0f * FlipCurve(0.5f);
+
+        Matrix4x4 const turning = front * Matrix4x4::RotationY(flipping) * perspective;
+
+        D2D1_MATRIX_4X4_F const expectedTurning =
+            expectedFront *
+            Matrix4x4F::RotationY(flipping) *
+            expectedPerspective;
+
+        ASSERT(0 == memcmp(&back, &expectedBack, sizeof(expectedBack)));
+        ASSERT(0 == memcmp(&front, &expectedFront, sizeof(expectedFront)));
+        ASSERT(0 == memcmp(&turning, &expectedTurning, sizeof(expectedTurning)));
+        ASSERT(0 == memcmp(&perspective, &expectedPerspective, sizeof(expectedPerspective)));
+        #endif
+
+        SetMatrix(m_frontTransform, front);
+        SetMatrix(m_backTransform, back);
+        SetMatrix(m_perspective, perspective);
+    }
+
+    void CreateEffect(ComPtr<IDCompositionVisual2> const & visual,
+                      ComPtr<IDCompositionRotateTransform3D> const & rotation,
+                      ComPtr<IDCompositionMatrixTransform3D> const & pre)
+    {
+        TRACE_ZONE("CreateEffect");
+
+        IDCompositionTransform3D * transforms[] =
+        {
+            pre.Get(),
+            rotation.Get(),
+            m_perspective.Get()
+        };
+
+        ComPtr<IDCompositionTransform3D> transform;
+
+        HR(m_device->CreateTransform3DGroup(transforms,
+                                            _countof(transforms),
+                                            transform.GetAddressOf()));
+
+        HR(visual->SetEffect(transform.Get()));
+    }
+
+    ComPtr<ID2D1Bitmap1> CreateGlyphBitmap(ComPtr<ID2D1DeviceContext> const & dc,
+                                           AlphaMask const & sheet)
+    {
+        ComPtr<ID2D1Bitmap1> bitmap;
+
+        D2D1_BITMAP_PROPERTIES1 const properties =
+            BitmapProperties1(D2D1_BITMAP_OPTIONS_NONE,
+                              PixelFormat(DXGI_FORMAT_A8_UNORM,
+                                          D2D1_ALPHA_MODE_PREMULTIPLIED),
+                              m_dpiX,
+                              m_dpiY);
+
+        HR(dc->CreateBitmap(SizeU(sheet.Width, sheet.Height),
+                            sheet.Coverage.data(),
+                            sheet.Width,
+                            properties,
+                            bitmap.GetAddressOf()));
+
+        return bitmap;
+    }
+
+    void DrawCardFront(ComPtr<IDCompositionSurface> const & surface,
+                       GlyphEntry const & glyph,
+                       vector<ComPtr<ID2D1Bitmap1>> const & glyphBitmaps,
+                       ComPtr<ID2D1SolidColorBrush> const & brush)
+    {
+        TRACE_ZONE("DrawCardFront");
+
+        ComPtr<ID2D1DeviceContext> dc;
+        POINT offset = {};
+
+        HR(surface->BeginDraw(nullptr,
+                              __uuidof(dc),
+                              reinterpret_cast<void **>(dc.GetAddressOf()),
+                              &offset));
+
+        dc->SetDpi(m_dpiX,
+                   m_dpiY);
+
+        dc->SetTransform(Matrix3x2F::Translation(PhysicalToLogical(offset.x, m_dpiX),
+                                                 PhysicalToLogical(offset.y, m_dpiY)));
+
+        dc->Clear(ColorF(1.0f, 1.0f, 1.0f));
+
+        if (glyph.Width)
+        {
+            float const x = PhysicalToLogical(glyph.OffsetX, m_dpiX);
+            float const y = PhysicalToLogical(glyph.OffsetY, m_dpiY);
+
+            D2D1_RECT_F const destination =
+                RectF(x,
+                      y,
+                      x + PhysicalToLogical(glyph.Width, m_dpiX),
+                      y + PhysicalToLogical(glyph.Height, m_dpiY));
+
+            D2D1_RECT_F const source =
+                RectF(PhysicalToLogical(glyph.X, m_dpiX),
+                      PhysicalToLogical(glyph.Y, m_dpiY),
+                      PhysicalToLogical(glyph.X + glyph.Width, m_dpiX),
+                      PhysicalToLogical(glyph.Y + glyph.Height, m_dpiY));
+
+            // Opacity masks may only be filled with aliased geometry
+            dc->SetAntialiasMode(D2D1_ANTIALIAS_MODE_ALIASED);
+
+            dc->FillOpacityMask(glyphBitmaps[glyph.Sheet].Get(),
+                                brush.Get(),
+                                &destination,
+                                &source);
+        }
+
+        HR(surface->EndDraw());
+    }
+
+    // May be called on any thread with a factory belonging to it
+    AlphaMask CreateGlyphMask(ComPtr<IWICImagingFactory2> const & imageFactory,
+                              wchar_t const value,
+                              unsigned const width,
+                              unsigned const height,
+                              float const dpiX,
+                              float const dpiY) const
+    {
+        ComPtr<IWICBitmap> bitmap;
+
+        HR(imageFactory->CreateBitmap(width,
+                                      height,
+                                      GUID_WICPixelFormat32bppPBGRA,
+                                      WICBitmapCacheOnLoad,
+                                      bitmap.GetAddressOf()));
+
+        ComPtr<ID2D1Factory1> factory;
+
+        HR(D2D1CreateFactory(D2D1_FACTORY_TYPE_SINGLE_THREADED,
+                             factory.GetAddressOf()));
+
+        D2D1_RENDER_TARGET_PROPERTIES const properties =
+            RenderTargetProperties(D2D1_RENDER_TARGET_TYPE_SOFTWARE,
+                                   PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM,
+                                               D2D1_ALPHA_MODE_PREMULTIPLIED),
+                                   dpiX,
+                                   dpiY);
+
+        ComPtr<ID2D1RenderTarget> target;
+
+        HR(factory->CreateWicBitmapRenderTarget(bitmap.Get(),
+                                                properties,
+                                                target.GetAddressOf()));
+
+        ComPtr<ID2D1SolidColorBrush> brush;
+
+        HR(target->CreateSolidColorBrush(ColorF(0.0f, 0.0f, 0.0f),
+                                         brush.GetAddressOf()));
+
+        target->SetTextAntialiasMode(D2D1_TEXT_ANTIALIAS_MODE_GRAYSCALE);
+        target->BeginDraw();
+        target->Clear(ColorF(0.0f, 0.0f, 0.0f, 0.0f));
+
+        target->DrawText(&value,
+                         1,
+                         m_textFormat.Get(),
+                         RectF(0.0f, 0.0f, CardWidth, CardHeight),
+                         brush.Get());
+
+        HR(target->EndDraw());
+
+        vector<uint32_t> pixels(width * height);
+
+        HR(bitmap->CopyPixels(nullptr,
+                              width * sizeof(uint32_t),
+                              width * height * sizeof(uint32_t),
+                              reinterpret_cast<BYTE *>(pixels.data())));
+
+        AlphaMask mask(width, height);
+
+        for (unsigned i = 0; i != pixels.size(); ++i)
+        {
+            mask.Coverage[i] = static_cast<uint8_t>(pixels[i] >> 24);
+        }
+
+        return mask;
+    }
+
+    void UploadBitmap(ComPtr<IDCompositionSurface> const & surface,
+                      Bitmap const & bitmap)
+    {
+        ComPtr<IDXGISurface1> dxgi;
+        POINT offset = {};
+
+        HR(surface->BeginDraw(nullptr,
+                              __uuidof(dxgi),
+                              reinterpret_cast<void **>(dxgi.GetAddressOf()),
+                              &offset));
+
+        ComPtr<ID3D11Texture2D> texture;
+        HR(dxgi.As(&texture));
+
+        ComPtr<ID3D11DeviceContext> context;
+        m_device3D->GetImmediateContext(context.GetAddressOf());
+
+        D3D11_BOX const box =
+        {
+            static_cast<unsigned>(offset.x),
+            static_cast<unsigned>(offset.y),
+            0,
+            offset.x + bitmap.Width,
+            offset.y + bitmap.Height,
+            1
+        };
+
+        context->UpdateSubresource(texture.Get(),
+                                   0,
+                                   &box,
+                                   bitmap.Pixels.data(),
+                                   bitmap.Width * sizeof(uint32_t),
+                                   0);
+
+        HR(surface->EndDraw());
+    }
+
+    void DrawCardFrontSoftware(ComPtr<IDCompositionSurface> const & surface,
+                               GlyphEntry const & glyph)
+    {
+        TRACE_ZONE("DrawCardFrontSoftware");
+
+        Bitmap bitmap(static_cast<unsigned>(m_grid.Width),
+                      static_cast<unsigned>(m_grid.Height));
+
+        RenderCardFront(bitmap,
+                        m_glyphs.Pages[m_glyphs.Current],
+                        glyph);
+
+        UploadBitmap(surface, bitmap);
+    }
+
+    unsigned CardAtPoint(LPARAM const lparam,
+                         double const time)
+    {
+        TRACE_ZONE("CardAtPoint");
+
+        float const x = LOWORD(lparam) + m_viewport.ScrollX;
+        float const y = HIWORD(lparam) + m_viewport.ScrollY;
+
+        return m_picker.CardAt(m_grid,
+                               m_animations,
+                               time,
+                               x,
+                               y);
+    }
+
+    // The scroll position is scaled with the board when the DPI changes
+    void UpdateGrid(float const scaleX = 1.0f,
+                    float const scaleY = 1.0f)
+    {
+        m_grid.Build(m_game.Cards.Rows,
+                     m_game.Cards.Columns,
+                     CardMargin,
+                     CardWidth,
+                     CardHeight,
+                     m_dpiX,
+                     m_dpiY);
+
+        m_viewport.Resize(m_grid,
+                          LogicalToPhysical(WindowWidth(min(m_game.Cards.Columns, ViewportColumns)), m_dpiX),
+                          LogicalToPhysical(WindowHeight(min(m_game.Cards.Rows, ViewportRows)), m_dpiY),
+                          scaleX,
+                          scaleY);
+    }
+
+    // The card's track maps directly onto the segments of a composition
+    // animation so what is on screen is exactly what the track evaluates.
+    void UpdateAnimation(unsigned const card,
+                         LARGE_INTEGER const & frequency,
+                         ObjectPool<ComPtr<IDCompositionAnimation>> & pool)
+    {
+        TRACE_ZONE("UpdateAnimation");
+
+        // A card out of view takes up its flip when it comes back into view
+        unsigned const slot = m_slots.SlotOf[card];
+
+        if (NoCard == slot || !IsCurrent(m_visuals[slot])) return;
+
+        CardVisuals & visuals = m_visuals[slot];
+        AnimationTrack const & track = m_animations.Tracks[card];
+
+        if (0 == track.Count)
+        {
+            HR(visuals.Rotation->SetAngle(track.Final));
+            return;
+        }
+
+        double const begin = track.Segments[0].Begin;
+
+        ComPtr<IDCompositionAnimation> const & animation = pool.Acquire([&]
+        {
+            ComPtr<IDCompositionAnimation> created;
+            HR(m_device->CreateAnimation(created.GetAddressOf()));
+            return created;
+        });
+
+        HR(animation->Reset());
+
+        LARGE_INTEGER start = {};
+        start.QuadPart = static_cast<LONGLONG>(begin * frequency.QuadPart);
+        HR(animation->SetAbsoluteBeginTime(start));
+
+        for (unsigned i = 0; i != track.Count; ++i)
+        {
+            CurveSegment const & segment = track.Segments[i];
+
+            HR(animation->AddCubic(segment.Begin - begin,
+                                   segment.Constant,
+                                   segment.Linear,
+                                   segment.Quadratic,
+                                   segment.Cubic));
+        }
+
+        HR(animation->End(track.End - begin, track.Final));
+        HR(visuals.Rotation->SetAngle(animation.Get()));
+    }
+
+    void LeftButtonUpHandler(WPARAM,
+                             LPARAM const lparam)
+    {
+        // Clicks are logged where they land on the board, so that a replay
+        // need not follow the scrolling
+        RecordInput(InputKind::Click,
+                    LOWORD(lparam) + static_cast<unsigned>(m_viewport.ScrollX),
+                    HIWORD(lparam) + static_cast<unsigned>(m_viewport.ScrollY));
+
+        // Without a device there are no cards on screen to click
+        if (!IsDeviceCreated()) return;
+
+        TRACE_LATENCY("LeftButtonUpHandler", m_clickHistogram);
+
+        LARGE_INTEGER start = {};
+        VERIFY(QueryPerformanceCounter(&start));
+
+        try
+        {
+            DCOMPOSITION_FRAME_STATISTICS stats = {};
+            HR(m_device->GetFrameStatistics(&stats));
+
+            double const frequency = static_cast<double>(stats.timeFrequency.QuadPart);
+
+            // The click lands on the cards as the last frame showed them
+
+            unsigned const next = CardAtPoint(lparam, stats.lastFrameTime.QuadPart / frequency);
+            unsigned const first = m_game.FirstCard;
+
+            ClickResult const result = m_game.Click(next);
+
+            if (ClickResult::Ignored == result) return;
+
+            m_footprint.Restate(next, m_game.Cards.Status[next]);
+
+            if (NoCard != first)
             {
-                m_firstCard->Status = CardStatus::Hidden;
+                m_footprint.Restate(first, m_game.Cards.Status[first]);
+            }
 
-                if (IsMatch(m_firstCard->Value, nextCard->Value))
-                {
-                    m_firstCard->Status = nextCard->Status = CardStatus::Matched;
+            ObjectPool<ComPtr<IDCompositionAnimation>> & pool =
+                m_animationPools[static_cast<unsigned>(result)];
 
-                    UI_ANIMATION_KEYFRAME keyframe =
-                        AddShowTransition(*nextCard, storyboard);
+            pool.Recycle();
 
-                    AddHideTransition(*m_firstCard,
-                                      storyboard,
-                                      keyframe,
-                                      90.0);
+            double const time = stats.nextEstimatedFrameTime.QuadPart / frequency;
 
-                    AddHideTransition(*nextCard,
-                                      storyboard,
-                                      keyframe,
-                                      90.0);
-                }
-                else
-                {
-                    UI_ANIMATION_KEYFRAME keyframe =
-                        AddShowTransition(*nextCard, storyboard);
-
-                    AddHideTransition(*m_firstCard,
-                                      storyboard,
-                                      keyframe,
-                                      0.0);
-
-                    AddHideTransition(*nextCard,
-                                      storyboard,
-                                      keyframe,
-                                      0.0);
-                }
+            AnimateClick(m_animations,
+                         result,
+                         first,
+                         next,
+                         time,
+                         FlipCurve);
+
+            UpdateAnimation(next, stats.timeFrequency, pool);
+
+            if (ClickResult::Shown != result)
+            {
+                UpdateAnimation(first, stats.timeFrequency, pool);
+            }
 
-                HR(storyboard->Schedule(next));
-                UpdateAnimation(*m_firstCard);
-                UpdateAnimation(*nextCard);
+            Commit();
 
-                m_firstCard = nullptr;
+            if (ClickResult::Matched == result)
+            {
+                m_hiding.Add(first, m_animations.Tracks[first].End);
+                m_hiding.Add(next, m_animations.Tracks[next].End);
+                ScheduleReclaim();
             }
 
-            HR(m_device->Commit());
+            RecordClickLatency(start);
+
+            // The face is drawn once the flip is under way, since it only
+            // comes into view halfway through
+            if (ShowFront(next, true))
+            {
+                Commit();
+            }
         }
         catch (ComException const & e)
         {
@@ -740,12 +1501,187 @@ struct SampleWindow : Window<SampleWindow>
         }
     }
 
+    void MouseWheelHandler(WPARAM const wparam,
+                           LPARAM)
+    {
+        // A notch scrolls a row, or a column with shift held down
+        float const notches = -static_cast<float>(GET_WHEEL_DELTA_WPARAM(wparam)) / WHEEL_DELTA;
+
+        if (MK_SHIFT & GET_KEYSTATE_WPARAM(wparam))
+        {
+            Scroll(notches * m_grid.PitchX, 0.0f);
+        }
+        else
+        {
+            Scroll(0.0f, notches * m_grid.PitchY);
+        }
+    }
+
+    void MouseHorizontalWheelHandler(WPARAM const wparam,
+                                     LPARAM)
+    {
+        float const notches = static_cast<float>(GET_WHEEL_DELTA_WPARAM(wparam)) / WHEEL_DELTA;
+
+        Scroll(notches * m_grid.PitchX, 0.0f);
+    }
+
+    // Moves the board under the window, giving the visuals of the cards that
+    // leave the view to those that enter it
+    void Scroll(float const x,
+                float const y)
+    {
+        if (!m_viewport.ScrollBy(m_grid, x, y)) return;
+
+        // Without a device the view is brought up to date with everything else
+        if (!IsDeviceCreated()) return;
+
+        TRACE_ZONE("Scroll");
+
+        try
+        {
+            ScrollRoot();
+
+            if (!UpdateDeviceResources())
+            {
+                Commit();
+            }
+        }
+        catch (ComException const & e)
+        {
+            TRACE(L"Scroll failed 0x%X\n", e.result);
+
+            ReleaseDeviceResources();
+
+            VERIFY(InvalidateRect(m_window,
+                                  nullptr,
+                                  false));
+        }
+    }
+
+    // The composition clock is the performance counter
+    static double Now()
+    {
+        LARGE_INTEGER now = {};
+        LARGE_INTEGER frequency = {};
+        VERIFY(QueryPerformanceCounter(&now));
+        VERIFY(QueryPerformanceFrequency(&frequency));
+
+        return static_cast<double>(now.QuadPart) / frequency.QuadPart;
+    }
+
+    // Sets the timer for when the next matched card has finished hiding
+    void ScheduleReclaim()
+    {
+        if (m_hiding.Cards.empty())
+        {
+            KillTimer(m_window, ReclaimTimer);
+            return;
+        }
+
+        double const delay = max(0.0, m_hiding.NextDue() - Now());
+
+        VERIFY(SetTimer(m_window,
+                        ReclaimTimer,
+                        static_cast<UINT>(ceil(delay * 1000.0)),
+                        nullptr));
+    }
+
+    void TimerHandler(WPARAM const wparam,
+                      LPARAM)
+    {
+        if (ReclaimTimer != wparam) return;
+
+        TRACE_ZONE("ReclaimMatched");
+
+        try
+        {
+            // A matched card is reclaimed wherever it is; one out of view has
+            // already given up its visuals
+            unsigned const reclaimed = m_hiding.Complete(Now(), [this](unsigned const card)
+            {
+                if (IsDeviceCreated() && NoCard != m_slots.SlotOf[card])
+                {
+                    ReleaseVisuals(card, VisualsOf(card));
+                }
+            });
+
+            // The slots are freed for the cards in view along with the update
+            if (reclaimed && IsDeviceCreated() && !UpdateDeviceResources())
+            {
+                Commit();
+            }
+        }
+        catch (ComException const & e)
+        {
+            TRACE(L"TimerHandler failed 0x%X\n", e.result);
+
+            ReleaseDeviceResources();
+
+            VERIFY(InvalidateRect(m_window,
+                                  nullptr,
+                                  false));
+        }
+
+        ScheduleReclaim();
+    }
+
+    void RecordInput(InputKind const kind,
+                     unsigned const x = 0,
+                     unsigned const y = 0)
+    {
+        LARGE_INTEGER now = {};
+        LARGE_INTEGER frequency = {};
+        VERIFY(QueryPerformanceCounter(&now));
+        VERIFY(QueryPerformanceFrequency(&frequency));
+
+        m_input.Record(kind,
+                       static_cast<double>(now.QuadPart - m_inputStart.QuadPart) / frequency.QuadPart,
+                       x,
+                       y);
+    }
+
+    void RecordClickLatency(LARGE_INTEGER const & start)
+    {
+        LARGE_INTEGER now = {};
+        LARGE_INTEGER frequency = {};
+        VERIFY(QueryPerformanceCounter(&now));
+        VERIFY(QueryPerformanceFrequency(&frequency));
+
+        m_clickLatency.Record(static_cast<double>(now.QuadPart - start.QuadPart) / frequency.QuadPart);
+
+        if (0 != m_clickLatency.Count % LatencyReportInterval) return;
+
+        unsigned created = 0;
+        unsigned reused = 0;
+
+        for (ObjectPool<ComPtr<IDCompositionAnimation>> const & pool : m_animationPools)
+        {
+            created += pool.Created;
+            reused += pool.Reused;
+        }
+
+        TRACE(L"Click to commit p50 %.0f us p99 %.0f us, animations created %u reused %u\n",
+              m_clickLatency.Percentile(0.5) * 1e6,
+              m_clickLatency.Percentile(0.99) * 1e6,
+              created,
+              reused);
+    }
+
     void DpiChangedHandler(WPARAM const wparam,
                            LPARAM const lparam)
     {
+        RecordInput(InputKind::Dpi, LOWORD(wparam), HIWORD(wparam));
+
+        float const scaleX = LOWORD(wparam) / m_dpiX;
+        float const scaleY = HIWORD(wparam) / m_dpiY;
+
         m_dpiX = LOWORD(wparam);
         m_dpiY = HIWORD(wparam);
 
+        TRACE(L"DPI changed to %u by %u\n", LOWORD(wparam), HIWORD(wparam));
+
+        UpdateGrid(scaleX, scaleY);
+
         RECT const * suggested =
             reinterpret_cast<RECT const *>(lparam);
 
@@ -759,17 +1695,26 @@ struct SampleWindow : Window<SampleWindow>
                             size.height,
                             SWP_NOACTIVATE | SWP_NOZORDER));
 
-        ReleaseDeviceResources();
+        // The device survives a DPI change so only the resources that depend
+        // on the card size are rebuilt.
+
+        m_generations.InvalidateLayout();
+
+        VERIFY(InvalidateRect(m_window,
+                              nullptr,
+                              false));
     }
 
+    // The client area is the viewport, which is the whole board unless the
+    // board is larger than a window of ViewportRows by ViewportColumns
     D2D1_SIZE_U GetEffectiveWindowSize()
     {
         RECT rect =
         {
             0,
             0,
-            static_cast<int>(LogicalToPhysical(WindowWidth, m_dpiX)),
-            static_cast<int>(LogicalToPhysical(WindowHeight, m_dpiY))
+            static_cast<int>(m_viewport.Width),
+            static_cast<int>(m_viewport.Height)
         };
 
         VERIFY(AdjustWindowRect(&rect,
@@ -780,7 +1725,106 @@ struct SampleWindow : Window<SampleWindow>
                      rect.bottom - rect.top);
     }
 
-    void CreateHandler()
+    void ImageLoadedHandler(WPARAM,
+                            LPARAM)
+    {
+        m_background = m_imageLoader.get();
+        m_backImages.Reset(m_background.View);
+
+        // Without a device the atlas is created along with everything else
+        if (!IsDeviceCreated()) return;
+
+        try
+        {
+            CreateBackAtlas();
+
+            for (CardVisuals const & visuals : m_visuals)
+            {
+                if (!IsCurrent(visuals)) continue;
+
+                HR(visuals.BackContent->SetContent(m_backAtlas.Get()));
+            }
+
+            Commit();
+        }
+        catch (ComException const & e)
+        {
+            TRACE(L"ImageLoadedHandler failed 0x%X\n", e.result);
+
+            ReleaseDeviceResources();
+
+            VERIFY(InvalidateRect(m_window,
+                                  nullptr,
+                                  false));
+        }
+    }
+
+    void GlyphRasterizedHandler(WPARAM const wparam,
+                                LPARAM)
+    {
+        auto const request = find_if(m_glyphRequests.begin(), m_glyphRequests.end(), [&](GlyphRequest const & pending)
+        {
+            return pending.Value == wparam;
+        });
+
+        if (m_glyphRequests.end() == request) return;
+
+        wchar_t const value = request->Value;
+        unsigned const page = request->Page;
+        AlphaMask mask = request->Mask.get();
+        m_glyphRequests.erase(request);
+
+        // A glyph rasterized for another DPI is of no use, and one that
+        // failed is rasterized again as its cards are drawn
+        if (page == m_glyphs.Current && mask.Width)
+        {
+            m_glyphs.Find(value, [&](wchar_t)
+            {
+                return move(mask);
+            });
+        }
+
+        vector<unsigned> waiting;
+        swap(waiting, m_waitingFronts);
+
+        // Without a device the cards are drawn along with everything else
+        if (!IsDeviceCreated()) return;
+
+        try
+        {
+            bool drawn = false;
+
+            for (unsigned const card : waiting)
+            {
+                if (m_game.Cards.Value[card] == value)
+                {
+                    drawn = ShowFront(card, false) || drawn;
+                }
+                else
+                {
+                    m_waitingFronts.push_back(card);
+                }
+            }
+
+            if (drawn)
+            {
+                Commit();
+            }
+        }
+        catch (ComException const & e)
+        {
+            TRACE(L"GlyphRasterizedHandler failed 0x%X\n", e.result);
+
+            ReleaseDeviceResources();
+
+            VERIFY(InvalidateRect(m_window,
+                                  nullptr,
+                                  false));
+        }
+    }
+
+    void CreateHandler(WPARAM,
+                       LPARAM)
     {
         HMONITOR const monitor = MonitorFromWindow(m_window,
                                                    MONITOR_DEFAULTTONEAREST);
@@ -796,6 +1840,10 @@ struct SampleWindow : Window<SampleWindow>
         m_dpiX = static_cast<float>(dpiX);
         m_dpiY = static_cast<float>(dpiY);
 
+        RecordInput(InputKind::Dpi, dpiX, dpiY);
+
+        UpdateGrid();
+
         D2D1_SIZE_U const size = GetEffectiveWindowSize();
 
         VERIFY(SetWindowPos(m_window,
@@ -806,8 +1854,24 @@ struct SampleWindow : Window<SampleWindow>
                             SWP_NOACTIVATE | SWP_NOMOVE | SWP_NOZORDER));
     }
 
-    void PaintHandler()
+    // Creates the device and everything drawn with it, after device loss or
+    // for the first paint
+    void RebuildDeviceResources()
+    {
+        TRACE_LATENCY("RebuildDeviceResources", m_rebuildHistogram);
+
+        CreateDeviceResources();
+
+        // Card surfaces are created again only as the cards face up in view
+        // are drawn
+        UpdateDeviceResources();
+    }
+
+    void PaintHandler(WPARAM,
+                      LPARAM)
     {
+        RecordInput(InputKind::Paint);
+
         try
         {
             RECT rect = {};
@@ -816,10 +1880,11 @@ struct SampleWindow : Window<SampleWindow>
             if (IsDeviceCreated())
             {
                 HR(m_device3D->GetDeviceRemovedReason());
+                UpdateDeviceResources();
             }
             else
             {
-                CreateDeviceResources();
+                RebuildDeviceResources();
             }
 
             VERIFY(ValidateRect(m_window, nullptr));
@@ -831,20 +1896,69 @@ struct SampleWindow : Window<SampleWindow>
             ReleaseDeviceResources();
         }
     }
+
+    void WindowPosChangingHandler(WPARAM,
+                                  LPARAM)
+    {
+        // Prevent window resizing due to device loss
+    }
+
+    typedef MessageMap<SampleWindow,
+                       On<WM_LBUTTONUP, &SampleWindow::LeftButtonUpHandler>,
+                       On<WM_MOUSEWHEEL, &SampleWindow::MouseWheelHandler>,
+                       On<WM_MOUSEHWHEEL, &SampleWindow::MouseHorizontalWheelHandler>,
+                       On<WM_PAINT, &SampleWindow::PaintHandler>,
+                       On<WM_DPICHANGED, &SampleWindow::DpiChangedHandler>,
+                       On<WM_CREATE, &SampleWindow::CreateHandler>,
+                       On<ImageLoadedMessage, &SampleWindow::ImageLoadedHandler>,
+                       On<GlyphRasterizedMessage, &SampleWindow::GlyphRasterizedHandler>,
+                       On<WM_TIMER, &SampleWindow::TimerHandler>,
+                       On<WM_WINDOWPOSCHANGING, &SampleWindow::WindowPosChangingHandler>> Messages;
 };
 
 int __stdcall wWinMain(HINSTANCE, 
                        HINSTANCE, 
-                       PWSTR, 
+                       PWSTR commandLine, 
                        int)
 {
     HR(CoInitializeEx(nullptr, COINIT_MULTITHREADED));
 
-    SampleWindow window;
+    // The board dimensions may be given on the command line as "rows columns"
+    // optionally followed by a path to save the session's input to on exit.
+
+    unsigned rows = CardRows;
+    unsigned columns = CardColumns;
+    wchar_t inputPath[MAX_PATH] = {};
+
+    if (2 > swscanf_s(commandLine, L"%u %u %259s", &rows, &columns, inputPath, _countof(inputPath)) ||
+        !IsValidBoard(rows, columns))
+    {
+        rows = CardRows;
+        columns = CardColumns;
+    }
+
+    SampleWindow window(rows, columns);
     MSG message;
 
     while (GetMessage(&message, nullptr, 0, 0))
     {
         DispatchMessage(&message);
     }
+
+    if (*inputPath)
+    {
+        VERIFY(window.m_input.Save(inputPath));
+    }
+
+    #if TRACING
+    VERIFY(WriteChromeTrace(TracePath));
+
+    TRACE(L"Click to commit p50 %.0f us p99 %.0f us over %llu clicks, device rebuilds p50 %.1f ms worst %.1f ms over %llu\n",
+          window.m_clickHistogram.Percentile(0.5) * 1e6,
+          window.m_clickHistogram.Percentile(0.99) * 1e6,
+          window.m_clickHistogram.Count,
+          window.m_rebuildHistogram.Percentile(0.5) * 1e3,
+          window.m_rebuildHistogram.Worst * 1e3,
+          window.m_rebuildHistogram.Count);
+    #endif
 }
@@ -0,0 +1,21 @@
+#pragma once
+
+//
+// Instruction set selection for the portable kernels. Each kernel has a
+// scalar loop that handles whatever the vector loop leaves over, so the
+// same code builds where neither SSE2 nor AVX2 is available.
+//
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#define SIMD_SSE2 0
+#endif
+
+#if defined(__AVX2__)
+#define SIMD_AVX2 1
+#include <immintrin.h>
+#else
+#define SIMD_AVX2 0
+#endif
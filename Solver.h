@@ -0,0 +1,338 @@
+#pragma once
+
+#include "Board.h"
+#include "Parallel.h"
+#include "Random.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//
+// Strategies for playing a board and the means to measure them. A player
+// is given a freshly dealt game and clicks until it is complete. Monte Carlo
+// runs deal each game from the seed and the run's index alone, so results
+// are the same for a seed however many threads share the work.
+//
+
+// A scripted player with perfect memory: it turns over unseen cards in order
+// and completes any pair as soon as it has seen both halves. The deal is
+// random so the order it turns cards over in does not matter.
+struct MemoryPlayer
+{
+    std::vector<unsigned> m_seen;
+    std::vector<unsigned> m_known;
+
+    unsigned TakePartner(GameState const & game,
+                         unsigned const card)
+    {
+        for (unsigned i = 0; i != m_seen.size(); ++i)
+        {
+            unsigned const other = m_seen[i];
+
+            if (IsMatch(game.Cards.Value[card], game.Cards.Value[other]))
+            {
+                m_seen[i] = m_seen.back();
+                m_seen.pop_back();
+                return other;
+            }
+        }
+
+        return NoCard;
+    }
+
+    template <typename Generator>
+    void Play(GameState & game,
+              Generator &)
+    {
+        m_seen.clear();
+        m_known.clear();
+        unsigned next = 0;
+
+        while (!game.IsComplete())
+        {
+            if (!m_known.empty())
+            {
+                game.Click(m_known[0]);
+                game.Click(m_known[1]);
+                m_known.clear();
+                continue;
+            }
+
+            unsigned const first = next++;
+            unsigned const partner = TakePartner(game, first);
+
+            game.Click(first);
+
+            if (NoCard != partner)
+            {
+                game.Click(partner);
+                continue;
+            }
+
+            unsigned const second = next++;
+            game.Click(second);
+
+            if (game.Cards.Status[second] == CardStatus::Matched) continue;
+
+            unsigned const known = TakePartner(game, second);
+
+            if (NoCard == known)
+            {
+                m_seen.push_back(second);
+            }
+            else
+            {
+                m_known.push_back(second);
+                m_known.push_back(known);
+            }
+
+            m_seen.push_back(first);
+        }
+    }
+};
+
+//
+// A heuristic player that remembers only the most recent cards it has seen,
+// more like a person. It plays as MemoryPlayer does but turns over cards at
+// random from those it does not remember, and forgets the oldest card once
+// its memory is full. With no memory it clicks at random; with room for
+// every card it plays as well as MemoryPlayer.
+//
+
+struct ForgetfulPlayer
+{
+    unsigned Capacity;
+    std::vector<unsigned> m_memory;
+    std::vector<unsigned> m_unknown;
+
+    explicit ForgetfulPlayer(unsigned const capacity) :
+        Capacity(capacity)
+    {}
+
+    unsigned TakePartner(GameState const & game,
+                         unsigned const card)
+    {
+        for (unsigned i = 0; i != m_memory.size(); ++i)
+        {
+            unsigned const other = m_memory[i];
+
+            if (IsMatch(game.Cards.Value[card], game.Cards.Value[other]))
+            {
+                m_memory.erase(m_memory.begin() + i);
+                return other;
+            }
+        }
+
+        return NoCard;
+    }
+
+    template <typename Generator>
+    unsigned TakeUnknown(Generator & generator)
+    {
+        uint32_t const index = RandomBelow(generator, static_cast<uint32_t>(m_unknown.size()));
+        unsigned const card = m_unknown[index];
+
+        m_unknown[index] = m_unknown.back();
+        m_unknown.pop_back();
+        return card;
+    }
+
+    void Remember(unsigned const card)
+    {
+        m_memory.push_back(card);
+
+        if (m_memory.size() > Capacity)
+        {
+            m_unknown.push_back(m_memory.front());
+            m_memory.erase(m_memory.begin());
+        }
+    }
+
+    template <typename Generator>
+    void Play(GameState & game,
+              Generator & generator)
+    {
+        m_memory.clear();
+        m_unknown.resize(game.Cards.Count());
+
+        for (unsigned i = 0; i != game.Cards.Count(); ++i)
+        {
+            m_unknown[i] = i;
+        }
+
+        while (!game.IsComplete())
+        {
+            unsigned const first = TakeUnknown(generator);
+            unsigned const partner = TakePartner(game, first);
+
+            game.Click(first);
+
+            if (NoCard != partner)
+            {
+                game.Click(partner);
+                continue;
+            }
+
+            // The partner is hidden but not remembered, so there is
+            // always another unknown card to turn over
+
+            unsigned const second = TakeUnknown(generator);
+            game.Click(second);
+
+            if (game.Cards.Status[second] == CardStatus::Matched) continue;
+
+            unsigned const known = TakePartner(game, second);
+
+            Remember(first);
+
+            if (NoCard == known)
+            {
+                Remember(second);
+            }
+            else
+            {
+                game.Click(second);
+                game.Click(known);
+            }
+        }
+    }
+};
+
+//
+// The exact expected number of clicks MemoryPlayer makes on a board of the
+// given number of distinct pairs, without simulation. The state between
+// turns is the number of unseen cards and how many of them are partners of
+// cards seen once; the expectations of smaller states are built up first.
+//
+
+inline double PerfectMemoryClicks(unsigned const pairs)
+{
+    unsigned const cards = pairs * 2;
+
+    // expected[unseen * (cards + 1) + single]
+    std::vector<double> expected((cards + 1) * (cards + 1), 0.0);
+
+    auto at = [&](unsigned const unseen, unsigned const single) -> double &
+    {
+        return expected[unseen * (cards + 1) + single];
+    };
+
+    for (unsigned unseen = 1; unseen <= cards; ++unseen)
+    {
+        for (unsigned single = unseen % 2; single <= unseen; single += 2)
+        {
+            double const u = unseen;
+            double const k = single;
+            double value = 0.0;
+
+            // The first card turned over partners a card seen before
+            if (single)
+            {
+                value += k / u * (2.0 + at(unseen - 1, single - 1));
+            }
+
+            // Otherwise its partner is still unseen and a second card is
+            // turned over: its partner, the partner of an earlier card, to
+            // be taken next turn, or another new card.
+            if (unseen > single)
+            {
+                double const n = u - 1.0;
+                double fresh = 1.0 / n * (2.0 + at(unseen - 2, single));
+
+                fresh += k / n * (4.0 + at(unseen - 2, single));
+
+                if (unseen - 2 > single)
+                {
+                    fresh += (u - 2.0 - k) / n * (2.0 + at(unseen - 2, single + 2));
+                }
+
+                value += (u - k) / u * fresh;
+            }
+
+            at(unseen, single) = value;
+        }
+    }
+
+    return at(cards, 0);
+}
+
+struct StrategyResult
+{
+    double Mean = 0.0;
+    double Deviation = 0.0;
+    unsigned Median = 0;
+    unsigned P90 = 0;
+    unsigned Best = 0;
+    unsigned Worst = 0;
+    std::vector<unsigned> Clicks; // Per run, in run order
+};
+
+//
+// Plays the given number of games with a copy of the player per thread and
+// summarizes the clicks each game took. Run i is dealt by a generator seeded
+// with the seed on stream i.
+//
+
+template <typename Player>
+StrategyResult EvaluateStrategy(unsigned const rows,
+                                unsigned const columns,
+                                unsigned const runs,
+                                uint64_t const seed,
+                                Player const & player,
+                                unsigned const threads = HardwareThreads())
+{
+    StrategyResult result;
+    result.Clicks.resize(runs);
+
+    unsigned const workers = std::max(1u, std::min(threads, runs));
+    std::vector<Player> players(workers, player);
+    std::vector<GameState> games(workers, GameState(rows, columns));
+
+    ParallelForStealing(runs, workers, [&](unsigned const run, unsigned const worker)
+    {
+        Pcg32 generator(seed, run);
+        GameState & game = games[worker];
+
+        game.Reset(generator);
+        players[worker].Play(game, generator);
+        result.Clicks[run] = game.Clicks;
+    });
+
+    if (0 == runs) return result;
+
+    double sum = 0.0;
+    double squares = 0.0;
+
+    for (unsigned const clicks : result.Clicks)
+    {
+        sum += clicks;
+        squares += static_cast<double>(clicks) * clicks;
+    }
+
+    result.Mean = sum / runs;
+    result.Deviation = std::sqrt(std::max(0.0, squares / runs - result.Mean * result.Mean));
+
+    std::vector<unsigned> sorted(result.Clicks);
+    std::sort(sorted.begin(), sorted.end());
+
+    result.Median = sorted[runs / 2];
+    result.P90 = sorted[runs * 9 / 10];
+    result.Best = sorted.front();
+    result.Worst = sorted.back();
+    return result;
+}
+
+//
+// How hard a board is for a player: the clicks it takes beyond the minimum
+// of two per pair, relative to what perfect memory would need beyond that
+// minimum. A player as good as perfect memory scores 1.
+//
+
+inline double Difficulty(double const clicks,
+                         unsigned const pairs)
+{
+    double const minimum = 2.0 * pairs;
+    double const perfect = PerfectMemoryClicks(pairs) - minimum;
+
+    return perfect > 0.0 ? (clicks - minimum) / perfect : 1.0;
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+//
+// Keeps card surfaces for reuse rather than creating one whenever a card is
+// laid out. Surfaces are kept by size and format; one that is released goes
+// back to the pool and the next card needing that size and format takes it
+// without a device call. Free surfaces of the size cards currently take are
+// kept whole, since cards are going back and forth between them. Those of
+// every other size, such as the old size after a DPI change, are kept within
+// a budget, dropping those of the sizes used least recently first. Moving
+// back to the previous monitor then reuses as many as the budget held, and
+// the pool never holds more than the budget beyond what cards are using.
+//
+// Surfaces cannot outlive their device, so Lose drops every one of them.
+// Nothing is recreated up front: each card acquires a surface again when it
+// is next drawn, so recovery creates only those of the cards face up in view.
+//
+
+struct SurfaceKey
+{
+    unsigned Width;
+    unsigned Height;
+    unsigned Format;
+    unsigned PixelBytes;
+
+    size_t Bytes() const
+    {
+        return static_cast<size_t>(Width) * Height * PixelBytes;
+    }
+
+    bool operator==(SurfaceKey const & other) const
+    {
+        return Width == other.Width &&
+               Height == other.Height &&
+               Format == other.Format;
+    }
+
+    bool operator!=(SurfaceKey const & other) const
+    {
+        return !(*this == other);
+    }
+};
+
+template <typename Surface>
+struct SurfacePool
+{
+    struct Bucket
+    {
+        SurfaceKey Key;
+        std::vector<Surface> Free;
+        unsigned InUse = 0;
+        uint64_t LastUse = 0;
+    };
+
+    // There are only ever a few sizes, one or two per DPI seen
+    std::vector<Bucket> Buckets;
+    uint64_t Uses = 0;
+
+    // The size most recently acquired
+    SurfaceKey Current = {};
+
+    // The most the free surfaces of every size but the current one may take
+    size_t Budget = std::numeric_limits<size_t>::max();
+
+    size_t BytesInUse = 0;
+    size_t BytesFree = 0;
+    size_t HighWater = 0;
+    unsigned Created = 0;
+    unsigned Reused = 0;
+
+    // Create is called with the key to make a new surface when none is free
+    template <typename Create>
+    Surface Acquire(SurfaceKey const & key,
+                    Create && create)
+    {
+        Bucket & bucket = Find(key);
+        bucket.LastUse = ++Uses;
+
+        // The previous size now falls within the budget
+        if (Current != key)
+        {
+            Current = key;
+            Trim();
+        }
+
+        // Nothing is counted until the surface exists, in case creating it
+        // throws
+        Surface surface;
+
+        if (bucket.Free.empty())
+        {
+            surface = create(key);
+            ++Created;
+        }
+        else
+        {
+            surface = std::move(bucket.Free.back());
+            bucket.Free.pop_back();
+            BytesFree -= key.Bytes();
+            ++Reused;
+        }
+
+        ++bucket.InUse;
+        BytesInUse += key.Bytes();
+        Peak();
+        return surface;
+    }
+
+    // Takes back a surface acquired with the key for another card to use
+    void Release(SurfaceKey const & key,
+                 Surface && surface)
+    {
+        Bucket & bucket = Find(key);
+        Retire(bucket);
+
+        bucket.Free.push_back(std::move(surface));
+        BytesFree += key.Bytes();
+        bucket.LastUse = ++Uses;
+        Trim();
+    }
+
+    // Accounts for a surface acquired with the key that its card let go of
+    void Discard(SurfaceKey const & key)
+    {
+        Retire(Find(key));
+    }
+
+    // Drops every surface with the device that created them. Surfaces still
+    // held by cards must be let go of without being released or discarded.
+    void Lose()
+    {
+        for (Bucket & bucket : Buckets)
+        {
+            bucket.InUse = 0;
+            bucket.Free.clear();
+        }
+
+        BytesInUse = 0;
+        BytesFree = 0;
+    }
+
+    // Releases free surfaces of every size but the current one until they
+    // fit the budget
+    void Trim()
+    {
+        while (BytesFree - CurrentBytes() > Budget)
+        {
+            Bucket * oldest = nullptr;
+
+            for (Bucket & bucket : Buckets)
+            {
+                if (!bucket.Free.empty() && bucket.Key != Current && (!oldest || bucket.LastUse < oldest->LastUse))
+                {
+                    oldest = &bucket;
+                }
+            }
+
+            oldest->Free.pop_back();
+            BytesFree -= oldest->Key.Bytes();
+        }
+    }
+
+    // The bytes of the free surfaces of the current size
+    size_t CurrentBytes() const
+    {
+        for (Bucket const & bucket : Buckets)
+        {
+            if (bucket.Key == Current) return bucket.Free.size() * bucket.Key.Bytes();
+        }
+
+        return 0;
+    }
+
+    unsigned FreeCount() const
+    {
+        unsigned count = 0;
+
+        for (Bucket const & bucket : Buckets)
+        {
+            count += static_cast<unsigned>(bucket.Free.size());
+        }
+
+        return count;
+    }
+
+    Bucket & Find(SurfaceKey const & key)
+    {
+        for (Bucket & bucket : Buckets)
+        {
+            if (bucket.Key == key) return bucket;
+        }
+
+        Buckets.emplace_back();
+        Buckets.back().Key = key;
+        return Buckets.back();
+    }
+
+    void Retire(Bucket & bucket)
+    {
+        --bucket.InUse;
+        BytesInUse -= bucket.Key.Bytes();
+    }
+
+    void Peak()
+    {
+        if (HighWater < BytesInUse + BytesFree)
+        {
+            HighWater = BytesInUse + BytesFree;
+        }
+    }
+};
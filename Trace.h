@@ -0,0 +1,198 @@
+#pragma once
+
+#include "File.h"
+#include "Latency.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//
+// Scoped trace zones for the hot paths. A zone records its name, when it
+// began and how long it took into a buffer belonging to the thread, which
+// takes no lock and never allocates once the thread's first zone has been
+// recorded. The buffers keep each thread's most recent zones and are written
+// out in the Chrome trace format, for chrome://tracing or Perfetto.
+//
+// TRACE_ZONE and TRACE_LATENCY expand to nothing unless TRACING is nonzero,
+// so a build without tracing carries no trace code at all. Debug builds
+// trace by default; define TRACING=1 to trace a release build.
+//
+
+#ifndef TRACING
+#ifdef _DEBUG
+#define TRACING 1
+#else
+#define TRACING 0
+#endif
+#endif
+
+unsigned const TraceBufferCapacity = 64 * 1024;
+
+struct TraceEvent
+{
+    char const * Name; // A string literal
+    uint64_t Begin;    // Nanoseconds since tracing began
+    uint64_t Duration; // Nanoseconds
+};
+
+struct TraceBuffer
+{
+    unsigned Thread = 0;
+    std::unique_ptr<TraceEvent[]> Events;
+    std::atomic<uint64_t> Written;
+
+    explicit TraceBuffer(unsigned const thread) :
+        Thread(thread),
+        Events(new TraceEvent[TraceBufferCapacity]),
+        Written(0)
+    {}
+
+    void Record(TraceEvent const & event)
+    {
+        uint64_t const written = Written.load(std::memory_order_relaxed);
+
+        Events[written % TraceBufferCapacity] = event;
+        Written.store(written + 1, std::memory_order_release);
+    }
+};
+
+struct TraceRegistry
+{
+    std::chrono::steady_clock::time_point const Epoch = std::chrono::steady_clock::now();
+    std::mutex Lock;
+    std::vector<std::unique_ptr<TraceBuffer>> Buffers;
+
+    TraceBuffer * Register()
+    {
+        std::lock_guard<std::mutex> const lock(Lock);
+
+        Buffers.emplace_back(new TraceBuffer(static_cast<unsigned>(Buffers.size())));
+        return Buffers.back().get();
+    }
+
+    uint64_t Now() const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - Epoch).count());
+    }
+};
+
+// The buffers outlive their threads so that they can be written out at exit
+inline TraceRegistry & Traces()
+{
+    static TraceRegistry registry;
+    return registry;
+}
+
+inline TraceBuffer & ThreadTraceBuffer()
+{
+    thread_local TraceBuffer * const buffer = Traces().Register();
+    return *buffer;
+}
+
+// Records the time from its construction to its destruction
+struct TraceZone
+{
+    char const * m_name;
+    LatencyHistogram * m_histogram;
+    uint64_t m_begin;
+
+    explicit TraceZone(char const * name,
+                       LatencyHistogram * histogram = nullptr) :
+        m_name(name),
+        m_histogram(histogram),
+        m_begin(Traces().Now())
+    {}
+
+    ~TraceZone()
+    {
+        uint64_t const duration = Traces().Now() - m_begin;
+
+        ThreadTraceBuffer().Record(TraceEvent{ m_name, m_begin, duration });
+
+        if (m_histogram)
+        {
+            m_histogram->Record(duration / 1e9);
+        }
+    }
+
+    TraceZone(TraceZone const &) = delete;
+    TraceZone & operator=(TraceZone const &) = delete;
+};
+
+#define TRACE_CONCATENATE_(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_(a, b)
+
+#if TRACING
+#define TRACE_ZONE(name) TraceZone const TRACE_CONCATENATE(traceZone, __LINE__)(name)
+#define TRACE_LATENCY(name, histogram) TraceZone const TRACE_CONCATENATE(traceZone, __LINE__)(name, &(histogram))
+#else
+#define TRACE_ZONE(name)
+#define TRACE_LATENCY(name, histogram)
+#endif
+
+//
+// Writes every thread's recorded zones as Chrome trace JSON. Zones recorded
+// while the trace is being written may be torn, so it is best written once
+// the traced threads are idle, such as at exit.
+//
+
+inline bool WriteChromeTrace(PathChar const * path)
+{
+    FILE * file = nullptr;
+
+    #ifdef _WIN32
+    if (0 != _wfopen_s(&file, path, L"wb")) return false;
+    #else
+    file = fopen(path, "wb");
+    if (!file) return false;
+    #endif
+
+    TraceRegistry & registry = Traces();
+    std::lock_guard<std::mutex> const lock(registry.Lock);
+    char const * separator = "\n";
+
+    fputs("{\"traceEvents\":[", file);
+
+    for (std::unique_ptr<TraceBuffer> const & buffer : registry.Buffers)
+    {
+        fprintf(file,
+                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}",
+                separator,
+                buffer->Thread,
+                buffer->Thread);
+
+        separator = ",\n";
+
+        uint64_t const written = buffer->Written.load(std::memory_order_acquire);
+        uint64_t const first = written > TraceBufferCapacity ? written - TraceBufferCapacity : 0;
+
+        for (uint64_t i = first; i != written; ++i)
+        {
+            TraceEvent const & event = buffer->Events[i % TraceBufferCapacity];
+
+            fputs(",\n{\"name\":\"", file);
+
+            for (char const * c = event.Name; *c; ++c)
+            {
+                if ('"' == *c || '\\' == *c) fputc('\\', file);
+                fputc(*c, file);
+            }
+
+            fprintf(file,
+                    "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    buffer->Thread,
+                    event.Begin / 1e3,
+                    event.Duration / 1e3);
+        }
+    }
+
+    fputs("\n],\"displayTimeUnit\":\"ns\"}\n", file);
+
+    bool const written = !ferror(file);
+    return 0 == fclose(file) && written;
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "Layout.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//
+// Virtualizes a board larger than the window. The viewport is the part of
+// the board in view, scrolled in physical pixels. Only the cards within it
+// and a row and column either side, which a turning card may reach over and
+// a short scroll brings into view, are given visuals.
+//
+
+struct CardRange
+{
+    unsigned FirstRow = 0;
+    unsigned EndRow = 0;
+    unsigned FirstColumn = 0;
+    unsigned EndColumn = 0;
+
+    unsigned Count() const
+    {
+        return (EndRow - FirstRow) * (EndColumn - FirstColumn);
+    }
+
+    bool Contains(unsigned const card,
+                  unsigned const columns) const
+    {
+        unsigned const row = card / columns;
+        unsigned const column = card % columns;
+
+        return row >= FirstRow && row < EndRow &&
+               column >= FirstColumn && column < EndColumn;
+    }
+};
+
+struct Viewport
+{
+    float ScrollX = 0.0f;
+    float ScrollY = 0.0f;
+    float Width = 0.0f;
+    float Height = 0.0f;
+
+    static float Extent(float const origin,
+                        float const pitch,
+                        unsigned const count)
+    {
+        return origin + count * pitch;
+    }
+
+    // Resizes the viewport, scaling the scroll position by the same factor as
+    // the board when the DPI changes
+    void Resize(CardGrid const & grid,
+                float const width,
+                float const height,
+                float const scaleX = 1.0f,
+                float const scaleY = 1.0f)
+    {
+        Width = width;
+        Height = height;
+        ScrollX *= scaleX;
+        ScrollY *= scaleY;
+        ScrollBy(grid, 0.0f, 0.0f);
+    }
+
+    // Keeps the viewport on the board and returns whether it moved. It stops
+    // on whole pixels so that a click's position on the board is as whole as
+    // its position in the window, which is how the input log records it.
+    bool ScrollBy(CardGrid const & grid,
+                  float const x,
+                  float const y)
+    {
+        float const right = std::max(0.0f, std::floor(Extent(grid.OriginX, grid.PitchX, grid.Columns) - Width));
+        float const bottom = std::max(0.0f, std::floor(Extent(grid.OriginY, grid.PitchY, grid.Rows) - Height));
+
+        float const scrollX = std::min(std::max(std::round(ScrollX + x), 0.0f), right);
+        float const scrollY = std::min(std::max(std::round(ScrollY + y), 0.0f), bottom);
+
+        bool const moved = scrollX != ScrollX || scrollY != ScrollY;
+
+        ScrollX = scrollX;
+        ScrollY = scrollY;
+        return moved;
+    }
+
+    CardRange Range(CardGrid const & grid,
+                    unsigned const overscan = 1) const
+    {
+        CardRange range;
+
+        Span(ScrollX, Width, grid.OriginX, grid.PitchX, grid.Columns, overscan, range.FirstColumn, range.EndColumn);
+        Span(ScrollY, Height, grid.OriginY, grid.PitchY, grid.Rows, overscan, range.FirstRow, range.EndRow);
+
+        return range;
+    }
+
+    static void Span(float const scroll,
+                     float const size,
+                     float const origin,
+                     float const pitch,
+                     unsigned const count,
+                     unsigned const overscan,
+                     unsigned & first,
+                     unsigned & end)
+    {
+        float const low = std::floor((scroll - origin) / pitch);
+        float const high = std::ceil((scroll + size - origin) / pitch);
+
+        first = low > overscan ? static_cast<unsigned>(low) - overscan : 0;
+        end = high > 0.0f ? std::min(count, static_cast<unsigned>(high) + overscan) : 0;
+        first = std::min(first, end);
+    }
+};
+
+//
+// Visuals are kept in slots that pass from the cards leaving the viewport
+// to those entering it, so the number of slots depends on the size of the
+// window rather than the board. Bound lists the cards holding slots in card
+// order, which is also their drawing order, and Entering those given a slot
+// by the last update.
+//
+
+struct VisualSlots
+{
+    std::vector<unsigned> SlotOf; // By card, or NoCard
+    std::vector<unsigned> CardOf; // By slot, or NoCard
+    std::vector<unsigned> Free;
+    std::vector<unsigned> Bound;
+    std::vector<unsigned> Entering;
+
+    explicit VisualSlots(unsigned const cards) :
+        SlotOf(cards, NoCard)
+    {}
+
+    unsigned Slots() const
+    {
+        return static_cast<unsigned>(CardOf.size());
+    }
+
+    //
+    // Takes the slots from the cards outside the range, or that keep says
+    // have no more need of one, and gives them to the other cards inside it,
+    // returning how many cards left or entered. Unbind is called with each
+    // card that leaves and the slot it held, and may throw; each slot is
+    // recorded as free first so that the bookkeeping holds.
+    //
+
+    template <typename Keep, typename Unbind>
+    unsigned Update(CardRange const & range,
+                    unsigned const columns,
+                    Keep && keep,
+                    Unbind && unbind)
+    {
+        unsigned changed = 0;
+
+        for (unsigned const card : Bound)
+        {
+            unsigned const slot = SlotOf[card];
+
+            if (NoCard == slot || (range.Contains(card, columns) && keep(card))) continue;
+
+            SlotOf[card] = NoCard;
+            CardOf[slot] = NoCard;
+            Free.push_back(slot);
+            ++changed;
+
+            unbind(card, slot);
+        }
+
+        Bound.clear();
+        Entering.clear();
+
+        for (unsigned row = range.FirstRow; row != range.EndRow; ++row)
+        {
+            for (unsigned column = range.FirstColumn; column != range.EndColumn; ++column)
+            {
+                unsigned const card = row * columns + column;
+
+                if (!keep(card)) continue;
+
+                Bound.push_back(card);
+
+                if (NoCard != SlotOf[card]) continue;
+
+                unsigned slot = Slots();
+
+                if (Free.empty())
+                {
+                    CardOf.push_back(card);
+                }
+                else
+                {
+                    slot = Free.back();
+                    Free.pop_back();
+                    CardOf[slot] = card;
+                }
+
+                SlotOf[card] = slot;
+                Entering.push_back(card);
+            }
+        }
+
+        return changed + static_cast<unsigned>(Entering.size());
+    }
+
+    // The nearest card before this one that holds a slot and passes the test,
+    // or NoCard
+    template <typename Test>
+    unsigned Previous(unsigned const card,
+                      Test && test) const
+    {
+        auto i = std::lower_bound(Bound.begin(), Bound.end(), card);
+
+        while (i != Bound.begin())
+        {
+            --i;
+
+            if (test(*i)) return *i;
+        }
+
+        return NoCard;
+    }
+
+    // The nearest card after this one that holds a slot and passes the test,
+    // or NoCard
+    template <typename Test>
+    unsigned Next(unsigned const card,
+                  Test && test) const
+    {
+        for (auto i = std::upper_bound(Bound.begin(), Bound.end(), card); i != Bound.end(); ++i)
+        {
+            if (test(*i)) return *i;
+        }
+
+        return NoCard;
+    }
+};
@@ -1,20 +1,114 @@
 #pragma once
 
+#ifdef _WIN32
+#include "Debug.h"
+#else
+#include "Headless.h"
+#endif
+
+//
+// A window's messages are mapped to its handlers at compile time. Each entry
+// names a message and a member taking its WPARAM and LPARAM, and the map
+// expands to a chain of compares against constant ids with a direct call to
+// each handler, which the compiler lowers as it would a switch and free to
+// inline the handlers. Any ids may be mapped as long as none is mapped twice.
+// Messages that are not mapped fall through to the default handling.
+//
+
+template <typename T, UINT Message, void (T::*Handler)(WPARAM, LPARAM)>
+struct MessageEntry
+{
+    static UINT const Id = Message;
+
+    static void Call(T & that,
+                     WPARAM const wparam,
+                     LPARAM const lparam)
+    {
+        (that.*Handler)(wparam, lparam);
+    }
+};
+
+// Whether no id is given twice, past the first which is a placeholder
+template <size_t Count>
+constexpr bool DistinctMessages(UINT const (&ids)[Count])
+{
+    for (size_t i = 1; i != Count; ++i)
+    {
+        for (size_t j = i + 1; j != Count; ++j)
+        {
+            if (ids[i] == ids[j]) return false;
+        }
+    }
+
+    return true;
+}
+
+template <typename T, typename... Entries>
+struct MessageMap;
+
+template <typename T>
+struct MessageMap<T>
+{
+    static bool Dispatch(T &,
+                         UINT,
+                         WPARAM,
+                         LPARAM)
+    {
+        return false;
+    }
+};
+
+template <typename T, typename Entry, typename... Entries>
+struct MessageMap<T, Entry, Entries...>
+{
+    // A leading WM_NULL keeps the first id from being compared with itself
+    static constexpr UINT Ids[] = { WM_NULL, Entry::Id, Entries::Id... };
+
+    static_assert(DistinctMessages(Ids), "A message is mapped twice");
+
+    // Returns false if the message is not mapped
+    static bool Dispatch(T & that,
+                         UINT const message,
+                         WPARAM const wparam,
+                         LPARAM const lparam)
+    {
+        if (Entry::Id == message)
+        {
+            Entry::Call(that, wparam, lparam);
+            return true;
+        }
+
+        return MessageMap<T, Entries...>::Dispatch(that,
+                                                   message,
+                                                   wparam,
+                                                   lparam);
+    }
+};
+
+template <typename T, typename Entry, typename... Entries>
+constexpr UINT MessageMap<T, Entry, Entries...>::Ids[];
+
 template <typename T>
 struct Window
 {
     HWND m_window = nullptr;
 
+    // A window replaces this with its own map of On entries
+    typedef MessageMap<T> Messages;
+
+    template <UINT Message, void (T::*Handler)(WPARAM, LPARAM)>
+    using On = MessageEntry<T, Message, Handler>;
+
     static T * GetThisFromHandle(HWND const window)
     {
         return reinterpret_cast<T *>(GetWindowLongPtr(window,
                                                       GWLP_USERDATA));
     }
 
-    static LRESULT __stdcall WndProc(HWND const window,
-                                     UINT const message,
-                                     WPARAM const wparam,
-                                     LPARAM const lparam)
+    static LRESULT CALLBACK WndProc(HWND const window,
+                                    UINT const message,
+                                    WPARAM const wparam,
+                                    LPARAM const lparam)
     {
         ASSERT(window);
 
@@ -49,6 +143,14 @@ struct Window
                            WPARAM const wparam,
                            LPARAM const lparam)
     {
+        if (T::Messages::Dispatch(static_cast<T &>(*this),
+                                  message,
+                                  wparam,
+                                  lparam))
+        {
+            return 0;
+        }
+
         if (WM_DESTROY == message)
         {
             PostQuitMessage(0);
@@ -63,4 +165,17 @@ struct Window
 
         return 0;
     }
+
+    #ifndef _WIN32
+
+    void CreateHeadless()
+    {
+        ASSERT(!m_window);
+
+        CreateHeadlessWindow(WndProc, static_cast<T *>(this));
+
+        ASSERT(m_window);
+    }
+
+    #endif
 };